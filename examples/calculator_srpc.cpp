@@ -1,7 +1,14 @@
 #include <srpc/core.hpp>
 #include <srpc/transport.hpp>
+#include <srpc/client.hpp>
 #include <srpc/packer.hpp>
+#include <cstring>
 #include <stdexcept>
+#include <string_view>
+#include <span>
+#include <vector>
+#include <unordered_map>
+#include <memory_resource>
 #include <cstdint>
 
 /**
@@ -16,8 +23,36 @@ struct Number : public srpc::message_base {
 	static constexpr auto fields = std::make_tuple(
 		STRUCT_MEMBER(Number, num, "Number::num")
 	);
-	void unpack(srpc::buffer::ptr bp) override {
-		srpc::packer p(bp);
+	void encode(srpc::packer& p) const {
+		p << num;
+	}
+	void decode(srpc::packer& p) {
+		p >> num;
+	}
+	constexpr size_t encoded_size(srpc::wire_format f) const noexcept {
+		if (f == srpc::wire_format::FIXED) { return wire_size; }
+		return srpc::packer::encoded_size(num, f);
+	}
+
+	// fixed layout
+	static constexpr size_t wire_size = 4;
+	void encode_to(uint8_t* out) const {
+		std::memcpy(out + 0, &num, sizeof(num));
+	}
+	void decode_from(const uint8_t* in) {
+		std::memcpy(&num, in + 0, sizeof(num));
+	}
+};
+
+struct Number_view : public srpc::message_base {
+	int32_t num;
+
+	// overrides
+	static constexpr const char* name = "Number";
+	static constexpr auto fields = std::make_tuple(
+		STRUCT_MEMBER(Number_view, num, "Number::num")
+	);
+	void decode(srpc::packer& p) {
 		p >> num;
 	}
 };
@@ -32,127 +67,298 @@ struct TwoNumbers : public srpc::message_base {
 		STRUCT_MEMBER(TwoNumbers, left, "TwoNumbers::left"),
 		STRUCT_MEMBER(TwoNumbers, right, "TwoNumbers::right")
 	);
-	void unpack(srpc::buffer::ptr bp) override {
-		srpc::packer p(bp);
+	void encode(srpc::packer& p) const {
+		p << left;
+		p << right;
+	}
+	void decode(srpc::packer& p) {
 		p >> left;
 		p >> right;
 	}
+	constexpr size_t encoded_size(srpc::wire_format f) const noexcept {
+		if (f == srpc::wire_format::FIXED) { return wire_size; }
+		return srpc::packer::encoded_size(left, f)
+			+ srpc::packer::encoded_size(right, f);
+	}
+
+	// fixed layout
+	static constexpr size_t wire_size = 8;
+	void encode_to(uint8_t* out) const {
+		std::memcpy(out + 0, &left, sizeof(left));
+		std::memcpy(out + 4, &right, sizeof(right));
+	}
+	void decode_from(const uint8_t* in) {
+		std::memcpy(&left, in + 0, sizeof(left));
+		std::memcpy(&right, in + 4, sizeof(right));
+	}
+};
+
+struct TwoNumbers_view : public srpc::message_base {
+	int32_t left;
+	int32_t right;
+
+	// overrides
+	static constexpr const char* name = "TwoNumbers";
+	static constexpr auto fields = std::make_tuple(
+		STRUCT_MEMBER(TwoNumbers_view, left, "TwoNumbers::left"),
+		STRUCT_MEMBER(TwoNumbers_view, right, "TwoNumbers::right")
+	);
+	void decode(srpc::packer& p) {
+		p >> left;
+		p >> right;
+	}
+};
+
+struct Calculator_method_ids {
+	static constexpr uint32_t add = 0;
+	static constexpr uint32_t subtract = 1;
+	static constexpr uint32_t multiply = 2;
+	static constexpr uint32_t divide = 3;
+	static constexpr uint32_t square = 4;
 };
 
 struct Calculator_stub {
-	Calculator_stub() {
-		if (!_init) {
-			srpc::message_registry["TwoNumbers"] = []() -> std::unique_ptr<TwoNumbers> {
-				return std::make_unique<TwoNumbers>();
-			};
-			srpc::message_registry["Number"] = []() -> std::unique_ptr<Number> {
-				return std::make_unique<Number>();
-			};
+	void register_insecure_channel(std::string server_ip, std::string port) {
+		_channel = srpc::channel::create(server_ip, port);
+	}
+
+	void register_channel(srpc::channel::ptr channel) {
+		_channel = std::move(channel);
+	}
+
+	Number add(const TwoNumbers& req) {
+		if (_channel->format() == srpc::wire_format::FIXED) {
+			return srpc::fixed_call<Number>(*_channel, Calculator_method_ids::add, req);
 		}
-		_init = true;
+
+		srpc::packer pr(_channel->format());
+		pr.set_chained(true);
+		pr.pack_request(Calculator_method_ids::add, req);
+
+		srpc::message_t res = _channel->call(pr.release_chain());
+		srpc::packer rpr(std::move(res), pr.format());
+
+		return rpr.unpack_response<Number>().take_value();
 	}
 
-	void register_insecure_channel(std::string server_ip, std::string port) {
-		if (_socket != -1) { close(_socket); }
-		_socket = srpc::transport::create_client_socket(server_ip, port);
+	void add_async(const TwoNumbers& req, std::function<void(Number)> done) {
+		if (_channel->format() == srpc::wire_format::FIXED) {
+			srpc::fixed_call_then<Number>(*_channel, Calculator_method_ids::add, req, std::move(done));
+			return;
+		}
+
+		srpc::packer pr(_channel->format());
+		pr.set_chained(true);
+		pr.pack_request(Calculator_method_ids::add, req);
+
+		_channel->call_then(pr.release_chain(), [done = std::move(done), format = pr.format()] (srpc::message_t res) {
+			srpc::packer rpr(std::move(res), format);
+			done(rpr.unpack_response<Number>().take_value());
+		});
 	}
 
-	Number add(TwoNumbers& req) {
-		srpc::packer pr;
-		srpc::request_t<TwoNumbers> request;
-		request.set_method_name("Calculator_servicer::add");
-		request.set_value(std::move(req));
-		pr.pack_request(request);
+	std::future<Number> add_async(const TwoNumbers& req) {
+		auto p = std::make_shared<std::promise<Number>>();
+		std::future<Number> f = p->get_future();
+		add_async(req, [p] (Number v) { p->set_value(std::move(v)); });
+		return f;
+	}
 
-		srpc::transport::send_data(_socket, (*pr.buf()).data(), pr.size());
-		srpc::message_t res = srpc::transport::recv_data(_socket);
-		srpc::packer rpr(res.data(), res.size());
+	srpc::callback_awaitable<Number> add_co(const TwoNumbers& req) {
+		return srpc::callback_awaitable<Number>([this, req] (std::function<void(Number)> done) mutable {
+			add_async(req, std::move(done));
+		});
+	}
+	Number subtract(const TwoNumbers& req) {
+		if (_channel->format() == srpc::wire_format::FIXED) {
+			return srpc::fixed_call<Number>(*_channel, Calculator_method_ids::subtract, req);
+		}
 
-		srpc::response_t<Number> msg = rpr.unpack_response<Number>();
+		srpc::packer pr(_channel->format());
+		pr.set_chained(true);
+		pr.pack_request(Calculator_method_ids::subtract, req);
 
-		return msg.value();
+		srpc::message_t res = _channel->call(pr.release_chain());
+		srpc::packer rpr(std::move(res), pr.format());
+
+		return rpr.unpack_response<Number>().take_value();
 	}
-	Number subtract(TwoNumbers& req) {
-		srpc::packer pr;
-		srpc::request_t<TwoNumbers> request;
-		request.set_method_name("Calculator_servicer::subtract");
-		request.set_value(std::move(req));
-		pr.pack_request(request);
 
-		srpc::transport::send_data(_socket, (*pr.buf()).data(), pr.size());
-		srpc::message_t res = srpc::transport::recv_data(_socket);
-		srpc::packer rpr(res.data(), res.size());
+	void subtract_async(const TwoNumbers& req, std::function<void(Number)> done) {
+		if (_channel->format() == srpc::wire_format::FIXED) {
+			srpc::fixed_call_then<Number>(*_channel, Calculator_method_ids::subtract, req, std::move(done));
+			return;
+		}
+
+		srpc::packer pr(_channel->format());
+		pr.set_chained(true);
+		pr.pack_request(Calculator_method_ids::subtract, req);
+
+		_channel->call_then(pr.release_chain(), [done = std::move(done), format = pr.format()] (srpc::message_t res) {
+			srpc::packer rpr(std::move(res), format);
+			done(rpr.unpack_response<Number>().take_value());
+		});
+	}
 
-		srpc::response_t<Number> msg = rpr.unpack_response<Number>();
+	std::future<Number> subtract_async(const TwoNumbers& req) {
+		auto p = std::make_shared<std::promise<Number>>();
+		std::future<Number> f = p->get_future();
+		subtract_async(req, [p] (Number v) { p->set_value(std::move(v)); });
+		return f;
+	}
 
-		return msg.value();
+	srpc::callback_awaitable<Number> subtract_co(const TwoNumbers& req) {
+		return srpc::callback_awaitable<Number>([this, req] (std::function<void(Number)> done) mutable {
+			subtract_async(req, std::move(done));
+		});
 	}
-	Number multiply(TwoNumbers& req) {
-		srpc::packer pr;
-		srpc::request_t<TwoNumbers> request;
-		request.set_method_name("Calculator_servicer::multiply");
-		request.set_value(std::move(req));
-		pr.pack_request(request);
+	Number multiply(const TwoNumbers& req) {
+		if (_channel->format() == srpc::wire_format::FIXED) {
+			return srpc::fixed_call<Number>(*_channel, Calculator_method_ids::multiply, req);
+		}
 
-		srpc::transport::send_data(_socket, (*pr.buf()).data(), pr.size());
-		srpc::message_t res = srpc::transport::recv_data(_socket);
-		srpc::packer rpr(res.data(), res.size());
+		srpc::packer pr(_channel->format());
+		pr.set_chained(true);
+		pr.pack_request(Calculator_method_ids::multiply, req);
 
-		srpc::response_t<Number> msg = rpr.unpack_response<Number>();
+		srpc::message_t res = _channel->call(pr.release_chain());
+		srpc::packer rpr(std::move(res), pr.format());
 
-		return msg.value();
+		return rpr.unpack_response<Number>().take_value();
 	}
-	Number divide(TwoNumbers& req) {
-		srpc::packer pr;
-		srpc::request_t<TwoNumbers> request;
-		request.set_method_name("Calculator_servicer::divide");
-		request.set_value(std::move(req));
-		pr.pack_request(request);
 
-		srpc::transport::send_data(_socket, (*pr.buf()).data(), pr.size());
-		srpc::message_t res = srpc::transport::recv_data(_socket);
-		srpc::packer rpr(res.data(), res.size());
+	void multiply_async(const TwoNumbers& req, std::function<void(Number)> done) {
+		if (_channel->format() == srpc::wire_format::FIXED) {
+			srpc::fixed_call_then<Number>(*_channel, Calculator_method_ids::multiply, req, std::move(done));
+			return;
+		}
 
-		srpc::response_t<Number> msg = rpr.unpack_response<Number>();
+		srpc::packer pr(_channel->format());
+		pr.set_chained(true);
+		pr.pack_request(Calculator_method_ids::multiply, req);
 
-		return msg.value();
+		_channel->call_then(pr.release_chain(), [done = std::move(done), format = pr.format()] (srpc::message_t res) {
+			srpc::packer rpr(std::move(res), format);
+			done(rpr.unpack_response<Number>().take_value());
+		});
 	}
-	Number square(Number& req) {
-		srpc::packer pr;
-		srpc::request_t<Number> request;
-		request.set_method_name("Calculator_servicer::square");
-		request.set_value(std::move(req));
-		pr.pack_request(request);
 
-		srpc::transport::send_data(_socket, (*pr.buf()).data(), pr.size());
-		srpc::message_t res = srpc::transport::recv_data(_socket);
-		srpc::packer rpr(res.data(), res.size());
+	std::future<Number> multiply_async(const TwoNumbers& req) {
+		auto p = std::make_shared<std::promise<Number>>();
+		std::future<Number> f = p->get_future();
+		multiply_async(req, [p] (Number v) { p->set_value(std::move(v)); });
+		return f;
+	}
 
-		srpc::response_t<Number> msg = rpr.unpack_response<Number>();
+	srpc::callback_awaitable<Number> multiply_co(const TwoNumbers& req) {
+		return srpc::callback_awaitable<Number>([this, req] (std::function<void(Number)> done) mutable {
+			multiply_async(req, std::move(done));
+		});
+	}
+	Number divide(const TwoNumbers& req) {
+		if (_channel->format() == srpc::wire_format::FIXED) {
+			return srpc::fixed_call<Number>(*_channel, Calculator_method_ids::divide, req);
+		}
 
-		return msg.value();
+		srpc::packer pr(_channel->format());
+		pr.set_chained(true);
+		pr.pack_request(Calculator_method_ids::divide, req);
+
+		srpc::message_t res = _channel->call(pr.release_chain());
+		srpc::packer rpr(std::move(res), pr.format());
+
+		return rpr.unpack_response<Number>().take_value();
+	}
+
+	void divide_async(const TwoNumbers& req, std::function<void(Number)> done) {
+		if (_channel->format() == srpc::wire_format::FIXED) {
+			srpc::fixed_call_then<Number>(*_channel, Calculator_method_ids::divide, req, std::move(done));
+			return;
+		}
+
+		srpc::packer pr(_channel->format());
+		pr.set_chained(true);
+		pr.pack_request(Calculator_method_ids::divide, req);
+
+		_channel->call_then(pr.release_chain(), [done = std::move(done), format = pr.format()] (srpc::message_t res) {
+			srpc::packer rpr(std::move(res), format);
+			done(rpr.unpack_response<Number>().take_value());
+		});
+	}
+
+	std::future<Number> divide_async(const TwoNumbers& req) {
+		auto p = std::make_shared<std::promise<Number>>();
+		std::future<Number> f = p->get_future();
+		divide_async(req, [p] (Number v) { p->set_value(std::move(v)); });
+		return f;
+	}
+
+	srpc::callback_awaitable<Number> divide_co(const TwoNumbers& req) {
+		return srpc::callback_awaitable<Number>([this, req] (std::function<void(Number)> done) mutable {
+			divide_async(req, std::move(done));
+		});
+	}
+	Number square(const Number& req) {
+		if (_channel->format() == srpc::wire_format::FIXED) {
+			return srpc::fixed_call<Number>(*_channel, Calculator_method_ids::square, req);
+		}
+
+		srpc::packer pr(_channel->format());
+		pr.set_chained(true);
+		pr.pack_request(Calculator_method_ids::square, req);
+
+		srpc::message_t res = _channel->call(pr.release_chain());
+		srpc::packer rpr(std::move(res), pr.format());
+
+		return rpr.unpack_response<Number>().take_value();
+	}
+
+	void square_async(const Number& req, std::function<void(Number)> done) {
+		if (_channel->format() == srpc::wire_format::FIXED) {
+			srpc::fixed_call_then<Number>(*_channel, Calculator_method_ids::square, req, std::move(done));
+			return;
+		}
+
+		srpc::packer pr(_channel->format());
+		pr.set_chained(true);
+		pr.pack_request(Calculator_method_ids::square, req);
+
+		_channel->call_then(pr.release_chain(), [done = std::move(done), format = pr.format()] (srpc::message_t res) {
+			srpc::packer rpr(std::move(res), format);
+			done(rpr.unpack_response<Number>().take_value());
+		});
+	}
+
+	std::future<Number> square_async(const Number& req) {
+		auto p = std::make_shared<std::promise<Number>>();
+		std::future<Number> f = p->get_future();
+		square_async(req, [p] (Number v) { p->set_value(std::move(v)); });
+		return f;
+	}
+
+	srpc::callback_awaitable<Number> square_co(const Number& req) {
+		return srpc::callback_awaitable<Number>([this, req] (std::function<void(Number)> done) mutable {
+			square_async(req, std::move(done));
+		});
 	}
 private:
-	static bool _init;
-	int32_t _socket = -1;
+	srpc::channel::ptr _channel;
 };
 
-inline bool Calculator_stub::_init = false;
-
 struct Calculator_servicer : srpc::servicer_base {
-	virtual Number add(TwoNumbers& req) { throw std::runtime_error("Method not implemented!"); }
-	virtual Number subtract(TwoNumbers& req) { throw std::runtime_error("Method not implemented!"); }
-	virtual Number multiply(TwoNumbers& req) { throw std::runtime_error("Method not implemented!"); }
-	virtual Number divide(TwoNumbers& req) { throw std::runtime_error("Method not implemented!"); }
-	virtual Number square(Number& req) { throw std::runtime_error("Method not implemented!"); }
+	virtual Number add([[maybe_unused]] TwoNumbers& req) { throw std::runtime_error("Method not implemented!"); }
+	virtual Number subtract([[maybe_unused]] TwoNumbers& req) { throw std::runtime_error("Method not implemented!"); }
+	virtual Number multiply([[maybe_unused]] TwoNumbers& req) { throw std::runtime_error("Method not implemented!"); }
+	virtual Number divide([[maybe_unused]] TwoNumbers& req) { throw std::runtime_error("Method not implemented!"); }
+	virtual Number square([[maybe_unused]] Number& req) { throw std::runtime_error("Method not implemented!"); }
 
 	static constexpr const char* name = "Calculator";
 	static constexpr auto methods = std::make_tuple(
-		STRUCT_MEMBER(Calculator_servicer, add, "Calculator_servicer::add"),
-		STRUCT_MEMBER(Calculator_servicer, subtract, "Calculator_servicer::subtract"),
-		STRUCT_MEMBER(Calculator_servicer, multiply, "Calculator_servicer::multiply"),
-		STRUCT_MEMBER(Calculator_servicer, divide, "Calculator_servicer::divide"),
-		STRUCT_MEMBER(Calculator_servicer, square, "Calculator_servicer::square")
+		SERVICE_METHOD(Calculator_servicer, add, "Calculator_servicer::add", Calculator_method_ids::add),
+		SERVICE_METHOD(Calculator_servicer, subtract, "Calculator_servicer::subtract", Calculator_method_ids::subtract),
+		SERVICE_METHOD(Calculator_servicer, multiply, "Calculator_servicer::multiply", Calculator_method_ids::multiply),
+		SERVICE_METHOD(Calculator_servicer, divide, "Calculator_servicer::divide", Calculator_method_ids::divide),
+		SERVICE_METHOD(Calculator_servicer, square, "Calculator_servicer::square", Calculator_method_ids::square)
 	);
 };
 
@@ -0,0 +1,140 @@
+#pragma once
+
+#include "pool.hpp"
+#include <new>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <utility>
+#include <memory_resource>
+
+namespace srpc {
+
+#define ARENA_CHUNK_SZ 4096     // first chunk of a request arena, later ones double
+
+/// Allocator drawing from buffer_pool::global(), for the few long-lived blocks (such
+/// as request_arenas themselves) that should not go through malloc either.
+template <typename T>
+struct pool_allocator {
+    using value_type = T;
+
+    pool_allocator() noexcept = default;
+    template <typename U> pool_allocator(pool_allocator<U> const&) noexcept {}
+
+    T* allocate(size_t n) {
+        void* p = buffer_pool::global().allocate(n * sizeof(T));
+        if (!p) { throw std::bad_alloc(); }
+        return static_cast<T*>(p);
+    }
+    void deallocate(T* p, size_t n) noexcept { buffer_pool::global().deallocate(p, n * sizeof(T)); }
+
+    template <typename U> bool operator==(pool_allocator<U> const&) const noexcept { return true; }
+};
+
+/// Monotonic memory for everything one server call allocates: its packers and their
+/// buffers, the decoded argument and the response. Bump allocated from chunks of
+/// buffer_pool::global(), freeing single objects is a no-op and the chunks go back to
+/// the pool all at once when the arena is destroyed, so a server in steady state does
+/// not call malloc for them. Objects are placed in it with make_in(), which keeps the
+/// arena alive until the last of them is gone (typically once the response is sent).
+/// Not thread-safe, one call only allocates from one thread at a time.
+class request_arena : public std::pmr::memory_resource {
+    struct private_tag {};
+
+public:
+    using ptr = std::shared_ptr<request_arena>;
+
+    /// The arena and its reference count come from the buffer pool as well.
+    static ptr create() { return std::allocate_shared<request_arena>(pool_allocator<request_arena>{}, private_tag{}); }
+
+    explicit request_arena(private_tag) noexcept { _live.fetch_add(1, std::memory_order_relaxed); }
+
+    ~request_arena() override {
+        while (_chunks) {
+            chunk* c = _chunks;
+            _chunks = c->prev;
+            buffer_pool::global().deallocate(c, c->size);
+        }
+        _live.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    request_arena(const request_arena&) = delete;
+    request_arena& operator=(const request_arena&) = delete;
+
+    /// Bytes handed out so far, padding included.
+    size_t allocated() const noexcept { return _allocated; }
+
+    /// Number of chunks taken from the pool.
+    size_t chunk_count() const noexcept {
+        size_t n = 0;
+        for (chunk* c = _chunks; c; c = c->prev) { n++; }
+        return n;
+    }
+
+    /// Arenas alive in the process, to check that calls give theirs back.
+    static size_t live_count() noexcept { return _live.load(std::memory_order_relaxed); }
+
+private:
+    /// Header at the start of every chunk, chunks are linked newest first.
+    struct chunk {
+        chunk*  prev;
+        size_t  size;
+    };
+
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        uintptr_t p = (_cur + alignment - 1) & ~(uintptr_t{alignment} - 1);
+        if (!_chunks || p + bytes > _end) {
+            size_t size = _chunks ? _chunks->size * 2 : ARENA_CHUNK_SZ;
+            while (size < sizeof(chunk) + alignment + bytes) { size *= 2; }
+
+            chunk* c = static_cast<chunk*>(buffer_pool::global().allocate(size));
+            if (!c) { throw std::bad_alloc(); }
+            c->prev = _chunks;
+            c->size = size;
+            _chunks = c;
+            _cur = reinterpret_cast<uintptr_t>(c + 1);
+            _end = reinterpret_cast<uintptr_t>(c) + size;
+            p = (_cur + alignment - 1) & ~(uintptr_t{alignment} - 1);
+        }
+        _allocated += p + bytes - _cur;
+        _cur = p + bytes;
+        return reinterpret_cast<void*>(p);
+    }
+
+    void do_deallocate(void*, size_t, size_t) override {}
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+    chunk*      _chunks = nullptr;
+    uintptr_t   _cur = 0;
+    uintptr_t   _end = 0;
+    size_t      _allocated = 0;
+
+    static inline std::atomic<size_t> _live = 0;
+};
+
+/// Allocates from a request_arena and owns a reference to it. shared_ptrs made with
+/// it free their block through a copy of the allocator, so the arena outlives them.
+template <typename T>
+struct arena_allocator {
+    using value_type = T;
+
+    explicit arena_allocator(request_arena::ptr a) noexcept : arena(std::move(a)) {}
+    template <typename U> arena_allocator(arena_allocator<U> const& other) noexcept : arena(other.arena) {}
+
+    T* allocate(size_t n) { return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T))); }
+    void deallocate(T* p, size_t n) noexcept { arena->deallocate(p, n * sizeof(T), alignof(T)); }
+
+    template <typename U> bool operator==(arena_allocator<U> const& other) const noexcept { return arena == other.arena; }
+
+    request_arena::ptr arena;
+};
+
+/// make_shared in arena a, or on the heap if there is none.
+template <typename T, typename... Args>
+std::shared_ptr<T> make_in(request_arena::ptr const& a, Args&&... args) {
+    if (!a) { return std::make_shared<T>(std::forward<Args>(args)...); }
+    return std::allocate_shared<T>(arena_allocator<T>(a), std::forward<Args>(args)...);
+}
+
+} // namespace srpc
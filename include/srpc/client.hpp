@@ -0,0 +1,765 @@
+#pragma once
+
+#include "core.hpp"
+#include "pool.hpp"
+#include "packer.hpp"
+#include "transport.hpp"
+#include "coro.hpp"
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cerrno>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <condition_variable>
+#include <sys/time.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+namespace srpc {
+
+#define CLIENT_IO_MAX_EVENTS 64
+#define CLIENT_IO_READ_CHUNK 65536
+#define CLIENT_IO_DIRECT_RECV 4096  // response bytes left from which they are received in place rather than via scratch
+#define CLIENT_IO_RING_ENTRIES 256
+#define CLIENT_IO_BUF_GROUP 0
+#define CLIENT_IO_BUF_COUNT 64      // must be a power of two
+#define CLIENT_IO_BUF_SIZE 16384
+#define CLIENT_HANDSHAKE_TIMEOUT_MS 1000    // wait for the server's handshake answer at most this long
+
+class client_connection;
+
+/// The one thread that reads responses for every client_connection in the process.
+/// Callers send their requests themselves; this thread waits on all client sockets
+/// with epoll, splits what arrives into frames and completes the matching calls, so
+/// any number of calls can be outstanding without a thread blocked on each.
+///
+/// Sockets added while the IO_URING backend is selected are read through an io_uring
+/// instead: each gets a multishot receive filling buffers from a kernel provided buffer
+/// ring, and the ring's own descriptor sits in the epoll set. Responses are then reaped
+/// from the completion queue in shared memory, without a recv() per readable socket
+/// and the one more that finds it drained.
+class client_io {
+public:
+    static client_io& shared() {
+        static client_io io;
+        return io;
+    }
+
+    ~client_io() {
+        _stopping.store(true, std::memory_order_release);
+        wake();
+        _thread.join();
+        close(_wake_fd);
+        close(_epoll_fd);
+    }
+
+    client_io(const client_io&) = delete;
+    client_io& operator=(const client_io&) = delete;
+
+    /// Starts watching conn's socket.
+    /// @return 0 on success, -1 on failure
+    int32_t add(int32_t fd, std::weak_ptr<client_connection> conn, uint64_t& id) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        id = _next_id++;
+
+        if (transport::get_backend() == transport::backend::IO_URING && ring_ready()) {
+            // armed by the I/O thread: a request belongs to the thread that submitted it
+            // and is cancelled when that thread exits
+            _connections[id] = {std::move(conn), fd, true};
+            _to_arm.push_back(id);
+            wake();
+            return 0;
+        }
+
+        struct epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        ev.data.u64 = id;
+        if (epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            fprintf(stderr, "srpc::client_io::add(): epoll_ctl failed.\n");
+            return -1;
+        }
+        _connections[id] = {std::move(conn), fd, false};
+        return 0;
+    }
+
+    /// Stops watching the socket. Called by the connection's destructor, which cannot
+    /// run while this thread is reading for it. A receive armed on the ring keeps the
+    /// socket open until the I/O thread cancelled it, moments after this returns.
+    void remove(int32_t fd, uint64_t id) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _connections.find(id);
+        if (it == _connections.end()) { return; }
+
+        if (it->second.on_ring) {
+            _to_cancel.push_back(id);
+            wake();
+        } else {
+            epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+        }
+        _connections.erase(it);
+    }
+
+private:
+    struct watched {
+        std::weak_ptr<client_connection>    conn;
+        int32_t                             fd = -1;
+        bool                                on_ring = false;
+    };
+
+    client_io() {
+        _epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        _wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+        struct epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.u64 = WAKE_ID;
+        epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, _wake_fd, &ev);
+
+        _thread = std::thread(&client_io::run, this);
+    }
+
+    void run();
+
+    void wake() noexcept {
+        uint64_t one = 1;
+        [[maybe_unused]] ssize_t w = write(_wake_fd, &one, sizeof(one));
+    }
+
+    /// Sets the ring up on first use, under _mutex.
+    /// @return false if io_uring is unavailable, the socket is then watched with epoll
+    bool ring_ready() {
+        if (_ring) { return true; }
+        if (_ring_failed) { return false; }
+
+        auto ring = std::make_unique<uring>(CLIENT_IO_RING_ENTRIES);
+        struct epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.u64 = RING_ID;
+        if (!ring->ok() || ring->register_buffer_ring(CLIENT_IO_BUF_GROUP, CLIENT_IO_BUF_COUNT, CLIENT_IO_BUF_SIZE) != 0
+                || epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, ring->fd(), &ev) < 0) {
+            _ring_failed = true;
+            return false;
+        }
+        _ring = std::move(ring);
+        return true;
+    }
+
+    /// Submits the receives and cancellations queued by add(), remove() and reap(), on
+    /// the I/O thread. Holds _mutex meanwhile, so that no socket is closed between being 
+    /// looked up and handed to the kernel.
+    /// @param failed   gets the connections whose receive could not be armed
+    void submit_pending(std::vector<std::shared_ptr<client_connection>>& failed);
+
+    /// Handles every completion on the ring, on the I/O thread.
+    void reap();
+
+    static constexpr uint64_t WAKE_ID = 0;
+    static constexpr uint64_t RING_ID = 1;
+    static constexpr uint64_t CANCEL_TAG = 1ull << 63;  // user_data of cancellations, the completion is ignored
+
+    int32_t                                                         _epoll_fd = -1;
+    int32_t                                                         _wake_fd = -1;
+    std::atomic<bool>                                               _stopping = false;
+    std::thread                                                     _thread;
+
+    std::mutex                                                      _mutex;
+    uint64_t                                                        _next_id = RING_ID + 1;
+    std::unordered_map<uint64_t, watched>                           _connections;
+    std::unique_ptr<uring>                                          _ring;          // set once, under _mutex
+    bool                                                            _ring_failed = false;
+    std::vector<uint64_t>                                           _to_arm;
+    std::vector<uint64_t>                                           _to_cancel;
+};
+
+/// Client end of a connection shared by any number of concurrent calls. Every request
+/// frame carries a fresh request id; the shared client_io thread matches response
+/// frames back to the calls by that id, in whatever order the server finishes them.
+class client_connection {
+public:
+    using ptr = std::shared_ptr<client_connection>;
+
+    /// Invoked on the client_io thread with the response payload, or an empty
+    /// message if the connection was lost. Should return quickly.
+    using callback = std::function<void(message_t)>;
+
+    /// Connects and registers with the shared client_io thread.
+    /// @param format   wire format to ask the server for, anything but FIXED costs a 
+    ///                 handshake round trip before the connection is handed out
+    /// @return the connection, disconnected if the server could not be reached
+    static ptr connect(std::string const& server_ip, std::string const& port, 
+                       wire_format format = wire_format::FIXED) {
+        ptr conn(new client_connection(transport::create_client_socket(server_ip, port)));
+        if (conn->_fd >= 0 && (format == wire_format::FIXED || conn->handshake(format) == 0) 
+                && client_io::shared().add(conn->_fd, conn, conn->_io_id) == 0) {
+            conn->_registered = true;
+        } else {
+            conn->_closed = true;
+        }
+        return conn;
+    }
+
+    /// Calls still waiting are completed with an empty message.
+    ~client_connection() {
+        if (_registered) { client_io::shared().remove(_fd, _io_id); }
+        fail_pending();
+        if (_fd >= 0) { close(_fd); }
+    }
+
+    client_connection(const client_connection&) = delete;
+    client_connection& operator=(const client_connection&) = delete;
+
+    /// false once the server closed the connection, or if it never connected
+    bool connected() {
+        std::lock_guard<std::mutex> lock(_pending_mutex);
+        return !_closed;
+    }
+
+    /// Thread-safe, sends one request frame and returns without waiting.
+    /// @param on_response  called once with the response payload
+    void call_then(const uint8_t* data, size_t len, callback on_response) {
+        send_request([this, data, len] (uint64_t id) { transport::send_data(_fd, data, len, id); }, 
+                std::move(on_response));
+    }
+
+    /// Same, for a request packed as a chain (packer::release_chain()). The chain is
+    /// written before this returns.
+    void call_then(iobuf const& payload, callback on_response) {
+        send_request([this, &payload] (uint64_t id) { transport::send_chain(_fd, payload, id); }, 
+                std::move(on_response));
+    }
+
+    /// Thread-safe, sends one request frame and returns without waiting.
+    /// @return future response payload, an empty message if the connection is lost
+    std::future<message_t> call_async(const uint8_t* data, size_t len) {
+        auto promise = std::make_shared<std::promise<message_t>>();
+        std::future<message_t> response = promise->get_future();
+        call_then(data, len, [promise] (message_t msg) { promise->set_value(std::move(msg)); });
+        return response;
+    }
+
+    /// Thread-safe, sends one request frame and blocks until its response arrives.
+    message_t call(const uint8_t* data, size_t len) { return call_async(data, len).get(); }
+
+    /// Number of calls sent and not yet answered.
+    size_t in_flight() {
+        std::lock_guard<std::mutex> lock(_pending_mutex);
+        return _pending.size();
+    }
+
+    /// Wire format agreed on with the server, requests and responses must use it.
+    wire_format format() const noexcept { return _format; }
+
+private:
+    friend class client_io;
+
+    explicit client_connection(int32_t fd) : _fd(fd) {}
+
+    /// Registers on_response under a fresh request id, then writes the frame with send(id).
+    template <typename F>
+    void send_request(F send, callback on_response) {
+        uint64_t request_id = _next_request_id.fetch_add(1, std::memory_order_relaxed);
+        {
+            std::unique_lock<std::mutex> lock(_pending_mutex);
+            if (_closed) {
+                lock.unlock();
+                on_response(message_t{});
+                return;
+            }
+            _pending.emplace(request_id, std::move(on_response));
+        }
+        std::lock_guard<std::mutex> lock(_send_mutex);
+        send(request_id);
+    }
+
+    /// Asks the server for a wire format, blocking, before anything else is sent.
+    /// @return 0 once the server answered, -1 on failure
+    int32_t handshake(wire_format format) {
+        struct timeval timeout{};
+        timeout.tv_sec = CLIENT_HANDSHAKE_TIMEOUT_MS / 1000;
+        timeout.tv_usec = (CLIENT_HANDSHAKE_TIMEOUT_MS % 1000) * 1000;
+        setsockopt(_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        uint8_t asked = static_cast<uint8_t>(format);
+        uint64_t request_id = 0;
+        transport::send_data(_fd, &asked, sizeof(asked), HANDSHAKE_REQUEST_ID);
+        message_t answer = transport::recv_frame(_fd, request_id);
+
+        timeout = {};
+        setsockopt(_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        if (!answer || request_id != HANDSHAKE_REQUEST_ID || answer.size() != 1) {
+            fprintf(stderr, "srpc::client_connection::handshake(): no answer from the server.\n");
+            return -1;
+        }
+        _format = answer.data()[0] == static_cast<uint8_t>(wire_format::COMPACT) 
+            ? wire_format::COMPACT : wire_format::FIXED;
+        return 0;
+    }
+
+    /// Called on the client_io thread when the socket is readable. Small responses are 
+    /// parsed out of scratch, the rest of a large one is received straight into its slab.
+    /// @return false if the connection is gone
+    bool on_readable(uint8_t* scratch, size_t scratch_size) {
+        auto on_frame = [this] (uint64_t request_id, message_t&& msg) { complete(request_id, std::move(msg)); };
+        bool open = true;
+        while (open) {
+            bool direct = _reader.remaining() >= CLIENT_IO_DIRECT_RECV;
+            ssize_t n = direct ? recv(_fd, _reader.space(), _reader.remaining(), MSG_DONTWAIT)
+                               : recv(_fd, scratch, scratch_size, MSG_DONTWAIT);
+            if (n > 0) {
+                if (direct) {
+                    _reader.received(static_cast<size_t>(n), on_frame);
+                } else {
+                    open = _reader.feed(scratch, static_cast<size_t>(n), on_frame);
+                }
+                continue;
+            }
+            if (n == 0) { open = false; break; }
+            if (errno == EINTR) { continue; }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) { open = false; }
+            break;
+        }
+
+        if (!open) { fail_pending(); }
+        return open;
+    }
+
+    /// Called on the client_io thread with bytes its ring received for this connection.
+    /// @return false if the connection is gone
+    bool on_received(const uint8_t* data, size_t len) {
+        bool open = _reader.feed(data, len, [this] (uint64_t request_id, message_t&& msg) { 
+            complete(request_id, std::move(msg)); 
+        });
+        if (!open) { fail_pending(); }
+        return open;
+    }
+
+    void complete(uint64_t request_id, message_t msg) {
+        callback done;
+        {
+            std::lock_guard<std::mutex> lock(_pending_mutex);
+            auto it = _pending.find(request_id);
+            if (it == _pending.end()) { return; } // not ours, drop it
+            done = std::move(it->second);
+            _pending.erase(it);
+        }
+        done(std::move(msg));
+    }
+
+    void fail_pending() {
+        std::unordered_map<uint64_t, callback> pending;
+        {
+            std::lock_guard<std::mutex> lock(_pending_mutex);
+            _closed = true;
+            pending.swap(_pending);
+        }
+        for (auto& [id, done] : pending) { done(message_t{}); }
+    }
+
+    int32_t                                     _fd = -1;
+    uint64_t                                    _io_id = 0;
+    bool                                        _registered = false;
+    wire_format                                 _format = wire_format::FIXED;
+    std::atomic<uint64_t>                       _next_request_id = 1;
+    transport::frame_reader                     _reader;    // only touched by the client_io thread
+
+    std::mutex                                  _send_mutex;
+    std::mutex                                  _pending_mutex;
+    std::unordered_map<uint64_t, callback>      _pending;
+    bool                                        _closed = false;
+};
+
+/// Tuning of a channel's connection pool.
+struct channel_options {
+    size_t                      max_connections = 4;        // sockets opened at most
+    size_t                      max_in_flight = 1024;       // unanswered calls per connection
+    std::chrono::milliseconds   reconnect_backoff{100};     // wait before retrying a failed connect
+    wire_format                 format = wire_format::FIXED; // asked for in each connection's handshake
+};
+
+/// Thread-safe handle to one server, shared by any number of stubs. Calls go out on a
+/// bounded pool of client_connections: connections are only opened when a call finds
+/// none idle (lazily, the first one on the first call), dead ones are dropped and
+/// reopened after a backoff, and a call waits when every connection already carries
+/// max_in_flight calls (so do not issue calls from response callbacks, which run on
+/// the thread that would free up the slots).
+class channel : public std::enable_shared_from_this<channel> {
+public:
+    using ptr = std::shared_ptr<channel>;
+
+    static ptr create(std::string const& server_ip, std::string const& port, channel_options options = {}) {
+        return ptr(new channel(server_ip, port, options));
+    }
+
+    channel(const channel&) = delete;
+    channel& operator=(const channel&) = delete;
+
+    /// Thread-safe, sends one request frame and returns once it is written.
+    /// @param on_response  called once with the response payload, or an empty message
+    ///                     if the server can not be reached
+    void call_then(const uint8_t* data, size_t len, client_connection::callback on_response) {
+        size_t idx;
+        client_connection::ptr conn = acquire(idx);
+        if (!conn) {
+            on_response(message_t{});
+            return;
+        }
+        conn->call_then(data, len, releasing(idx, std::move(on_response)));
+    }
+
+    /// Same, for a request packed as a chain (packer::release_chain()).
+    void call_then(iobuf const& payload, client_connection::callback on_response) {
+        size_t idx;
+        client_connection::ptr conn = acquire(idx);
+        if (!conn) {
+            on_response(message_t{});
+            return;
+        }
+        conn->call_then(payload, releasing(idx, std::move(on_response)));
+    }
+
+    /// Thread-safe, sends one request frame and returns once it is written.
+    /// @return future response payload, an empty message if the call failed
+    std::future<message_t> call_async(const uint8_t* data, size_t len) {
+        auto promise = std::make_shared<std::promise<message_t>>();
+        std::future<message_t> response = promise->get_future();
+        call_then(data, len, [promise] (message_t msg) { promise->set_value(std::move(msg)); });
+        return response;
+    }
+
+    /// Thread-safe, sends one request frame and blocks until its response arrives.
+    message_t call(const uint8_t* data, size_t len) { return call_async(data, len).get(); }
+
+    /// Same, for a request packed as a chain (packer::release_chain()).
+    message_t call(iobuf const& payload) {
+        std::promise<message_t> promise;
+        std::future<message_t> response = promise.get_future();
+        call_then(payload, [&promise] (message_t msg) { promise.set_value(std::move(msg)); });
+        return response.get();
+    }
+
+    /// Wire format requests must be packed in and responses read with. Settled by the 
+    /// handshake of the first connection (opened here if there is none yet): the server
+    /// may fall back to FIXED, later connections must then agree with the first one.
+    wire_format format() {
+        if (_settled.load(std::memory_order_acquire)) { return _format; }
+
+        size_t idx;
+        if (client_connection::ptr conn = acquire(idx)) { release(idx); }
+        return _settled.load(std::memory_order_acquire) ? _format : _options.format;
+    }
+
+    /// Number of open, healthy connections.
+    size_t connection_count() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        size_t n = 0;
+        for (auto& s : _slots) { if (s.conn && s.conn->connected()) { n++; } }
+        return n;
+    }
+
+    /// Number of calls sent on any connection and not yet answered.
+    size_t in_flight() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        size_t n = 0;
+        for (auto& s : _slots) { n += s.in_flight; }
+        return n;
+    }
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    struct slot {
+        client_connection::ptr  conn;
+        size_t                  in_flight = 0;
+        bool                    connecting = false;
+        clock::time_point       retry_at{};
+    };
+
+    channel(std::string const& server_ip, std::string const& port, channel_options options)
+        : _server_ip(server_ip), _port(port), _options(options),
+          _slots(options.max_connections == 0 ? 1 : options.max_connections),
+          _format(options.format), _settled(options.format == wire_format::FIXED) {}
+
+    /// Picks the connection for one call and counts the call against it: the least
+    /// loaded healthy one, unless none is idle and the pool may still grow.
+    /// @return nullptr if no connection can be established
+    client_connection::ptr acquire(size_t& idx) {
+        static constexpr size_t NONE = static_cast<size_t>(-1);
+        std::unique_lock<std::mutex> lock(_mutex);
+
+        while (true) {
+            size_t best = NONE, empty = NONE;
+            bool pending = false; // something may become usable without us connecting
+            clock::time_point now = clock::now();
+
+            for (size_t i = 0; i < _slots.size(); i++) {
+                slot& s = _slots[i];
+                if (s.connecting) { pending = true; continue; }
+                if (s.conn && !s.conn->connected()) {
+                    // health check: a dead connection is reopened once its calls failed
+                    if (s.in_flight > 0) { pending = true; continue; }
+                    s.conn.reset();
+                    s.retry_at = now;
+                }
+                if (!s.conn) {
+                    if (now >= s.retry_at) {
+                        if (empty == NONE) { empty = i; }
+                    } else {
+                        pending = true;
+                    }
+                    continue;
+                }
+                pending = true;
+                if (s.in_flight < _options.max_in_flight && (best == NONE || s.in_flight < _slots[best].in_flight)) {
+                    best = i;
+                }
+            }
+
+            if (best != NONE && (_slots[best].in_flight == 0 || empty == NONE)) {
+                _slots[best].in_flight++;
+                idx = best;
+                return _slots[best].conn;
+            }
+
+            if (empty != NONE) {
+                slot& s = _slots[empty];
+                s.connecting = true;
+                wire_format proposed = _format;
+                lock.unlock();
+                client_connection::ptr conn = client_connection::connect(_server_ip, _port, proposed);
+                lock.lock();
+                s.connecting = false;
+                _cv.notify_all();
+
+                if (conn->connected() && !_settled.load(std::memory_order_relaxed)) {
+                    _format = conn->format();
+                    _settled.store(true, std::memory_order_release);
+                }
+                if (conn->connected() && conn->format() != _format) {
+                    fprintf(stderr, "srpc::channel::acquire(): server changed its wire format, dropping the connection.\n");
+                    conn.reset();
+                }
+
+                if (conn && conn->connected()) {
+                    s.conn = std::move(conn);
+                    s.in_flight = 1;
+                    idx = empty;
+                    return s.conn;
+                }
+                s.retry_at = clock::now() + _options.reconnect_backoff;
+                if (best != NONE) { continue; }
+                if (!pending) { return nullptr; }
+            } else if (!pending) {
+                return nullptr;
+            }
+
+            // every connection is busy, connecting or backing off
+            _cv.wait_for(lock, _options.reconnect_backoff);
+        }
+    }
+
+    /// Wraps a response callback so that the call's slot is freed first.
+    client_connection::callback releasing(size_t idx, client_connection::callback done) {
+        return [self = shared_from_this(), idx, done = std::move(done)] (message_t msg) {
+            self->release(idx);
+            done(std::move(msg));
+        };
+    }
+
+    void release(size_t idx) {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _slots[idx].in_flight--;
+        }
+        _cv.notify_one();
+    }
+
+    std::string                 _server_ip;
+    std::string                 _port;
+    channel_options             _options;
+
+    std::mutex                  _mutex;
+    std::condition_variable     _cv;
+    std::vector<slot>           _slots;
+    wire_format                 _format;    // written under _mutex before _settled is set
+    std::atomic<bool>           _settled;
+};
+
+/// Builds the request frame of a fixed-layout message in the FIXED format.
+/// @param frame room for sizeof(method_id) + T::wire_size bytes
+template <SrpcFixedMessage T>
+void encode_fixed_request(uint8_t* frame, uint32_t method_id, T const& req) noexcept {
+    std::memcpy(frame, &method_id, sizeof(method_id));
+    req.encode_to(frame + sizeof(method_id));
+}
+
+/// Reads a fixed-layout response straight out of the received frame.
+/// @return the response, default constructed if the call failed
+template <SrpcFixedMessage R>
+R decode_fixed_response(message_t const& res) noexcept {
+    R out{};
+    if (res.size() == sizeof(uint8_t) + R::wire_size && res.data()[0] == RPC_SUCCESS) {
+        out.decode_from(res.data() + sizeof(uint8_t));
+    }
+    return out;
+}
+
+/// Calls a method whose request and response both have a fixed layout, without a 
+/// packer: the request frame is built on the stack and the response decoded from the 
+/// pooled receive slab, so no buffer is allocated. The channel must speak FIXED.
+template <SrpcFixedMessage R, SrpcFixedMessage T>
+R fixed_call(channel& ch, uint32_t method_id, T const& req) {
+    uint8_t frame[sizeof(method_id) + T::wire_size];
+    encode_fixed_request(frame, method_id, req);
+    return decode_fixed_response<R>(ch.call(frame, sizeof(frame)));
+}
+
+/// fixed_call() that returns once the request is written, done runs on the client I/O thread.
+template <SrpcFixedMessage R, SrpcFixedMessage T>
+void fixed_call_then(channel& ch, uint32_t method_id, T const& req, std::function<void(R)> done) {
+    uint8_t frame[sizeof(method_id) + T::wire_size];
+    encode_fixed_request(frame, method_id, req);
+    ch.call_then(frame, sizeof(frame), [done = std::move(done)] (message_t res) {
+        done(decode_fixed_response<R>(res));
+    });
+}
+
+inline void client_io::run() {
+    struct epoll_event events[CLIENT_IO_MAX_EVENTS];
+    std::vector<uint8_t> scratch(CLIENT_IO_READ_CHUNK);
+    std::vector<client_connection::ptr> failed;
+
+    while (!_stopping.load(std::memory_order_acquire)) {
+        int32_t n = epoll_wait(_epoll_fd, events, CLIENT_IO_MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) { continue; }
+            fprintf(stderr, "srpc::client_io::run(): epoll_wait failed.\n");
+            return;
+        }
+
+        for (int32_t i = 0; i < n; i++) {
+            uint64_t id = events[i].data.u64;
+            if (id == WAKE_ID) {
+                uint64_t count;
+                [[maybe_unused]] ssize_t r = read(_wake_fd, &count, sizeof(count));
+                continue;
+            }
+            if (id == RING_ID) {
+                reap();
+                continue;
+            }
+
+            client_connection::ptr conn;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                auto it = _connections.find(id);
+                if (it != _connections.end()) { conn = it->second.conn.lock(); }
+            }
+            if (!conn) { continue; } // being destroyed
+
+            if (!conn->on_readable(scratch.data(), scratch.size())) {
+                std::lock_guard<std::mutex> lock(_mutex);
+                epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, conn->_fd, nullptr);
+            }
+        }
+
+        submit_pending(failed);
+        for (auto& conn : failed) { conn->fail_pending(); }
+        failed.clear();
+    }
+}
+
+inline void client_io::submit_pending(std::vector<client_connection::ptr>& failed) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_to_arm.empty() && _to_cancel.empty()) { return; }
+
+    auto next_sqe = [this] () {
+        struct io_uring_sqe* e = _ring->get_sqe();
+        for (int32_t i = 0; e == nullptr && i < URING_SUBMIT_RETRIES; i++) {
+            int32_t ret = _ring->submit();
+            if (ret < 0 && ret != -EAGAIN && ret != -EBUSY) { break; }
+            e = _ring->get_sqe();
+        }
+        return e;
+    };
+
+    for (uint64_t id : _to_cancel) {
+        struct io_uring_sqe* e = next_sqe();
+        if (!e) { break; } // the receive completes once the socket is closed
+        e->opcode = IORING_OP_ASYNC_CANCEL;
+        e->addr = id;
+        e->user_data = CANCEL_TAG | id;
+    }
+    for (uint64_t id : _to_arm) {
+        auto it = _connections.find(id);
+        if (it == _connections.end()) { continue; } // removed before it was armed
+
+        struct io_uring_sqe* e = next_sqe();
+        if (!e) {
+            fprintf(stderr, "srpc::client_io::submit_pending(): submission queue is full.\n");
+            if (client_connection::ptr conn = it->second.conn.lock()) { failed.push_back(std::move(conn)); }
+            continue;
+        }
+        e->opcode = IORING_OP_RECV;
+        e->fd = it->second.fd;
+        e->ioprio = IORING_RECV_MULTISHOT;
+        e->flags = IOSQE_BUFFER_SELECT;
+        e->buf_group = CLIENT_IO_BUF_GROUP;
+        e->user_data = id;
+    }
+    _to_arm.clear();
+    _to_cancel.clear();
+
+    int32_t ret = -EAGAIN;
+    for (int32_t i = 0; i < URING_SUBMIT_RETRIES && (ret == -EAGAIN || ret == -EBUSY); i++) { ret = _ring->submit(); }
+    if (ret < 0) { fprintf(stderr, "srpc::client_io::submit_pending(): io_uring_enter failed.\n"); }
+}
+
+inline void client_io::reap() {
+    if (_ring->cq_overflowed()) { _ring->flush_overflow(); }
+
+    _ring->for_each_cqe([this] (const struct io_uring_cqe& cqe) {
+        if (cqe.user_data & CANCEL_TAG) { return; }
+        uint64_t id = cqe.user_data;
+        bool more = cqe.flags & IORING_CQE_F_MORE;
+
+        client_connection::ptr conn;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto it = _connections.find(id);
+            if (it != _connections.end()) { conn = it->second.conn.lock(); }
+        }
+
+        bool open = true;
+        if (cqe.flags & IORING_CQE_F_BUFFER) {
+            uint16_t bid = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+            if (conn && cqe.res > 0) { open = conn->on_received(_ring->buffer(bid), static_cast<size_t>(cqe.res)); }
+            _ring->recycle_buffer(bid);
+        }
+        if (!conn) { return; } // removed, its receive is being cancelled
+
+        if (!open) {
+            if (more) {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _to_cancel.push_back(id);
+            }
+        } else if (cqe.res > 0 || cqe.res == -ENOBUFS) {
+            // multishot receives stop when the buffer ring runs dry, the buffers are back by now
+            if (!more) {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _to_arm.push_back(id);
+            }
+        } else if (!more) {
+            conn->fail_pending(); // peer closed, or the receive failed
+        }
+    });
+}
+
+} // namespace srpc
@@ -1,7 +1,12 @@
 #pragma once
 
+#include "pool.hpp"
 #include <memory>
-#include <stdexcept>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <memory_resource>
+#include <concepts>
 #include <functional>
 
 namespace srpc {
@@ -10,40 +15,82 @@ namespace srpc {
 #define STRUCT_MEMBER(struct_t, member_name, member_str) std::make_tuple(member_str, &struct_t::member_name)
 #endif
 
+/// Servicer method entry. method_id is what travels on the wire, it must be unique among
+/// the services registered with one server and stay the same across releases.
+#ifndef SERVICE_METHOD
+#define SERVICE_METHOD(struct_t, method_name, method_str, method_id) \
+    std::make_tuple(method_str, &struct_t::method_name, static_cast<uint32_t>(method_id))
+#endif
+
 constexpr int MEMBER_NAME = 0;
 constexpr int MEMBER_ADDR = 1;
+constexpr int MEMBER_ID = 2;
 
-struct buffer : public std::vector<uint8_t> {
-    using ptr = std::shared_ptr<buffer>;
+/// How integers are laid out in a packed message.
+enum class wire_format : uint8_t {
+    FIXED = 0,  // raw sizeof(T) bytes, string lengths as 8 bytes
+    COMPACT     // LEB128 varints, zigzag for signed types; 1-byte types stay raw
+};
 
-    constexpr buffer() : _offset(0) {}
-    constexpr buffer(const uint8_t* bytes, size_t len) : _offset(0), std::vector<uint8_t>(bytes, bytes + len) {} 
-    constexpr buffer(std::vector<uint8_t> const& bytes) : _offset(0), std::vector<uint8_t>(bytes) {} 
-    constexpr buffer(std::vector<uint8_t>&& bytes) : _offset(0), std::vector<uint8_t>(std::move(bytes)) {} 
+/// Either owns its bytes in the vector, or adopts a pooled slab received from the
+/// network and reads straight out of it. Appending to an adopted buffer first copies
+/// the slab into the vector. The vector allocates from a memory resource, the heap
+/// unless the buffer belongs to a call's request_arena.
+struct buffer : public std::pmr::vector<uint8_t> {
+    using ptr = std::shared_ptr<buffer>;
+    using base = std::pmr::vector<uint8_t>;
+
+    buffer() : _offset(0) {}
+    explicit buffer(std::pmr::memory_resource* mr) : base(mr), _offset(0) {}
+    buffer(const uint8_t* bytes, size_t len) : base(bytes, bytes + len), _offset(0) {} 
+    buffer(std::vector<uint8_t> const& bytes) : base(bytes.begin(), bytes.end()), _offset(0) {} 
+    buffer(slab&& s, std::pmr::memory_resource* mr = std::pmr::get_default_resource()) 
+        : base(mr), _offset(0), _slab(std::move(s)) {}
     
-    constexpr size_t cursize() noexcept { return size() - _offset; }
-    constexpr size_t offset() noexcept { return _offset; }
-    constexpr const uint8_t* data() noexcept { return &(*this)[0]; }
-    constexpr const uint8_t* curdata() noexcept { return &(*this)[_offset]; }
-    void increment(int32_t k) {
-        if (_offset + k > size()) {
-            throw std::runtime_error("offset out of bounds!");
+    size_t size() const noexcept { return _slab ? _slab.size() : base::size(); }
+    size_t cursize() const noexcept { return size() - _offset; }
+    constexpr size_t offset() const noexcept { return _offset; }
+    const uint8_t* data() const noexcept { return _slab ? _slab.data() : base::data(); }
+    const uint8_t* curdata() const noexcept { return data() + _offset; }
+    /// Moves the offset k bytes on. Lengths come off the wire, so k is not trusted: if 
+    /// fewer than k bytes are left the offset moves to the end instead.
+    /// @return false if k overran the buffer
+    bool increment(size_t k) noexcept {
+        if (k > cursize()) {
+            _offset = size();
+            return false;
         }
         _offset += k; 
+        return true;
+    }
+    void append(const uint8_t* s, size_t len) { detach(); insert(end(), s, s + len); }
+    /// Makes room for len more bytes so the appends that follow do not reallocate.
+    void reserve_more(size_t len) { detach(); reserve(size() + len); }
+    /// Appends len bytes for the caller to fill in.
+    uint8_t* extend(size_t len) { detach(); resize(size() + len); return base::data() + size() - len; }
+    template <typename It> void append(It b, It e) { detach(); insert(end(), b, e); }
+    void reset() { _offset = 0; _slab.release(); clear(); }
+
+    /// Compares the bytes held, adopted or not.
+    friend bool operator==(buffer const& a, std::vector<uint8_t> const& b) noexcept {
+        return std::equal(a.data(), a.data() + a.size(), b.begin(), b.end());
     }
-    constexpr void append(const uint8_t* s, size_t len) { insert(end(), s, s + len); }
-    template <typename It> constexpr void append(It b, It e) { insert(end(), b, e); }
-    constexpr void reset() { _offset = 0; clear(); }
 
 private:
-    size_t _offset;
+    /// Moves adopted bytes into the vector so they can be appended to.
+    void detach() {
+        if (!_slab) { return; }
+        assign(_slab.data(), _slab.data() + _slab.size());
+        _slab.release();
+    }
+
+    size_t  _offset;
+    slab    _slab;
 };
 
-/// To be inherited by generated messages
+/// To be inherited by generated messages. Carries no virtual functions, messages are
+/// encoded and decoded by their static type.
 struct message_base {
-    virtual ~message_base() = default;
-    virtual void unpack(buffer::ptr bp) {};
-
     static constexpr const char* name = nullptr;
     static constexpr auto fields = std::make_tuple();
 };
@@ -119,19 +166,36 @@ struct has_name<T, std::void_t<decltype(T::name)>> : std::true_type {};
 template <typename T>
 constexpr bool has_name_v = has_name<T>::value;
 
+template <typename T>
+struct is_vector : std::false_type {};
+
+template <typename T, typename A>
+struct is_vector<std::vector<T, A>> : std::true_type {};
+
+template <typename T>
+constexpr bool is_vector_v = is_vector<T>::value;
+
+/// std::unordered_map, std::map and the like.
+template <typename T>
+constexpr bool is_map_v = requires { typename T::key_type; typename T::mapped_type; };
+
 template <typename D, typename B>
 concept Derived = std::is_base_of_v<B, D>;
 
 template <typename T>
 concept SrpcMessage = has_name_v<T> && has_fields_v<T> && Derived<T, message_base>;
 
+/// Message whose FIXED wire form has a constant size: generated with wire_size, and
+/// encode_to() / decode_from() writing and reading exactly that many bytes.
 template <typename T>
-concept SrpcService = has_name_v<T> && has_methods_v<T> && Derived<T, servicer_base>;
-
-using message_factory = std::function<std::unique_ptr<message_base>()>;
+concept SrpcFixedMessage = SrpcMessage<T> && requires (const T& c, T& m, uint8_t* out, const uint8_t* in) {
+    { T::wire_size } -> std::convertible_to<size_t>;
+    c.encode_to(out);
+    m.decode_from(in);
+};
 
-/// To be populated with user generated structs 
-static std::unordered_map<std::string, message_factory> message_registry {};
+template <typename T>
+concept SrpcService = has_name_v<T> && has_methods_v<T> && Derived<T, servicer_base>;
 
 } // namespace srpc
 
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <atomic>
+#include <utility>
+#include <optional>
+#include <coroutine>
+#include <exception>
+#include <functional>
+
+namespace srpc {
+
+/// Something that can run a function on its own thread later, used to resume
+/// suspended coroutines where they belong. Server event loops are schedulers.
+class scheduler {
+public:
+    virtual ~scheduler() = default;
+
+    /// Thread-safe, queues fn to run on the scheduler's thread.
+    virtual void post(std::function<void()> fn) = 0;
+
+    /// Scheduler of the work the calling thread is currently doing, nullptr if none.
+    static scheduler*& current() noexcept {
+        static thread_local scheduler* s = nullptr;
+        return s;
+    }
+
+    /// Makes s the current scheduler until the end of the scope.
+    class scope {
+    public:
+        explicit scope(scheduler* s) noexcept : _prev(std::exchange(current(), s)) {}
+        ~scope() { current() = _prev; }
+
+        scope(const scope&) = delete;
+        scope& operator=(const scope&) = delete;
+
+    private:
+        scheduler* _prev;
+    };
+};
+
+/// Resumes h on home if there is one, right here otherwise.
+inline void resume_on(scheduler* home, std::coroutine_handle<> h) {
+    if (home) {
+        home->post([h] () { h.resume(); });
+    } else {
+        h.resume();
+    }
+}
+
+/// Lazily started coroutine producing a T. Awaiting a task runs it and resumes the
+/// awaiter once it finished. Servicer methods may return task<R> instead of R.
+/// @tparam T result type
+template <typename T>
+class task {
+public:
+    struct promise_type {
+        std::optional<T>                            value;
+        std::exception_ptr                          error;
+        std::coroutine_handle<>                     continuation;
+        std::function<void(std::optional<T>)>       on_done;   // set when started detached
+        scheduler*                                  home = nullptr;
+
+        task get_return_object() noexcept { return task(handle::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        struct final_awaiter {
+            bool await_ready() noexcept { return false; }
+            void await_resume() noexcept {}
+
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+                promise_type& p = h.promise();
+                if (p.continuation) { return p.continuation; }
+
+                // detached: nobody owns the frame, hand the result over and free it
+                auto done = std::move(p.on_done);
+                std::optional<T> value = p.error ? std::nullopt : std::move(p.value);
+                h.destroy();
+                if (done) { done(std::move(value)); }
+                return std::noop_coroutine();
+            }
+        };
+        final_awaiter final_suspend() noexcept { return {}; }
+
+        void return_value(T v) { value = std::move(v); }
+        void unhandled_exception() noexcept { error = std::current_exception(); }
+    };
+
+    using handle = std::coroutine_handle<promise_type>;
+
+    task(task&& other) noexcept : _h(std::exchange(other._h, nullptr)) {}
+    task& operator=(task&& other) noexcept {
+        if (this != &other) {
+            if (_h) { _h.destroy(); }
+            _h = std::exchange(other._h, nullptr);
+        }
+        return *this;
+    }
+    ~task() { if (_h) { _h.destroy(); } }
+
+    task(const task&) = delete;
+    task& operator=(const task&) = delete;
+
+    bool await_ready() const noexcept { return false; }
+
+    /// Starts the task, it inherits the awaiter's scheduler.
+    template <typename P>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<P> awaiter) noexcept {
+        _h.promise().continuation = awaiter;
+        if constexpr (requires { awaiter.promise().home; }) {
+            _h.promise().home = awaiter.promise().home;
+        } else {
+            _h.promise().home = scheduler::current();
+        }
+        return _h;
+    }
+
+    T await_resume() {
+        if (_h.promise().error) { std::rethrow_exception(_h.promise().error); }
+        return std::move(*_h.promise().value);
+    }
+
+    /// Runs the task without anyone awaiting it. The frame frees itself when done.
+    /// @param done called with the result, or nullopt if the task threw
+    /// @param home where operations awaited by the task resume
+    void start(std::function<void(std::optional<T>)> done, scheduler* home = scheduler::current()) && {
+        handle h = std::exchange(_h, nullptr);
+        h.promise().on_done = std::move(done);
+        h.promise().home = home;
+        h.resume();
+    }
+
+private:
+    explicit task(handle h) noexcept : _h(h) {}
+
+    handle _h;
+};
+
+/// The value a method returning T produces: T itself, or R for a task<R>.
+template <typename T>
+struct task_result { using type = T; };
+
+template <typename T>
+struct task_result<task<T>> { using type = T; };
+
+template <typename T>
+using task_result_t = typename task_result<T>::type;
+
+/// Awaitable completed by a callback that may fire on any thread, possibly before
+/// the awaiting coroutine got to suspend. Resumes the coroutine on its scheduler.
+/// @tparam T result type
+template <typename T>
+class callback_awaitable {
+public:
+    /// @param launch   called on suspension with the function to complete the await with
+    explicit callback_awaitable(std::function<void(std::function<void(T)>)> launch)
+        : _launch(std::move(launch)) {}
+
+    bool await_ready() const noexcept { return false; }
+
+    template <typename P>
+    bool await_suspend(std::coroutine_handle<P> h) {
+        scheduler* home = scheduler::current();
+        if constexpr (requires { h.promise().home; }) { home = h.promise().home; }
+
+        _launch([this, h, home] (T v) {
+            _value.emplace(std::move(v));
+            if (_ready.exchange(true, std::memory_order_acq_rel)) { resume_on(home, h); }
+        });
+        // if the callback already ran, carry on without suspending
+        return !_ready.exchange(true, std::memory_order_acq_rel);
+    }
+
+    T await_resume() { return std::move(*_value); }
+
+private:
+    std::function<void(std::function<void(T)>)>    _launch;
+    std::optional<T>                                _value;
+    std::atomic<bool>                               _ready = false;
+};
+
+} // namespace srpc
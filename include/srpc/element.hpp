@@ -3,6 +3,7 @@
 #include "token.hpp"
 #include <memory>
 #include <cstddef>
+#include <cstdint>
 #include <algorithm>
 #include <vector>
 #include <unordered_map>
@@ -19,11 +20,16 @@ struct rpc_element {
 
 struct field_descriptor {
     bool        is_primitive;
+    bool        is_repeated = false;    // std::vector of type
+    bool        in_arena = false;       // std::pmr storage, taken from the request arena on servers
     std::string name;
     std::string type;
+    std::string key_type;               // set for map<key_type, type> fields
 
     field_descriptor() {}
     field_descriptor(bool ip, std::string name, std::string t) : is_primitive(ip), name(name), type(t) {};
+
+    bool is_map() const noexcept { return !key_type.empty(); }
 };
 
 class message : public rpc_element {
@@ -43,14 +49,18 @@ public:
     std::vector<std::unique_ptr<field_descriptor>>& fields() noexcept { return _fields; }
 };
 
+#define MAX_METHOD_ID 65535     // method ids index the server's dispatch table, see SERVER_MAX_METHODS
+
 struct method {
     std::string name;
     std::string input_t;
     std::string output_t;
+    uint32_t    id = 0;     // on the wire, stable across releases
+    bool        view_input = false; // (view Input): the servicer takes an Input_view
     
     method() = default;
-    method(std::string n, std::string in, std::string out)
-        : name(std::move(n)), input_t(in), output_t(out) {}
+    method(std::string n, std::string in, std::string out, uint32_t i = 0)
+        : name(std::move(n)), input_t(in), output_t(out), id(i) {}
 };
 
 class service : public rpc_element {
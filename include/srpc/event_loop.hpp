@@ -0,0 +1,180 @@
+#pragma once
+
+#include "reactor.hpp"
+#include <cerrno>
+#include <cstdint>
+#include <sys/epoll.h>
+#include <netinet/tcp.h>
+
+namespace srpc {
+
+#define EVENT_LOOP_MAX_EVENTS 256
+#define EVENT_LOOP_READ_CHUNK 65536
+#define EVENT_LOOP_DIRECT_RECV 4096  // payload left from which it is received in place rather than via _scratch
+
+/// Edge-triggered epoll reactor. Accepts connections on a listening socket, keeps
+/// them open and hands every complete length-prefixed frame to the frame handler,
+/// writing the returned packer back as a response frame on the same connection.
+class event_loop : public reactor {
+public:
+    explicit event_loop(frame_handler handler, work_stealing_executor::ptr executor = nullptr)
+        : reactor(std::move(handler), std::move(executor)), _scratch(EVENT_LOOP_READ_CHUNK) {
+        _epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+        struct epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.u64 = WAKE_ID;
+        epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, _wake_fd, &ev);
+    }
+
+    ~event_loop() override {
+        wait_in_flight();
+        _connections.clear();
+        if (_listening_fd != -1) { close(_listening_fd); }
+        close(_epoll_fd);
+    }
+
+    int32_t adopt_listener(int32_t listening_fd) noexcept override {
+        if (listening_fd < 0 || transport::set_nonblocking(listening_fd) < 0) { return -1; }
+
+        struct epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLET;
+        ev.data.u64 = LISTENER_ID;
+        if (epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, listening_fd, &ev) < 0) {
+            fprintf(stderr, "srpc::event_loop::adopt_listener(): epoll_ctl failed.\n");
+            return -1;
+        }
+        _listening_fd = listening_fd;
+        return 0;
+    }
+
+protected:
+    void loop() override {
+        struct epoll_event events[EVENT_LOOP_MAX_EVENTS];
+
+        while (running()) {
+            int32_t n = epoll_wait(_epoll_fd, events, EVENT_LOOP_MAX_EVENTS, -1);
+            if (n < 0) {
+                if (errno == EINTR) { continue; }
+                fprintf(stderr, "srpc::event_loop::run(): epoll_wait failed.\n");
+                break;
+            }
+
+            for (int32_t i = 0; i < n; i++) {
+                uint64_t id = events[i].data.u64;
+                if (id == WAKE_ID) {
+                    uint64_t v;
+                    while (read(_wake_fd, &v, sizeof(v)) > 0) {}
+                    drain_completions();
+                } else if (id == LISTENER_ID) {
+                    handle_accept();
+                } else {
+                    handle_io(id, events[i].events);
+                }
+            }
+        }
+        _connections.clear();
+    }
+
+    /// Writes as much of the queued responses as the socket accepts, every queued
+    /// frame in one sendmsg. The rest is retried on the next EPOLLOUT edge.
+    bool flush([[maybe_unused]] uint64_t id, connection& conn) noexcept override {
+        struct iovec iov[REACTOR_MAX_IOV];
+        struct msghdr msg{};
+        msg.msg_iov = iov;
+
+        while (!conn.wframes.empty()) {
+            msg.msg_iovlen = gather(conn, iov, REACTOR_MAX_IOV);
+            ssize_t n = sendmsg(conn.fd, &msg, MSG_NOSIGNAL);
+            if (n > 0) { consume(conn, n); continue; }
+            if (n < 0 && errno == EINTR) { continue; }
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) { return true; }
+            return false;
+        }
+        return true;
+    }
+
+    void drop(uint64_t id) noexcept override {
+        auto it = _connections.find(id);
+        if (it == _connections.end()) { return; }
+        epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, it->second->fd, nullptr);
+        _connections.erase(it);
+    }
+
+private:
+    /// epoll tags for the non-connection descriptors
+    static constexpr uint64_t WAKE_ID = 0;
+    static constexpr uint64_t LISTENER_ID = 1;
+
+    void handle_accept() noexcept {
+        while (true) {
+            int32_t fd = accept4(_listening_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno == EINTR) { continue; }
+                if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    fprintf(stderr, "srpc::event_loop::handle_accept(): accept failed.\n");
+                }
+                return;
+            }
+
+            int32_t one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+            uint64_t id = _next_conn_id++;
+            struct epoll_event ev{};
+            ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+            ev.data.u64 = id;
+            if (epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+                fprintf(stderr, "srpc::event_loop::handle_accept(): epoll_ctl failed.\n");
+                close(fd);
+                continue;
+            }
+            _connections[id] = std::make_unique<connection>(fd);
+        }
+    }
+
+    void handle_io(uint64_t id, uint32_t events) {
+        auto it = _connections.find(id);
+        if (it == _connections.end()) { return; }
+        connection& conn = *it->second;
+
+        bool alive = !(events & (EPOLLERR | EPOLLHUP));
+        if (alive && (events & (EPOLLIN | EPOLLRDHUP))) { alive = read_frames(id, conn); }
+        if (alive) { 
+            flush_or_drop(id, conn); // also closes a half-closed connection with nothing left to answer
+        } else {
+            drop(id); 
+        }
+    }
+
+    /// Drains the socket (edge-triggered) and dispatches every complete frame. Reads go
+    /// to _scratch, from which small frames are parsed, except for the rest of a large 
+    /// payload: it is received straight into its slab. The peer shutting down its side 
+    /// only marks the connection read_closed, the frames read before are still answered.
+    /// @return false on an error, or if the peer sent an oversized frame
+    bool read_frames(uint64_t id, connection& conn) {
+        while (!conn.read_closed) {
+            bool direct = conn.reader.remaining() >= EVENT_LOOP_DIRECT_RECV;
+            ssize_t n = direct ? recv(conn.fd, conn.reader.space(), conn.reader.remaining(), 0)
+                               : recv(conn.fd, _scratch.data(), _scratch.size(), 0);
+            if (n > 0) {
+                if (direct) {
+                    payload_received(id, conn, static_cast<size_t>(n));
+                } else if (!parse_frames(id, conn, _scratch.data(), static_cast<size_t>(n))) {
+                    return false;
+                }
+                continue;
+            }
+            if (n == 0) { conn.read_closed = true; break; }
+            if (errno == EINTR) { continue; }
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        return true;
+    }
+
+    int32_t                 _epoll_fd = -1;
+    int32_t                 _listening_fd = -1;
+    std::vector<uint8_t>    _scratch;
+};
+
+} // namespace srpc
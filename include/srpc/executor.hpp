@@ -0,0 +1,146 @@
+#pragma once
+
+#include <mutex>
+#include <deque>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <cstdio>
+#include <cstdint>
+#include <functional>
+#include <condition_variable>
+
+namespace srpc {
+
+/// Thread pool with one task deque per worker. Workers pop their own deque from the
+/// back (most recently pushed first) and, once it is empty, steal from the front of the
+/// other workers' deques. Tasks submitted from outside the pool (e.g. by I/O threads)
+/// are spread round robin, tasks submitted from a worker go to that worker's own deque.
+class work_stealing_executor {
+public:
+    using ptr = std::shared_ptr<work_stealing_executor>;
+    using task = std::function<void()>;
+
+    explicit work_stealing_executor(size_t n_workers = std::thread::hardware_concurrency())
+        : _workers(n_workers == 0 ? 1 : n_workers) {
+        for (size_t i = 0; i < _workers.size(); i++) {
+            _workers[i].thread = std::thread(&work_stealing_executor::worker_loop, this, i);
+        }
+    }
+
+    /// Runs every task still queued, then joins the workers.
+    ~work_stealing_executor() {
+        {
+            std::lock_guard<std::mutex> lock(_idle_mutex);
+            _stopping = true;
+        }
+        _idle_cv.notify_all();
+        for (auto& w : _workers) { w.thread.join(); }
+    }
+
+    work_stealing_executor(const work_stealing_executor&) = delete;
+    work_stealing_executor& operator=(const work_stealing_executor&) = delete;
+
+    /// Thread-safe, queues t to be run on one of the workers. If t throws, the exception
+    /// is logged and dropped; the worker carries on with the next task.
+    void submit(task t) {
+        size_t target = (_self_owner == this)
+            ? _self_index
+            : _next.fetch_add(1, std::memory_order_relaxed) % _workers.size();
+        {
+            std::lock_guard<std::mutex> lock(_workers[target].mutex);
+            _workers[target].tasks.push_back(std::move(t));
+            _pending++;
+        }
+        // taking the idle lock orders the increment before any worker's predicate check
+        { std::lock_guard<std::mutex> lock(_idle_mutex); }
+        _idle_cv.notify_one();
+    }
+
+    size_t worker_count() const noexcept { return _workers.size(); }
+
+    /// Number of tasks queued but not yet picked up by a worker.
+    size_t queue_depth() const noexcept { return _pending.load(std::memory_order_relaxed); }
+
+    /// Number of tasks queued on worker i but not yet picked up.
+    size_t queue_depth(size_t i) {
+        std::lock_guard<std::mutex> lock(_workers[i].mutex);
+        return _workers[i].tasks.size();
+    }
+
+    /// Number of tasks a worker took from another worker's deque.
+    uint64_t steal_count() const noexcept { return _steals.load(std::memory_order_relaxed); }
+
+    /// Number of tasks run to completion.
+    uint64_t executed_count() const noexcept { return _executed.load(std::memory_order_relaxed); }
+
+private:
+    struct worker {
+        std::mutex          mutex;
+        std::deque<task>    tasks;
+        std::thread         thread;
+    };
+
+    void worker_loop(size_t self) {
+        _self_owner = this;
+        _self_index = self;
+
+        task t;
+        while (true) {
+            if (pop_local(self, t) || steal(self, t)) {
+                try {
+                    t();
+                } catch (...) { // the task is lost, not the worker running it
+                    fprintf(stderr, "srpc::work_stealing_executor::worker_loop(): task threw.\n");
+                }
+                t = nullptr;
+                _executed.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(_idle_mutex);
+            _idle_cv.wait(lock, [this] () { return _pending > 0 || _stopping; });
+            if (_pending == 0 && _stopping) { return; }
+        }
+    }
+
+    bool pop_local(size_t self, task& t) {
+        std::lock_guard<std::mutex> lock(_workers[self].mutex);
+        if (_workers[self].tasks.empty()) { return false; }
+        t = std::move(_workers[self].tasks.back());
+        _workers[self].tasks.pop_back();
+        _pending--;
+        return true;
+    }
+
+    bool steal(size_t self, task& t) {
+        for (size_t k = 1; k < _workers.size(); k++) {
+            worker& victim = _workers[(self + k) % _workers.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (victim.tasks.empty()) { continue; }
+            t = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            _pending--;
+            _steals.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        return false;
+    }
+
+    std::vector<worker>         _workers;
+    std::atomic<size_t>         _next = 0;
+    std::atomic<size_t>         _pending = 0;
+    std::atomic<uint64_t>       _steals = 0;
+    std::atomic<uint64_t>       _executed = 0;
+
+    std::mutex                  _idle_mutex;
+    std::condition_variable     _idle_cv;
+    bool                        _stopping = false;
+
+    /// Identifies the worker the calling thread belongs to, if any.
+    static inline thread_local const work_stealing_executor*    _self_owner = nullptr;
+    static inline thread_local size_t                           _self_index = 0;
+};
+
+} // namespace srpc
@@ -12,6 +12,7 @@ struct generator {
         for (const auto& e : contract::elements) {
             if (auto msg = dynamic_pointer_cast<message>(e)) {
                 write_to_file(path, handle_message(msg));
+                write_to_file(path, handle_message_view(msg));
             } else if (auto svc = dynamic_pointer_cast<service>(e)) {
                 write_to_file(path, handle_service(svc));
             }
@@ -19,42 +20,39 @@ struct generator {
     }
 
     [[nodiscard]] static std::string handle_service(std::shared_ptr<service> svc) noexcept {
-        // Stub 
-        std::ostringstream stub_stream, servicer_stream;
-
-        stub_stream << "struct " << svc->name << "_stub {\n";
-        stub_stream << "\t" << svc->name << "_stub() {\n";
-        stub_stream << "\t\tif (!_init) {\n";
+        // Method ids
+        std::ostringstream ids_stream, stub_stream, servicer_stream;
 
-        for (const auto& md : svc->msg_dependencies()) {
-            stub_stream << "\t\t\tsrpc::message_registry[\"" << md << "\"] = []() -> std::unique_ptr<" << md << "> {\n";
-            stub_stream << "\t\t\t\treturn std::make_unique<" << md << ">();\n";
-            stub_stream << "\t\t\t};\n";
+        ids_stream << "struct " << svc->name << "_method_ids {\n";
+        for (const auto& m : svc->methods()) {
+            ids_stream << "\tstatic constexpr uint32_t " << m->name << " = " << m->id << ";\n";
         }
+        ids_stream << "};\n\n";
 
-        stub_stream << "\t\t}\n";
-        stub_stream << "\t\t_init = true;\n";
+        // Stub 
+        stub_stream << "struct " << svc->name << "_stub {\n";
+        stub_stream << "\tvoid register_insecure_channel(std::string server_ip, std::string port) {\n";
+        stub_stream << "\t\t_channel = srpc::channel::create(server_ip, port);\n";
         stub_stream << "\t}\n\n";
 
-        stub_stream << "\tvoid register_insecure_channel(std::string server_ip, std::string port) {\n";
-        stub_stream << "\t\tif (_socket != -1) { close(_socket); }\n";
-        stub_stream << "\t\t_socket = srpc::transport::create_client_socket(server_ip, port);\n";
+        stub_stream << "\tvoid register_channel(srpc::channel::ptr channel) {\n";
+        stub_stream << "\t\t_channel = std::move(channel);\n";
         stub_stream << "\t}\n\n";
 
         for (const auto& m : svc->methods()) {
             stub_stream << get_client_stub_method(svc->name, m.get());
         }
 
-        stub_stream << "private:\n\tstatic bool _init;\n";
-        stub_stream << "\tint32_t _socket = -1;\n";
+        stub_stream << "private:\n";
+        stub_stream << "\tsrpc::channel::ptr _channel;\n";
         stub_stream << "};\n\n";
-        stub_stream << "inline bool " << svc->name << "_stub::_init = false;\n\n";
 
         // Generate Servicer
         servicer_stream << "struct " << svc->name << "_servicer : srpc::servicer_base {\n";
 
         for (const auto& m : svc->methods()) {
-            servicer_stream << "\tvirtual " << m->output_t << " " << m->name << "(" << m->input_t << "& req)";
+            std::string input_t = m->view_input ? m->input_t + "_view" : m->input_t; // decoded without copying strings
+            servicer_stream << "\tvirtual " << m->output_t << " " << m->name << "([[maybe_unused]] " << input_t << "& req)";
             servicer_stream << " { throw std::runtime_error(\"Method not implemented!\"); }\n";
         }
         servicer_stream << "\n";
@@ -62,8 +60,9 @@ struct generator {
         servicer_stream << "\tstatic constexpr auto methods = std::make_tuple(\n";
 
         for (size_t i = 0; i < svc->methods().size(); i++) {
-            servicer_stream << "\t\tSTRUCT_MEMBER(" << svc->name << "_servicer, " << svc->methods()[i]->name << ", \"" 
-                << svc->name << "_servicer::" << svc->methods()[i]->name<< "\")";
+            servicer_stream << "\t\tSERVICE_METHOD(" << svc->name << "_servicer, " << svc->methods()[i]->name << ", \"" 
+                << svc->name << "_servicer::" << svc->methods()[i]->name << "\", " 
+                << svc->name << "_method_ids::" << svc->methods()[i]->name << ")";
             if (i != svc->methods().size() - 1) {
                 servicer_stream << ",\n";
             }
@@ -71,27 +70,66 @@ struct generator {
         servicer_stream << "\n\t);\n";
         servicer_stream << "};\n\n";
 
-        return stub_stream.str() + servicer_stream.str();
+        return ids_stream.str() + stub_stream.str() + servicer_stream.str();
     }
 
     [[nodiscard]] static std::string get_client_stub_method(const std::string& svc_name, method* m) noexcept {
         std::ostringstream msg_stream;
+        // both ends of fixed size: encode on the stack, decode straight from the received frame
+        bool fixed = fixed_wire_size(m->input_t) > 0 && fixed_wire_size(m->output_t) > 0;
 
-        msg_stream << "\t" << m->output_t << " " << m->name << "(" << m->input_t << "& req) {\n";
+        msg_stream << "\t" << m->output_t << " " << m->name << "(const " << m->input_t << "& req) {\n";
+        if (fixed) {
+            msg_stream << "\t\tif (_channel->format() == srpc::wire_format::FIXED) {\n";
+            msg_stream << "\t\t\treturn srpc::fixed_call<" << m->output_t << ">(*_channel, " 
+                << svc_name << "_method_ids::" << m->name << ", req);\n";
+            msg_stream << "\t\t}\n\n";
+        }
 
-        msg_stream << "\t\tsrpc::packer pr;\n";
-        msg_stream << "\t\tsrpc::request_t<" << m->input_t << "> request;\n";
-        msg_stream << "\t\trequest.set_method_name(\"" << svc_name << "_servicer" << "::" << m->name << "\");\n";
-        msg_stream << "\t\trequest.set_value(std::move(req));\n";
-        msg_stream << "\t\tpr.pack_request(request);\n\n";
+        msg_stream << "\t\tsrpc::packer pr(_channel->format());\n";
+        msg_stream << "\t\tpr.set_chained(true);\n";
+        msg_stream << "\t\tpr.pack_request(" << svc_name << "_method_ids::" << m->name << ", req);\n\n";
 
-        msg_stream << "\t\tsrpc::transport::send_data(_socket, (*pr.buf()).data(), pr.size());\n"; 
-        msg_stream << "\t\tsrpc::message_t res = srpc::transport::recv_data(_socket);\n";
-        msg_stream << "\t\tsrpc::packer rpr(res.data(), res.size());\n\n";
+        msg_stream << "\t\tsrpc::message_t res = _channel->call(pr.release_chain());\n";
+        msg_stream << "\t\tsrpc::packer rpr(std::move(res), pr.format());\n\n";
         
-        msg_stream << "\t\tsrpc::response_t<" << m->output_t << "> msg = rpr.unpack_response<" << m->output_t << ">();\n\n";
-        msg_stream << "\t\treturn msg.value();\n";
+        msg_stream << "\t\treturn rpr.unpack_response<" << m->output_t << ">().take_value();\n";
 
+        msg_stream << "\t}\n\n";
+
+        // callback flavour, done runs on the client I/O thread
+        msg_stream << "\tvoid " << m->name << "_async(const " << m->input_t << "& req, std::function<void(" << m->output_t << ")> done) {\n";
+        if (fixed) {
+            msg_stream << "\t\tif (_channel->format() == srpc::wire_format::FIXED) {\n";
+            msg_stream << "\t\t\tsrpc::fixed_call_then<" << m->output_t << ">(*_channel, " 
+                << svc_name << "_method_ids::" << m->name << ", req, std::move(done));\n";
+            msg_stream << "\t\t\treturn;\n";
+            msg_stream << "\t\t}\n\n";
+        }
+        msg_stream << "\t\tsrpc::packer pr(_channel->format());\n";
+        msg_stream << "\t\tpr.set_chained(true);\n";
+        msg_stream << "\t\tpr.pack_request(" << svc_name << "_method_ids::" << m->name << ", req);\n\n";
+
+        msg_stream << "\t\t_channel->call_then(pr.release_chain(), [done = std::move(done), format = pr.format()] (srpc::message_t res) {\n";
+        msg_stream << "\t\t\tsrpc::packer rpr(std::move(res), format);\n";
+        msg_stream << "\t\t\tdone(rpr.unpack_response<" << m->output_t << ">().take_value());\n";
+        msg_stream << "\t\t});\n";
+        msg_stream << "\t}\n\n";
+
+        // future flavour
+        msg_stream << "\tstd::future<" << m->output_t << "> " << m->name << "_async(const " << m->input_t << "& req) {\n";
+        msg_stream << "\t\tauto p = std::make_shared<std::promise<" << m->output_t << ">>();\n";
+        msg_stream << "\t\tstd::future<" << m->output_t << "> f = p->get_future();\n";
+        msg_stream << "\t\t" << m->name << "_async(req, [p] (" << m->output_t << " v) { p->set_value(std::move(v)); });\n";
+        msg_stream << "\t\treturn f;\n";
+        msg_stream << "\t}\n\n";
+
+        // coroutine flavour: co_await stub.<name>_co(req)
+        msg_stream << "\tsrpc::callback_awaitable<" << m->output_t << "> " << m->name << "_co(const " << m->input_t << "& req) {\n";
+        msg_stream << "\t\treturn srpc::callback_awaitable<" << m->output_t << ">([this, req] (std::function<void(" 
+            << m->output_t << ")> done) mutable {\n";
+        msg_stream << "\t\t\t" << m->name << "_async(req, std::move(done));\n";
+        msg_stream << "\t\t});\n";
         msg_stream << "\t}\n";
 
         return msg_stream.str();
@@ -101,8 +139,9 @@ struct generator {
         std::ostringstream msg_stream;
         msg_stream << "struct " <<  msg->name << " : public srpc::message_base {\n";
         for (const auto& fd : msg->fields()) {
-            msg_stream << "\t" << fd->type << " " << fd->name << ";\n";
+            msg_stream << "\t" << field_type(fd.get()) << " " << fd->name << ";\n";
         }
+        msg_stream << handle_arena_fields(msg);
 
         msg_stream << "\n\t// overrides\n";
         msg_stream << "\tstatic constexpr const char* name = \"" << msg->name << "\";\n";
@@ -117,21 +156,169 @@ struct generator {
         }
         msg_stream << "\n\t);\n";
 
-        msg_stream << "\tvoid unpack(srpc::buffer::ptr bp) override {\n";
-        msg_stream << "\t\tsrpc::packer p(bp);\n";
+        // codec, called by srpc::packer with the static type, nested messages included
+        msg_stream << "\tvoid encode(srpc::packer& p) const {\n";
+        for (const auto& fd : msg->fields()) {
+            msg_stream << "\t\tp << " << fd->name << ";\n";
+        }
+        msg_stream << "\t}\n";
+
+        msg_stream << "\tvoid decode(srpc::packer& p) {\n";
+        for (const auto& fd : msg->fields()) {
+            msg_stream << "\t\tp >> " << fd->name << ";\n";
+        }
+        msg_stream << "\t}\n";
+
+        // exact packed size, lets srpc::packer reserve its buffer once
+        size_t wire_size = fixed_wire_size(msg->name);
+        if (msg->fields().empty()) {
+            msg_stream << "\tconstexpr size_t encoded_size(srpc::wire_format) const noexcept { return 0; }\n";
+        } else {
+            msg_stream << "\tconstexpr size_t encoded_size(srpc::wire_format f) const noexcept {\n";
+            if (wire_size > 0) {
+                msg_stream << "\t\tif (f == srpc::wire_format::FIXED) { return wire_size; }\n";
+            }
+            msg_stream << "\t\treturn ";
+            for (size_t i = 0; i < msg->fields().size(); i++) {
+                if (i != 0) { msg_stream << "\n\t\t\t+ "; }
+                msg_stream << "srpc::packer::encoded_size(" << msg->fields()[i]->name << ", f)";
+            }
+            msg_stream << ";\n\t}\n";
+        }
+
+        // fixed layout: FIXED format encodes to a constant number of bytes at constant offsets
+        if (wire_size > 0) {
+            std::ostringstream encode_stream, decode_stream;
+            size_t offset = 0;
+            for (const auto& fd : msg->fields()) {
+                if (fd->is_primitive) {
+                    encode_stream << "\t\tstd::memcpy(out + " << offset << ", &" << fd->name << ", sizeof(" << fd->name << "));\n";
+                    decode_stream << "\t\tstd::memcpy(&" << fd->name << ", in + " << offset << ", sizeof(" << fd->name << "));\n";
+                } else {
+                    encode_stream << "\t\t" << fd->name << ".encode_to(out + " << offset << ");\n";
+                    decode_stream << "\t\t" << fd->name << ".decode_from(in + " << offset << ");\n";
+                }
+                offset += fixed_wire_size(fd->type);
+            }
+
+            msg_stream << "\n\t// fixed layout\n";
+            msg_stream << "\tstatic constexpr size_t wire_size = " << wire_size << ";\n";
+            msg_stream << "\tvoid encode_to(uint8_t* out) const {\n" << encode_stream.str() << "\t}\n";
+            msg_stream << "\tvoid decode_from(const uint8_t* in) {\n" << decode_stream.str() << "\t}\n";
+        }
+        msg_stream << "};\n\n";
+
+        return msg_stream.str();
+    }
+
+    /// Messages with arena fields are allocator-aware: a server decodes their requests with
+    /// the request arena's allocator, and a handler can build its response from the same
+    /// one, e.g. R res(req.get_allocator()).
+    [[nodiscard]] static std::string handle_arena_fields(std::shared_ptr<message> msg) noexcept {
+        std::vector<std::string> arena_fields;
+        for (const auto& fd : msg->fields()) {
+            if (fd->in_arena) { arena_fields.push_back(fd->name); }
+        }
+        if (arena_fields.empty()) { return ""; }
+
+        std::ostringstream msg_stream;
+        msg_stream << "\n\t// arena fields\n";
+        msg_stream << "\tusing allocator_type = std::pmr::polymorphic_allocator<>;\n";
+        msg_stream << "\t" << msg->name << "() = default;\n";
+        msg_stream << "\texplicit " << msg->name << "(allocator_type alloc) : ";
+        for (size_t i = 0; i < arena_fields.size(); i++) {
+            msg_stream << (i == 0 ? "" : ", ") << arena_fields[i] << "(alloc)";
+        }
+        msg_stream << " {}\n";
+        msg_stream << "\tallocator_type get_allocator() const noexcept { return " << arena_fields[0] << ".get_allocator(); }\n";
+        return msg_stream.str();
+    }
+
+    /// Size of a field type or message in the FIXED wire format.
+    /// @return 0 if it varies (strings, messages holding strings) or is not known
+    [[nodiscard]] static size_t fixed_wire_size(const std::string& type) noexcept {
+        static const std::unordered_map<std::string, size_t> primitive_sizes = {
+            {"bool", 1}, {"char", 1}, {"int8_t", 1}, {"int16_t", 2}, {"int32_t", 4}, {"int64_t", 8},
+            {"uint8_t", 1}, {"uint16_t", 2}, {"uint32_t", 4}, {"uint64_t", 8}, {"float", 4}, {"double", 8}
+        };
+        if (auto it = primitive_sizes.find(type); it != primitive_sizes.end()) { return it->second; }
+
+        auto it = contract::element_index_map.find(type);
+        if (it == contract::element_index_map.end() || it->second >= contract::elements.size()) { return 0; }
+        auto msg = dynamic_pointer_cast<message>(contract::elements[it->second]);
+        if (!msg || msg->name != type || msg->fields().empty()) { return 0; }
 
+        size_t size = 0;
         for (const auto& fd : msg->fields()) {
-            if (fd->is_primitive) {
-                msg_stream << "\t\tp >> " << fd->name << ";\n";
-            } else {
-                msg_stream << "\t\t" << fd->name << " = *(p->getv());\n";
+            if (fd->is_repeated || fd->is_map()) { return 0; }
+            size_t field_size = fixed_wire_size(fd->type);
+            if (field_size == 0) { return 0; }
+            size += field_size;
+        }
+        return size;
+    }
+
+    /// Read-only counterpart of a message for handlers that take it instead of the owned
+    /// type: strings are std::string_views into the received frame, nested messages are
+    /// views themselves. Valid until the handler returns (or its coroutine finishes).
+    [[nodiscard]] static std::string handle_message_view(std::shared_ptr<message> msg) noexcept {
+        std::ostringstream msg_stream;
+        std::string view_name = msg->name + "_view";
+
+        msg_stream << "struct " << view_name << " : public srpc::message_base {\n";
+        for (const auto& fd : msg->fields()) {
+            msg_stream << "\t" << view_type(fd.get()) << " " << fd->name << ";\n";
+        }
+
+        msg_stream << "\n\t// overrides\n";
+        msg_stream << "\tstatic constexpr const char* name = \"" << msg->name << "\";\n";
+        msg_stream << "\tstatic constexpr auto fields = std::make_tuple(\n";
+
+        for (size_t i = 0; i < msg->fields().size(); i++) {
+            msg_stream << "\t\tSTRUCT_MEMBER(" << view_name << ", " << msg->fields()[i]->name << ", \"" 
+                << msg->name << "::" << msg->fields()[i]->name << "\")";
+            if (i != msg->fields().size() - 1) {
+                msg_stream << ",\n";
             }
         }
+        msg_stream << "\n\t);\n";
+
+        msg_stream << "\tvoid decode(srpc::packer& p) {\n";
+        for (const auto& fd : msg->fields()) {
+            msg_stream << "\t\tp >> " << fd->name << ";\n";
+        }
         msg_stream << "\t}\n";
         msg_stream << "};\n\n";
 
         return msg_stream.str();
     }
+
+    /// Type of a field, repeated fields are std::vectors of it.
+    [[nodiscard]] static std::string field_type(field_descriptor* fd) noexcept {
+        std::string type = fd->type;
+        if (fd->in_arena) { return type == "std::string" ? "std::pmr::string" : "std::pmr::vector<uint8_t>"; }
+        if (fd->is_map()) { type = "std::unordered_map<" + fd->key_type + ", " + type + ">"; }
+        if (fd->is_repeated) { return "std::vector<" + type + ">"; }
+        return type;
+    }
+
+    /// Type of a field inside a *_view message.
+    [[nodiscard]] static std::string view_type(field_descriptor* fd) noexcept {
+        std::string type = fd->type;
+        if (!fd->is_primitive) { 
+            type = fd->type + "_view"; 
+        } else if (fd->type == "std::string") { 
+            type = "std::string_view"; 
+        } else if (fd->type == "std::vector<uint8_t>") {
+            type = "std::span<const uint8_t>";
+        }
+        if (fd->is_map()) {
+            std::string key_type = fd->key_type == "std::string" ? "std::string_view" : fd->key_type;
+            type = "std::unordered_map<" + key_type + ", " + type + ">";
+        }
+        if (fd->is_repeated) { return "std::vector<" + type + ">"; }
+        return type;
+    }
  
     static signed write_to_file(const std::string& file_path, const std::string& s) noexcept {
         std::ofstream file(file_path, std::ios::app);
@@ -149,8 +336,15 @@ struct generator {
         std::ostringstream init_stream;
         init_stream << "#include <srpc/core.hpp>\n";
         init_stream << "#include <srpc/transport.hpp>\n";
+        init_stream << "#include <srpc/client.hpp>\n";
         init_stream << "#include <srpc/packer.hpp>\n";
+        init_stream << "#include <cstring>\n";
         init_stream << "#include <stdexcept>\n";
+        init_stream << "#include <string_view>\n";
+        init_stream << "#include <span>\n";
+        init_stream << "#include <vector>\n";
+        init_stream << "#include <unordered_map>\n";
+        init_stream << "#include <memory_resource>\n";
         init_stream << "#include <cstdint>\n\n";
         init_stream << "/**\n * This is an auto-generated file generated by srpc. Do not modify!\n */\n\n";
 
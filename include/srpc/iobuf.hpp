@@ -0,0 +1,174 @@
+#pragma once
+
+#include <span>
+#include <array>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <sys/uio.h>
+
+namespace srpc {
+
+#define IOBUF_REF_MIN 8192   // blobs at least this big are referenced by a chained packer, smaller ones copied
+#define IOBUF_INLINE_SEGMENTS 4 // segments (and owners) a chain holds without allocating, a response takes 1 or 2
+
+/// Bytes held as a chain of segments rather than one contiguous block, so that large
+/// regions can be sent without being copied: a segment either shares ownership of its
+/// memory (refcounted) or borrows it from the caller, who then keeps it alive until the
+/// chain is sent. Handed to sendmsg as one iovec per segment.
+class iobuf {
+public:
+    struct segment {
+        const uint8_t*  data;
+        size_t          len;
+    };
+
+    iobuf() = default;
+    iobuf(iobuf&& other) noexcept 
+        : _segments(std::move(other._segments)), _owners(std::move(other._owners)), _size(std::exchange(other._size, 0)) {}
+    iobuf& operator=(iobuf&& other) noexcept {
+        if (this != &other) {
+            _segments = std::move(other._segments);
+            _owners = std::move(other._owners);
+            _size = std::exchange(other._size, 0);
+        }
+        return *this;
+    }
+
+    iobuf(const iobuf&) = delete;
+    iobuf& operator=(const iobuf&) = delete;
+
+    /// Appends len bytes that owner keeps alive, the chain holds a reference to it.
+    void append(std::shared_ptr<const void> owner, const uint8_t* data, size_t len) {
+        if (len == 0) { return; }
+        append_ref(data, len);
+        hold(std::move(owner));
+    }
+
+    /// Appends len bytes without owning them, they must outlive the chain.
+    void append_ref(const uint8_t* data, size_t len) {
+        if (len == 0) { return; }
+        _segments.push_back({ data, len });
+        _size += len;
+    }
+
+    /// Appends a copy of len bytes.
+    void append_copy(const uint8_t* data, size_t len) {
+        if (len == 0) { return; }
+        auto block = std::make_shared<std::vector<uint8_t>>(data, data + len);
+        const uint8_t* bytes = block->data();
+        append(std::move(block), bytes, len);
+    }
+
+    /// Moves the segments of other to the end of this chain.
+    void append(iobuf&& other) {
+        for (const segment& s : other._segments) { _segments.push_back(s); }
+        for (auto& owner : other._owners) { _owners.push_back(std::move(owner)); }
+        _size += other._size;
+        other.clear();
+    }
+
+    /// Keeps owner alive as long as the chain, e.g. the object borrowed segments point into.
+    void hold(std::shared_ptr<const void> owner) {
+        if (owner) { _owners.push_back(std::move(owner)); }
+    }
+
+    size_t size() const noexcept { return _size; }
+    bool empty() const noexcept { return _size == 0; }
+    std::span<const segment> segments() const noexcept { return { _segments.begin(), _segments.size() }; }
+
+    /// Fills iov with the segments, starting skip bytes into the chain.
+    /// @return number of iovecs filled, at most max
+    size_t to_iov(size_t skip, struct iovec* iov, size_t max) const noexcept {
+        size_t n = 0;
+        for (const segment& s : _segments) {
+            if (n == max) { break; }
+            if (skip >= s.len) {
+                skip -= s.len;
+                continue;
+            }
+            iov[n++] = { const_cast<uint8_t*>(s.data + skip), s.len - skip };
+            skip = 0;
+        }
+        return n;
+    }
+
+    /// Copies the chain into one contiguous block.
+    std::vector<uint8_t> flatten() const {
+        std::vector<uint8_t> bytes(_size);
+        size_t pos = 0;
+        for (const segment& s : _segments) {
+            std::memcpy(bytes.data() + pos, s.data, s.len);
+            pos += s.len;
+        }
+        return bytes;
+    }
+
+    void clear() noexcept {
+        _segments.clear();
+        _owners.clear();
+        _size = 0;
+    }
+
+private:
+    /// Keeps its first IOBUF_INLINE_SEGMENTS elements in place and moves to the heap past
+    /// that, so the chains of most messages are built without calling malloc.
+    template <typename T>
+    class small_vector {
+    public:
+        small_vector() = default;
+        small_vector(small_vector&& other) noexcept { *this = std::move(other); }
+        small_vector& operator=(small_vector&& other) noexcept {
+            if (this != &other) {
+                clear();
+                if (other._heap.empty()) {
+                    for (size_t i = 0; i < other._n_inline; i++) { _inline[i] = std::move(other._inline[i]); }
+                    _n_inline = other._n_inline;
+                } else {
+                    _heap = std::move(other._heap);
+                }
+                other.clear();
+            }
+            return *this;
+        }
+
+        void push_back(T v) {
+            if (_heap.empty() && _n_inline < IOBUF_INLINE_SEGMENTS) {
+                _inline[_n_inline++] = std::move(v);
+                return;
+            }
+            if (_heap.empty()) { // spills, along with what was inline
+                _heap.reserve(2 * IOBUF_INLINE_SEGMENTS);
+                for (size_t i = 0; i < _n_inline; i++) { _heap.push_back(std::exchange(_inline[i], T{})); }
+                _n_inline = 0;
+            }
+            _heap.push_back(std::move(v));
+        }
+
+        /// Keeps the heap block, if any, for the elements to come.
+        void clear() noexcept {
+            for (size_t i = 0; i < _n_inline; i++) { _inline[i] = T{}; }
+            _n_inline = 0;
+            _heap.clear();
+        }
+
+        size_t size() const noexcept { return _heap.empty() ? _n_inline : _heap.size(); }
+        T* begin() noexcept { return _heap.empty() ? _inline.data() : _heap.data(); }
+        T* end() noexcept { return begin() + size(); }
+        const T* begin() const noexcept { return _heap.empty() ? _inline.data() : _heap.data(); }
+        const T* end() const noexcept { return begin() + size(); }
+
+    private:
+        std::array<T, IOBUF_INLINE_SEGMENTS>    _inline {};
+        size_t                                  _n_inline = 0;
+        std::vector<T>                          _heap;
+    };
+
+    small_vector<segment>                       _segments;
+    small_vector<std::shared_ptr<const void>>   _owners;
+    size_t                                      _size = 0;
+};
+
+} // namespace srpc
@@ -1,35 +1,47 @@
 #pragma once
 
 #include "core.hpp"
+#include "varint.hpp"
+#include "varint_array.hpp"
+#include "iobuf.hpp"
+#include "arena.hpp"
 #include <cstdio>
+#include <algorithm>
 #include <memory>
 #include <vector>
 #include <string>
+#include <string_view>
+#include <span>
 #include <cstdint>
 #include <cassert>
 #include <cstring>
+#include <utility>
 #include <type_traits>
-#include <unordered_map>
 
 namespace srpc {
 
 enum rpc_status_code : uint8_t {
 	RPC_SUCCESS = 0,
 	RPC_ERR_FUNCTION_NOT_REGISTERED,
-	RPC_ERR_RECV_TIMEOUT
+	RPC_ERR_RECV_TIMEOUT,
+	RPC_ERR_CONNECTION_CLOSED,
+	RPC_ERR_HANDLER_FAILED,
+	RPC_ERR_MALFORMED_MESSAGE
 };
 
 template <SrpcMessage T>
 class request_t {
 public:
-    T value() const { return _value; }
-    const std::string& method_name() const { return _method_name; }
+    T const& value() const { return _value; }
+    /// Moves the value out of a request that is done with.
+    T take_value() && { return std::move(_value); }
+    uint32_t method_id() const { return _method_id; }
     
     void set_value(T&& v) { _value = std::move(v); }
-    void set_method_name(std::string const& s) { _method_name = s; }
+    void set_method_id(uint32_t id) { _method_id = id; }
     
 private:
-    std::string _method_name;
+    uint32_t    _method_id = 0;
     T           _value;
 };
 
@@ -40,10 +52,14 @@ public:
     ~response_t() {};
 
     rpc_status_code code() const { return _code; }
-    T value() const { return _value; }
+    T const& value() const { return _value; }
+    /// Moves the value out of a response that is done with: 
+    /// `return std::move(res).take_value();`
+    T take_value() && { return std::move(_value); }
 
     void set_code(rpc_status_code c) { _code = c; }
     void set_value(T const& v) { _value = v; }
+    void set_value(T&& v) { _value = std::move(v); }
 
 private:
     rpc_status_code _code;
@@ -55,62 +71,97 @@ public:
     using ptr = std::shared_ptr<packer>;
 
     packer() { _buf = std::make_shared<buffer>(); }
+    explicit packer(wire_format f) : _format(f) { _buf = std::make_shared<buffer>(); }
     packer(const uint8_t* bytes, size_t len) { _buf = std::make_shared<buffer>(bytes, len); }
     packer(std::vector<uint8_t> const& bytes) { _buf = std::make_shared<buffer>(bytes); }
     packer(std::vector<uint8_t>&& bytes) { _buf = std::make_shared<buffer>(std::move(bytes)); }
     packer(buffer::ptr buf_ptr) : _buf(buf_ptr) {}
+    packer(slab&& s, wire_format f = wire_format::FIXED) : _format(f) { _buf = std::make_shared<buffer>(std::move(s)); } // adopts, no copy
+
+    /// Packers of a server call: the buffer, and everything appended to it, live in the
+    /// call's arena (see request_arena), as should the packer itself (make_in()).
+    packer(wire_format f, request_arena::ptr a) : _format(f), _arena(std::move(a)) { _buf = new_buffer(); }
+    packer(slab&& s, wire_format f, request_arena::ptr a) : _format(f), _arena(std::move(a)) { 
+        _buf = make_in<buffer>(_arena, std::move(s), memory()); 
+    }
 
     const uint8_t* data() { return _buf->curdata(); }
     size_t size() { return _buf->cursize(); }
     size_t offset() const noexcept { return _buf->offset(); }
-    void clear() noexcept { _buf->reset(); }
+    void clear() noexcept { _buf->reset(); _failed = false; }
     buffer::ptr buf() noexcept { return _buf; }
+    wire_format format() const noexcept { return _format; }
+    void set_format(wire_format f) noexcept { _format = f; }
+    /// Whether the message read so far was truncated or malformed: a length or count 
+    /// overran it, or a varint did not end. Reading stops at the end of the message and
+    /// what was decoded must not be used.
+    bool failed() const noexcept { return _failed; }
+    /// Arena of the call this packer belongs to, null outside of one.
+    request_arena::ptr const& arena() const noexcept { return _arena; }
+
+    /// A chained packer references strings, bytes and number arrays of IOBUF_REF_MIN bytes
+    /// or more where they live instead of copying them, and is sent through release_chain().
+    /// What was packed must then stay alive and unchanged until the chain is sent, or be 
+    /// held by it (see iobuf::hold). data() and size() only cover the bytes packed since 
+    /// the last referenced blob.
+    void set_chained(bool chained) noexcept { _chained = chained; }
+    bool chained() const noexcept { return _chained; }
+
+    /// Hands over everything packed as a chain: the referenced blobs and, without copying,
+    /// the buffer segments between them. Leaves the packer empty.
+    iobuf release_chain() {
+        cut_segment();
+        return std::exchange(_chain, iobuf{});
+    }
+
+    /// Keeps owner, e.g. the message blobs were referenced from, alive with the chain.
+    void hold(std::shared_ptr<const void> owner) { _chain.hold(std::move(owner)); }
    
     template <typename T>
     constexpr packer& operator>>(T& v) { pipe_output(v); return *this; };
 
     template <typename T>
-    constexpr packer& operator<<(T v) { pack_arg(v); return *this; };
+    constexpr packer& operator<<(T const& v) { pack_arg(v); return *this; };
+
+    /// To pack bytes with the method id as header. The message type is implied by the 
+    /// method. Used to pack the outermost struct from client to server (a client request).
+    template <SrpcMessage T>
+    constexpr void pack_request(request_t<T> const& req) { pack_request(req.method_id(), req.value()); }
 
-    /// To pack bytes with the method_name, service_name and message_name as header. 
-    /// Used to pack the outermost struct from client to server (a client request).
+    /// Same, straight from the message rather than a request_t it was moved into.
     template <SrpcMessage T>
-    constexpr void pack_request(request_t<T> const& req) {
-        pack_arg(req.method_name());
-        pack_arg(T::name);
-        pack_struct(req.value());
+    constexpr void pack_request(uint32_t method_id, T const& value) {
+        reserve_copied(encoded_size(method_id, _format) + encoded_size(value, _format), value);
+        pack_arg(method_id);
+        pack_struct(value);
     }
 
-    /// To pack bytes with the message's name as the header. 
+    /// To pack bytes with the status code as the header. 
     /// Used to pack the outermost struct from server to client (a server response).
     template <SrpcMessage T> 
-    constexpr void pack_response(response_t<T> const& resp) {
-        pack_arg(resp.code());
-        pack_arg(T::name);
-        pack_struct(resp.value());
+    constexpr void pack_response(response_t<T> const& resp) { pack_response(resp.code(), resp.value()); }
+
+    /// Same, straight from the message rather than a response_t it was moved into.
+    template <SrpcMessage T> 
+    constexpr void pack_response(rpc_status_code code, T const& value) {
+        reserve_copied(sizeof(rpc_status_code) + encoded_size(value, _format), value);
+        pack_arg(code);
+        pack_struct(value);
     }    
      
-    /// To be called at the server, unpacks a client request. 
+    /// To be called at the server, unpacks a client request. Check failed() before using it.
     /// @tparam R request struct type
     template <SrpcMessage R>
     [[nodiscard]] request_t<R> unpack_request() noexcept { 
         request_t<R> req;
 
-        std::string method_name;
-        *this >> method_name;
-        req.set_method_name(method_name);
+        uint32_t method_id = 0;
+        *this >> method_id;
+        req.set_method_id(method_id);
 
-        std::string message_name;
-        *this >> message_name;
-     
-        auto it = message_registry.find(message_name);
-        // TODO: change this to 'it == message_registry.end()' and add error exception 
-        // (package and send out some error in the request_t class)
-        if (it != message_registry.end()) {
-            std::unique_ptr<R> msg_ptr(dynamic_cast<R*>(it->second().release()));
-            msg_ptr->unpack(_buf);
-            req.set_value(std::move(*msg_ptr));
-        }
+        R value;
+        unpack_struct(value);
+        req.set_value(std::move(value));
 
         return req;
     }
@@ -120,45 +171,107 @@ public:
     template <SrpcMessage R>
     [[nodiscard]] response_t<R> unpack_response() noexcept {
         response_t<R> res;
+        if (size() == 0) { // no response frame, the connection went away
+            res.set_code(RPC_ERR_CONNECTION_CLOSED);
+            return res;
+        }
         
         // read status code
         rpc_status_code status;
         *this >> status;
         res.set_code(status);
 
-        // read message name
-        std::string message_name;
-        *this >> message_name;
-        
-        auto it = message_registry.find(message_name);
-        // TODO: change this to 'it == message_registry.end()' and add error exception 
-        // (package and send out some error in the response_t class)
-        if (it != message_registry.end()) { 
-            std::unique_ptr<R> msg_ptr(dynamic_cast<R*>(it->second().release()));
-            msg_ptr->unpack(_buf);
-            res.set_value(std::move(*msg_ptr));
+        // errors raised before a handler ran carry no message
+        if (size() > 0) { 
+            R value;
+            unpack_struct(value);
+            res.set_value(std::move(value));
         }
+        if (_failed) { res.set_code(RPC_ERR_MALFORMED_MESSAGE); }
 
         return res;
     }
-    
-    /// To be called to get the message in a buffer without metadata
-    template <SrpcMessage T>
-    [[nodiscard]] T* getv() noexcept {
-        std::string message_name;
-        *this >> message_name;
 
-        auto it = message_registry.find(message_name);
-        if (it == message_registry.end()) { 
-            fprintf(stderr, "message %s not found!", message_name.c_str());
-            return nullptr; 
+    /// Number of bytes v packs to in format f. Messages use their generated encoded_size(),
+    /// or add up their T::fields if they have none.
+    template <typename T>
+    static constexpr size_t encoded_size(T const& v, wire_format f) noexcept {
+        if constexpr (std::is_base_of_v<message_base, T>) {
+            if constexpr (SrpcFixedMessage<T>) {
+                if (f == wire_format::FIXED) { return T::wire_size; }
+            }
+            if constexpr (requires { v.encoded_size(f); }) {
+                return v.encoded_size(f);
+            } else {
+                return std::apply(
+                    [&v, f] (const auto&... member) { return (size_t{0} + ... + encoded_size(v.*(std::get<MEMBER_ADDR>(member)), f)); },
+                    T::fields
+                );
+            }
+        } else if constexpr (is_vector_v<T>) {
+            using E = typename T::value_type;
+            size_t size = encoded_size(v.size(), f);
+            if (packs_as_block<E>(f)) { return size + v.size() * sizeof(E); }
+            if constexpr (SrpcFixedMessage<E>) {
+                if (f == wire_format::FIXED) { return size + v.size() * E::wire_size; }
+            }
+            for (const E& e : v) { size += encoded_size(e, f); }
+            return size;
+        } else if constexpr (is_map_v<T>) {
+            using K = typename T::key_type;
+            using V = typename T::mapped_type;
+            size_t size = encoded_size(v.size(), f);
+            if (packs_as_block<K>(f)) { size += v.size() * sizeof(K); }
+            if (packs_as_block<V>(f)) { size += v.size() * sizeof(V); }
+            if (packs_as_block<K>(f) && packs_as_block<V>(f)) { return size; }
+            for (const auto& [key, value] : v) {
+                if (!packs_as_block<K>(f)) { size += encoded_size(key, f); }
+                if (!packs_as_block<V>(f)) { size += encoded_size(value, f); }
+            }
+            return size;
+        } else if constexpr (std::is_same_v<T, std::string> || std::is_same_v<T, std::pmr::string> || 
+                             std::is_same_v<T, std::string_view> || std::is_same_v<T, std::span<const uint8_t>>) {
+            return encoded_size(v.size(), f) + v.size();
+        } else if constexpr (is_varint_v<T>) {
+            if (f == wire_format::FIXED) { return sizeof(T); }
+            if constexpr (std::is_signed_v<T>) { return varint::encoded_size(varint::zigzag(v)); }
+            else { return varint::encoded_size(v); }
+        } else {
+            return sizeof(T);
         }
-        T* v(dynamic_cast<T*>(it->second().release()));
-        v->unpack(_buf);
+    }
 
-        assert(size() == 0);
-     
-        return v;
+    /// Number of bytes of v a chained packer references rather than copies in format f: 
+    /// its strings, bytes and number arrays of IOBUF_REF_MIN bytes or more.
+    template <typename T>
+    static constexpr size_t referenced_size(T const& v, wire_format f) noexcept {
+        if constexpr (SrpcFixedMessage<T>) {
+            return 0;
+        } else if constexpr (std::is_base_of_v<message_base, T>) {
+            return std::apply(
+                [&v, f] (const auto&... member) { return (size_t{0} + ... + referenced_size(v.*(std::get<MEMBER_ADDR>(member)), f)); },
+                T::fields
+            );
+        } else if constexpr (is_vector_v<T>) {
+            using E = typename T::value_type;
+            if (packs_as_block<E>(f)) { return v.size() * sizeof(E) >= IOBUF_REF_MIN ? v.size() * sizeof(E) : 0; }
+            size_t size = 0;
+            if constexpr (!std::is_arithmetic_v<E>) {
+                for (const E& e : v) { size += referenced_size(e, f); }
+            }
+            return size;
+        } else if constexpr (is_map_v<T>) { // keys are primitive, so are copied
+            size_t size = 0;
+            if constexpr (!std::is_arithmetic_v<typename T::mapped_type>) {
+                for (const auto& [key, value] : v) { size += referenced_size(value, f); }
+            }
+            return size;
+        } else if constexpr (std::is_same_v<T, std::string> || std::is_same_v<T, std::pmr::string> || 
+                             std::is_same_v<T, std::string_view> || std::is_same_v<T, std::span<const uint8_t>>) {
+            return v.size() >= IOBUF_REF_MIN ? v.size() : 0;
+        } else {
+            return 0;
+        }
     }
 
 private:
@@ -168,23 +281,317 @@ private:
     template <typename T>
     constexpr void pack_arg(T const& arg) noexcept;
     
-    /// Packs message structs by using the T::fields tuple the message comes with
+    /// Packs message structs with their generated encode(), or by using the T::fields 
+    /// tuple the message comes with if it has none. Fixed-layout messages are copied
+    /// in one go in the FIXED format.
     template <typename T> requires has_fields_v<T>
     constexpr void pack_struct(T const& arg) noexcept {
-        std::apply(
-            [this, &arg] (const auto&... member) { (pack_arg(arg.*(std::get<MEMBER_ADDR>(member))), ...); },
-            T::fields
-        );
+        if constexpr (SrpcFixedMessage<T>) {
+            if (_format == wire_format::FIXED) {
+                arg.encode_to(_buf->extend(T::wire_size)); // in place, nested ones included
+                return;
+            }
+        }
+        if constexpr (requires (packer& p) { arg.encode(p); }) {
+            arg.encode(*this);
+        } else {
+            std::apply(
+                [this, &arg] (const auto&... member) { (pack_arg(arg.*(std::get<MEMBER_ADDR>(member))), ...); },
+                T::fields
+            );
+        }
+    }
+
+    /// Reads message structs in place with their generated decode(), or by using the 
+    /// T::fields tuple the message comes with if it has none. Fixed-layout messages are
+    /// copied in one go in the FIXED format.
+    template <typename T> requires has_fields_v<T>
+    constexpr void unpack_struct(T& v) noexcept {
+        if constexpr (SrpcFixedMessage<T>) {
+            if (_format == wire_format::FIXED) {
+                const uint8_t* in = take(T::wire_size); // bounds checked once for the whole message
+                if (in) { v.decode_from(in); }
+                return;
+            }
+        }
+        if constexpr (requires (packer& p) { v.decode(p); }) {
+            v.decode(*this);
+        } else {
+            std::apply(
+                [this, &v] (const auto&... member) { (pipe_output(v.*(std::get<MEMBER_ADDR>(member))), ...); },
+                T::fields
+            );
+        }
+    }
+
+    /// Integers other than 1-byte ones go out as varints in wire_format::COMPACT.
+    template <typename T>
+    static constexpr bool is_varint_v = std::is_integral_v<T> && !std::is_same_v<T, bool> && sizeof(T) > 1;
+
+    /// Whether a vector of T is written as one contiguous copy of its elements: numbers
+    /// are, unless COMPACT turns them into varints. std::vector<bool> is not contiguous.
+    template <typename T>
+    static constexpr bool packs_as_block(wire_format f) noexcept {
+        if constexpr (std::is_arithmetic_v<T> && !std::is_same_v<T, bool>) {
+            return !(is_varint_v<T> && f == wire_format::COMPACT);
+        }
+        return false;
+    }
+
+    /// Repeated fields: the element count, then the elements.
+    template <typename T, typename A>
+    void pack_vector(std::vector<T, A> const& v) noexcept {
+        pack_arg(v.size());
+        pack_elements(v);
+    }
+
+    template <typename T, typename A>
+    void unpack_vector(std::vector<T, A>& v) noexcept {
+        size_t count = 0;
+        pipe_output(count);
+        unpack_elements(v, count);
+    }
+
+    /// Elements one after another, without their count. 32 and 64-bit integer arrays 
+    /// are varint-encoded in bulk by the SIMD kernels of varint_array.hpp.
+    template <typename T, typename A>
+    void pack_elements(std::vector<T, A> const& v) noexcept {
+        if constexpr (packs_as_block<T>(wire_format::FIXED)) {
+            if (packs_as_block<T>(_format)) {
+                pack_blob(reinterpret_cast<const uint8_t*>(v.data()), v.size() * sizeof(T));
+                return;
+            }
+        }
+        if constexpr (varint::array_element<T>) { // COMPACT, vectorized
+            size_t len = encoded_size(v, _format) - encoded_size(v.size(), _format);
+            varint::encode_array(v.data(), v.size(), _buf->extend(len));
+            return;
+        }
+        if constexpr (SrpcFixedMessage<T>) { // FIXED: one reservation, each encoded in place
+            if (_format == wire_format::FIXED) {
+                uint8_t* out = _buf->extend(v.size() * T::wire_size);
+                for (const T& e : v) { e.encode_to(out); out += T::wire_size; }
+                return;
+            }
+        }
+        for (const T& e : v) { pack_arg(e); }
+    }
+
+    /// Replaces v with the count elements that follow.
+    template <typename T, typename A>
+    void unpack_elements(std::vector<T, A>& v, size_t count) noexcept {
+        v.clear();
+        if constexpr (packs_as_block<T>(wire_format::FIXED)) {
+            if (packs_as_block<T>(_format)) {
+                if (count > _buf->cursize() / sizeof(T)) {
+                    fprintf(stderr, "srpc::packer::unpack_elements(): %zu elements overrun the message.\n", count);
+                    fail();
+                    return;
+                }
+                v.resize(count);
+                std::memcpy(v.data(), take(count * sizeof(T)), count * sizeof(T));
+                return;
+            }
+        }
+        if constexpr (varint::array_element<T>) { // COMPACT, vectorized
+            if (count > _buf->cursize()) { // every varint takes at least a byte
+                fprintf(stderr, "srpc::packer::unpack_elements(): %zu elements overrun the message.\n", count);
+                fail();
+                return;
+            }
+            v.resize(count);
+            size_t n = count == 0 ? 0 : varint::decode_array(_buf->curdata(), _buf->cursize(), v.data(), count);
+            if (count > 0 && n == 0) {
+                fprintf(stderr, "srpc::packer::unpack_elements(): malformed varint.\n");
+                v.clear();
+                fail();
+                return;
+            }
+            _buf->increment(n);
+            return;
+        }
+        if constexpr (SrpcFixedMessage<T>) { // FIXED: bounds checked once for all of them
+            if (_format == wire_format::FIXED) {
+                if (count > _buf->cursize() / T::wire_size) {
+                    fprintf(stderr, "srpc::packer::unpack_elements(): %zu elements overrun the message.\n", count);
+                    fail();
+                    return;
+                }
+                v.resize(count);
+                const uint8_t* in = take(count * T::wire_size);
+                for (T& e : v) { e.decode_from(in); in += T::wire_size; }
+                return;
+            }
+        }
+        v.reserve(std::min(count, _buf->cursize())); // a bogus count cannot reserve more than the frame
+        for (size_t i = 0; i < count && !_failed; i++) {
+            if constexpr (std::is_same_v<T, bool>) { // std::vector<bool> hands out proxies
+                bool e = false;
+                pipe_output(e);
+                v.push_back(e);
+            } else {
+                pipe_output(v.emplace_back()); // decoded straight into the element
+            }
+        }
+    }
+
+    /// Map fields: the entry count, every key, then every value. Keys and values are laid
+    /// out like repeated fields, so numeric ones are copied as one block.
+    template <typename M>
+    void pack_map(M const& m) noexcept {
+        pack_arg(m.size());
+        pack_map_column<true>(m);
+        pack_map_column<false>(m);
+    }
+
+    /// Decodes keys and values in bulk, then fills the map sized for all of them at once.
+    template <typename M>
+    void unpack_map(M& m) noexcept {
+        size_t count = 0;
+        pipe_output(count);
+        m.clear();
+        if (count > _buf->cursize()) { // every key takes at least a byte
+            fprintf(stderr, "srpc::packer::unpack_map(): %zu entries overrun the message.\n", count);
+            fail();
+            return;
+        }
+
+        std::vector<typename M::key_type> keys;
+        std::vector<typename M::mapped_type> values;
+        unpack_elements(keys, count);
+        unpack_elements(values, count);
+        if (keys.size() != count || values.size() != count) { return; } // reported already
+
+        if constexpr (requires { m.reserve(count); }) { m.reserve(count); }
+        for (size_t i = 0; i < count; i++) {
+            m.emplace(std::move(keys[i]), std::move(values[i]));
+        }
+    }
+
+    /// The keys (or the values) of every entry of m, one after another.
+    template <bool keys, typename M>
+    void pack_map_column(M const& m) noexcept {
+        using E = std::conditional_t<keys, typename M::key_type, typename M::mapped_type>;
+        auto column = [] (const auto& entry) -> const E& {
+            if constexpr (keys) { return entry.first; } else { return entry.second; }
+        };
+        if constexpr (packs_as_block<E>(wire_format::FIXED)) {
+            if (packs_as_block<E>(_format)) {
+                uint8_t* out = _buf->extend(m.size() * sizeof(E));
+                for (const auto& entry : m) {
+                    std::memcpy(out, &column(entry), sizeof(E));
+                    out += sizeof(E);
+                }
+                return;
+            }
+        }
+        for (const auto& entry : m) { pack_arg(column(entry)); }
+    }
+
+    template <typename T>
+    void pack_varint(T v) noexcept {
+        uint8_t bytes[VARINT_MAX_BYTES];
+        uint64_t u;
+        if constexpr (std::is_signed_v<T>) { u = varint::zigzag(v); } else { u = v; }
+        _buf->append(bytes, varint::encode(u, bytes));
     }
 
-    buffer::ptr _buf;
+    template <typename T>
+    void unpack_varint(T& v) noexcept {
+        uint64_t u = 0;
+        size_t n = varint::decode(_buf->curdata(), _buf->cursize(), u);
+        if (n == 0) {
+            if (!_failed) { fprintf(stderr, "srpc::packer::unpack_varint(): malformed varint.\n"); }
+            v = 0;
+            fail();
+            return;
+        }
+        if constexpr (std::is_signed_v<T>) {
+            v = varint::unzigzag<T>(static_cast<std::make_unsigned_t<T>>(u));
+        } else {
+            v = static_cast<T>(u);
+        }
+        _buf->increment(n);
+    }
+
+    /// The next len bytes of the message, consumed. Lengths and counts come off the wire,
+    /// so they are checked before anything is read: if fewer than len bytes are left, the
+    /// packer fails instead.
+    /// @return nullptr if len overran the message
+    const uint8_t* take(size_t len) noexcept {
+        const uint8_t* in = _buf->curdata();
+        if (_buf->increment(len)) { return in; }
+        if (!_failed) { fprintf(stderr, "srpc::packer::take(): %zu bytes overrun the message.\n", len); }
+        fail();
+        return nullptr;
+    }
+
+    /// Marks the message malformed and skips to its end, nothing more is read from it.
+    void fail() noexcept {
+        _failed = true;
+        _buf->increment(_buf->cursize());
+    }
+
+    /// Raw bytes of a string, bytes field or number array. Referenced rather than copied
+    /// by a chained packer if they are large.
+    void pack_blob(const uint8_t* data, size_t len) {
+        if (!_chained || len < IOBUF_REF_MIN) {
+            _buf->append(data, len);
+            return;
+        }
+        cut_segment();
+        _chain.append_ref(data, len);
+    }
+
+    /// Reserves, once, room for the len bytes value is about to pack to. A chained packer
+    /// only copies what it does not reference; the segments cut off by referenced blobs 
+    /// each reserve what is left to copy, so none of them grows while packing either.
+    template <typename T>
+    void reserve_copied(size_t len, T const& value) {
+        if (_chained) {
+            len -= referenced_size(value, _format);
+            _copy_left = _buf->cursize() + len;
+        }
+        _buf->reserve_more(len);
+    }
+
+    /// Moves the bytes packed so far to the chain, the buffer holding them becomes the
+    /// owner of their segment.
+    void cut_segment() {
+        if (_buf->cursize() == 0) { return; }
+        _copy_left -= std::min(_copy_left, _buf->cursize());
+        _chain.append(_buf, _buf->curdata(), _buf->cursize());
+        _buf = new_buffer();
+        if (_copy_left > 0) { _buf->reserve(_copy_left); }
+    }
+
+    std::pmr::memory_resource* memory() const noexcept { 
+        return _arena ? _arena.get() : std::pmr::get_default_resource(); 
+    }
+
+    buffer::ptr new_buffer() { return make_in<buffer>(_arena, memory()); }
+
+    buffer::ptr         _buf;
+    wire_format         _format = wire_format::FIXED;
+    bool                _chained = false;
+    iobuf               _chain;     // segments cut off by a chained packer
+    size_t              _copy_left = 0; // bytes reserved for, still to be packed by a chained packer
+    request_arena::ptr  _arena;
+    bool                _failed = false;    // see failed()
 };
 
 template <typename T>
 constexpr void packer::pack_arg(T const& arg) noexcept {
     if constexpr (std::is_base_of_v<message_base, T>) {
         pack_struct(arg);
+    } else if constexpr (is_vector_v<T>) {
+        pack_vector(arg);
+    } else if constexpr (is_map_v<T>) {
+        pack_map(arg);
     } else {
+        if constexpr (is_varint_v<T>) {
+            if (_format == wire_format::COMPACT) { pack_varint(arg); return; }
+        }
         const uint8_t* data = reinterpret_cast<const uint8_t*>(&arg);
         _buf->append(data, sizeof(T));
     }
@@ -194,7 +601,29 @@ template <>
 inline void packer::pack_arg<std::string>(std::string const& arg) noexcept {
     size_t length = arg.size();
     pack_arg(length);
-    _buf->append(arg.begin(), arg.end());
+    pack_blob(reinterpret_cast<const uint8_t*>(arg.data()), arg.size());
+}
+
+template <>
+inline void packer::pack_arg<std::pmr::string>(std::pmr::string const& arg) noexcept {
+    size_t length = arg.size();
+    pack_arg(length);
+    pack_blob(reinterpret_cast<const uint8_t*>(arg.data()), arg.size());
+}
+
+template <>
+inline void packer::pack_arg<std::string_view>(std::string_view const& arg) noexcept {
+    size_t length = arg.size();
+    pack_arg(length);
+    pack_blob(reinterpret_cast<const uint8_t*>(arg.data()), arg.size());
+}
+
+/// Sent like the std::vector<uint8_t> of a bytes field.
+template <>
+inline void packer::pack_arg<std::span<const uint8_t>>(std::span<const uint8_t> const& arg) noexcept {
+    size_t length = arg.size();
+    pack_arg(length);
+    pack_blob(arg.data(), arg.size());
 }
 
 /// const char* const& might be a bit confusing (for myself at least). essentially its a const reference 
@@ -209,16 +638,55 @@ inline void packer::pack_arg<const char*>(const char* const& arg) noexcept {
 
 template <typename T>
 constexpr void packer::pipe_output(T& v) noexcept {
-    std::memcpy(&v, _buf->curdata(), sizeof(T)); 
-    _buf->increment(sizeof(T)); 
+    if constexpr (std::is_base_of_v<message_base, T>) {
+        unpack_struct(v);
+    } else if constexpr (is_vector_v<T>) {
+        unpack_vector(v);
+    } else if constexpr (is_map_v<T>) {
+        unpack_map(v);
+    } else {
+        if constexpr (is_varint_v<T>) {
+            if (_format == wire_format::COMPACT) { unpack_varint(v); return; }
+        }
+        const uint8_t* in = take(sizeof(T));
+        if (in) { std::memcpy(&v, in, sizeof(T)); } else { v = T{}; }
+    }
 }
 
 template <>
 inline void packer::pipe_output(std::string& v) noexcept {
-    int64_t strlen = 0;
+    size_t strlen = 0;
+    pipe_output(strlen);
+    const uint8_t* in = take(strlen);
+    if (in) { v.assign(reinterpret_cast<const char*>(in), strlen); } else { v.clear(); }
+}
+
+/// Arena fields, the characters go to the string's memory_resource.
+template <>
+inline void packer::pipe_output(std::pmr::string& v) noexcept {
+    size_t strlen = 0;
     pipe_output(strlen);
-    v = std::string(reinterpret_cast<const char*>(_buf->curdata()), strlen);
-    _buf->increment(strlen); 
+    const uint8_t* in = take(strlen);
+    if (in) { v.assign(reinterpret_cast<const char*>(in), strlen); } else { v.clear(); }
+}
+
+/// Points into the buffer instead of copying, valid as long as the buffer is.
+template <>
+inline void packer::pipe_output(std::string_view& v) noexcept {
+    size_t strlen = 0;
+    pipe_output(strlen);
+    const uint8_t* in = take(strlen);
+    v = in ? std::string_view(reinterpret_cast<const char*>(in), strlen) : std::string_view();
+}
+
+/// Bytes in *_view messages. Points into the buffer instead of copying, valid as long 
+/// as the buffer is.
+template <>
+inline void packer::pipe_output(std::span<const uint8_t>& v) noexcept {
+    size_t length = 0;
+    pipe_output(length);
+    const uint8_t* bytes = take(length);
+    v = bytes ? std::span<const uint8_t>(bytes, length) : std::span<const uint8_t>();
 }
 
 } // namespace srpc
@@ -4,6 +4,8 @@
 #include "token.hpp"
 #include "trace.hpp"
 #include <string>
+#include <memory>
+#include <algorithm>
 
 namespace srpc {
 
@@ -63,6 +65,22 @@ public:
             cur_token.literal = ";";
             cur_token.type = token_t::SEMICOLON;
             break;
+        case '<':
+            cur_token.literal = "<";
+            cur_token.type = token_t::LANGLE;
+            break;
+        case '>':
+            cur_token.literal = ">";
+            cur_token.type = token_t::RANGLE;
+            break;
+        case ',':
+            cur_token.literal = ",";
+            cur_token.type = token_t::COMMA;
+            break;
+        case '=':
+            cur_token.literal = "=";
+            cur_token.type = token_t::EQUALS;
+            break;
         case 0:
             cur_token.literal = "";
             cur_token.type = token_t::EOFT;
@@ -123,7 +141,7 @@ private:
 
 
     constexpr bool is_letter(char ch) const noexcept {
-        return 'a' <= ch && ch <= 'z' || 'A' <= ch && ch <= 'Z' || ch == '_';
+        return ('a' <= ch && ch <= 'z') || ('A' <= ch && ch <= 'Z') || ch == '_';
     }
 
     constexpr void handle_whitespace() noexcept {
@@ -141,6 +159,7 @@ private:
     token                       _cur_token;
     token                       _peek_token;
     std::vector<std::string>    _errors;
+    uint32_t                    _next_base = 0;     // first id of a service without "= N", after every id before it
  
 public:
     void next_token() noexcept {
@@ -161,6 +180,7 @@ public:
             if (e) { contract::add_element(std::move(e)); }
             next_token();
         }
+        check_method_ids();
     }
 
     rpc_element* parse_element() {
@@ -190,9 +210,13 @@ public:
         if (!expect_peek(token_t::LBRACE)) { return nullptr; }
         next_token();
 
-        while(_cur_token.type != token_t::RBRACE) {
+        while(_cur_token.type != token_t::RBRACE && _cur_token.type != token_t::EOFT) {
             field_descriptor* fd = parse_message_field();
-            if (fd != nullptr) { msg->add_field_descriptor(std::move(fd)); }
+            if (fd != nullptr) { 
+                msg->add_field_descriptor(std::move(fd)); 
+            } else {
+                skip_field();
+            }
         }
 
         return msg; 
@@ -206,27 +230,80 @@ public:
 
         svc->name = _cur_token.literal;
 
+        // methods are numbered from the service's "= N" base, or after the ids of the services
+        // before it, each one after the one declared before it unless given its own id
+        uint32_t next_id = _next_base;
+        if (peek_token_is(token_t::EQUALS)) {
+            next_token();
+            if (!parse_method_id(next_id)) { return nullptr; }
+        }
+
         if (!expect_peek(token_t::LBRACE)) { return nullptr; }
         next_token();
 
-        while(_cur_token.type != token_t::RBRACE) {
-            method* mtd = parse_method();
-            if (mtd != nullptr) { svc->add_method(mtd); }
+        while(_cur_token.type != token_t::RBRACE && _cur_token.type != token_t::EOFT) {
+            method* mtd = parse_method(next_id);
+            if (mtd != nullptr) { 
+                next_id = mtd->id + 1;
+                _next_base = std::max(_next_base, next_id);
+                svc->add_method(mtd); 
+            } else {
+                skip_field();
+            }
         }
         return svc; 
     }
 
-    [[nodiscard]] method* parse_method() noexcept {
+    /// Reads the id after an "=", the current token.
+    /// @return false if it is not a valid method id, the error is recorded
+    bool parse_method_id(uint32_t& id) noexcept {
+        if (!expect_peek(token_t::INT_LIT)) { return false; }
+        if (_cur_token.literal.size() > 5 || std::stoul(_cur_token.literal) > MAX_METHOD_ID) {
+            _errors.push_back("Method id " + _cur_token.literal + " is out of range, ids go up to " 
+                    + std::to_string(MAX_METHOD_ID) + ".");
+            return false;
+        }
+        id = static_cast<uint32_t>(std::stoul(_cur_token.literal));
+        return true;
+    }
+
+    /// Every method id of the contract must be unique, they share one server.
+    void check_method_ids() noexcept {
+        std::unordered_map<uint32_t, std::string> taken;
+        for (const auto& e : contract::elements) {
+            auto svc = std::dynamic_pointer_cast<service>(e);
+            if (!svc) { continue; }
+            for (const auto& m : svc->methods()) {
+                std::string name = svc->name + "." + m->name;
+                auto [it, inserted] = taken.emplace(m->id, name);
+                if (!inserted) {
+                    _errors.push_back("Method id " + std::to_string(m->id) + " of " + name + " is already used by " 
+                            + it->second + ", give one of them another id with = N.");
+                }
+            }
+        }
+    }
+
+    /// @param id wire id of the method unless it declares its own
+    [[nodiscard]] method* parse_method(uint32_t id = 0) noexcept {
         FUNCTION_TRACE;
 
-        method* mtd = new method;
-        if (!cur_token_is(token_t::METHOD)) { return nullptr; }
+        if (!cur_token_is(token_t::METHOD)) { 
+            _errors.push_back("Expected a method, got " + inv_map[static_cast<size_t>(_cur_token.type)] + " instead.");
+            return nullptr; 
+        }
+        auto mtd = std::make_unique<method>(); // freed if parsing fails halfway
+        mtd->id = id;
         if (!expect_peek(token_t::IDENTIFIER)) { return nullptr; }
 
         mtd->name = _cur_token.literal;
 
         if (!expect_peek(token_t::LPAREN)) { return nullptr; }
         if (!expect_peek(token_t::IDENTIFIER)) { return nullptr; }
+        if (_cur_token.literal == "view" && peek_token_is(token_t::IDENTIFIER)) { // not a keyword elsewhere
+            mtd->view_input = true;
+            next_token();
+        }
 
         mtd->input_t = _cur_token.literal;
 
@@ -238,65 +315,126 @@ public:
         mtd->output_t= _cur_token.literal;
 
         if (!expect_peek(token_t::RPAREN)) { return nullptr; }
+        if (peek_token_is(token_t::EQUALS)) {
+            next_token();
+            if (!parse_method_id(mtd->id)) { return nullptr; }
+        }
         if (!expect_peek(token_t::SEMICOLON)) { return nullptr; }
         next_token();
         
-        return mtd;
+        return mtd.release();
     }
 
     [[nodiscard]] field_descriptor* parse_message_field() noexcept {
         FUNCTION_TRACE;
 
-        field_descriptor* fd = new field_descriptor;
+        auto fd = std::make_unique<field_descriptor>(); // freed if parsing fails halfway
+
+        if (cur_token_is(token_t::ARENA)) {
+            fd->in_arena = true;
+            next_token();
+        }
+
+        if (cur_token_is(token_t::REPEATED)) {
+            fd->is_repeated = true;
+            next_token();
+        }
+
+        if (cur_token_is(token_t::MAP)) {
+            if (!expect_peek(token_t::LANGLE)) { return nullptr; }
+            next_token();
+
+            bool key_is_primitive = true;
+            fd->key_type = parse_field_type(key_is_primitive);
+            if (fd->key_type.empty()) { return nullptr; }
+            if (!key_is_primitive) {
+                _errors.push_back("Map keys must be a primitive type.");
+                return nullptr;
+            }
+            if (fd->key_type == "std::vector<uint8_t>") {
+                _errors.push_back("Map keys cannot be bytes.");
+                return nullptr;
+            }
+
+            if (!expect_peek(token_t::COMMA)) { return nullptr; }
+            next_token();
+        }
+
+        fd->type = parse_field_type(fd->is_primitive);
+        if (fd->type.empty()) { return nullptr; }
+        if (fd->in_arena && (fd->is_repeated || fd->is_map() || 
+                    (fd->type != "std::string" && fd->type != "std::vector<uint8_t>"))) {
+            _errors.push_back("Only string and bytes fields can be arena fields.");
+            return nullptr;
+        }
+
+        if (fd->is_map() && !expect_peek(token_t::RANGLE)) { return nullptr; }
+
+        if (!expect_peek(token_t::IDENTIFIER)) { return nullptr; }
+
+        fd->name = _cur_token.literal;
+
+        if (!expect_peek(token_t::SEMICOLON)) { return nullptr; }
+        next_token();
+    
+        return fd.release();
+    }
+
+    /// Moves past a field (or method) that failed to parse, the error is already recorded.
+    void skip_field() noexcept {
+        while (!cur_token_is(token_t::SEMICOLON) && !cur_token_is(token_t::RBRACE) && !cur_token_is(token_t::EOFT)) {
+            next_token();
+        }
+        if (cur_token_is(token_t::SEMICOLON)) { next_token(); }
+    }
 
-        fd->is_primitive = 1;
+    /// Reads the field type at the current token.
+    /// @return its C++ type, empty if the token names none
+    [[nodiscard]] std::string parse_field_type(bool& is_primitive) noexcept {
+        is_primitive = 1;
         switch (_cur_token.type) {
         case token_t::BOOL_T:
-            fd->type = "bool";
-            break;
+            return "bool";
         case token_t::INT8_T:
-            fd->type = "int8_t";
-            break;
+            return "int8_t";
         case token_t::INT16_T:
-            fd->type = "int16_t";
-            break;
+            return "int16_t";
         case token_t::INT32_T:
-            fd->type = "int32_t";
-            break;
+            return "int32_t";
         case token_t::INT64_T:
-            fd->type = "int64_t";
-            break;
+            return "int64_t";
         case token_t::STRING_T:
-            fd->type = "std::string";
-            break;
+            return "std::string";
         case token_t::CHAR_T:
-            fd->type = "char";
-            break;
+            return "char";
+        case token_t::UINT8_T:
+            return "uint8_t";
+        case token_t::UINT16_T:
+            return "uint16_t";
+        case token_t::UINT32_T:
+            return "uint32_t";
+        case token_t::UINT64_T:
+            return "uint64_t";
+        case token_t::FLOAT_T:
+            return "float";
+        case token_t::DOUBLE_T:
+            return "double";
+        case token_t::BYTES_T:
+            return "std::vector<uint8_t>";
         case token_t::IDENTIFIER:
             {
-                fd->is_primitive = 0;
+                is_primitive = 0;
                 auto it = contract::element_index_map.find(_cur_token.literal);
                 if (it != contract::element_index_map.end()) {
-                    fd->type = _cur_token.literal;
-                } else {
-                    _errors.push_back("Undefined identifier in field type.");
-                    return nullptr;
+                    return _cur_token.literal;
                 }
-                break;
+                _errors.push_back("Undefined identifier in field type.");
+                return "";
             }
         default:
             _errors.push_back("Expected cur_token to be a field_type.");
-            return nullptr;
+            return "";
         }
-
-        if (!expect_peek(token_t::IDENTIFIER)) { return nullptr; }
-
-        fd->name = _cur_token.literal;
-
-        if (!expect_peek(token_t::SEMICOLON)) { return nullptr; }
-        next_token();
-    
-        return fd;
     }
     
     bool expect_peek(token_t token_type) noexcept {
@@ -0,0 +1,186 @@
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+#include <utility>
+
+namespace srpc {
+
+#define POOL_MIN_CLASS_SHIFT    6       // smallest slab is 64 bytes
+#define POOL_MAX_CLASS_SHIFT    20      // largest pooled slab is 1 MiB, bigger ones bypass the pool
+#define POOL_MAX_FREE           64      // free slabs kept per size class
+
+class buffer_pool;
+
+/// A block of memory borrowed from a buffer_pool, handed back to it when destroyed.
+/// size() is what was asked for, capacity() the size class actually reserved.
+class slab {
+public:
+    slab() = default;
+    slab(uint8_t* data, size_t size, size_t capacity, buffer_pool* owner) noexcept
+        : _data(data), _size(size), _capacity(capacity), _owner(owner) {}
+
+    ~slab() { release(); }
+
+    slab(const slab&) = delete;
+    slab& operator=(const slab&) = delete;
+
+    slab(slab&& other) noexcept
+        : _data(std::exchange(other._data, nullptr)), _size(std::exchange(other._size, 0)),
+          _capacity(std::exchange(other._capacity, 0)), _owner(std::exchange(other._owner, nullptr)) {}
+
+    slab& operator=(slab&& other) noexcept {
+        if (this != &other) {
+            release();
+            _data = std::exchange(other._data, nullptr);
+            _size = std::exchange(other._size, 0);
+            _capacity = std::exchange(other._capacity, 0);
+            _owner = std::exchange(other._owner, nullptr);
+        }
+        return *this;
+    }
+
+    uint8_t* data() noexcept { return _data; }
+    const uint8_t* data() const noexcept { return _data; }
+    size_t size() const noexcept { return _size; }
+    size_t capacity() const noexcept { return _capacity; }
+    explicit operator bool() const noexcept { return _data != nullptr; }
+
+    /// Returns the memory to its pool now rather than on destruction.
+    void release() noexcept;
+
+private:
+    uint8_t*        _data = nullptr;
+    size_t          _size = 0;
+    size_t          _capacity = 0;
+    buffer_pool*    _owner = nullptr;
+};
+
+/// Size-classed pool of receive buffers. Requests are rounded up to the next power of
+/// two and served from that class's free list; slabs coming back are kept for reuse
+/// (up to POOL_MAX_FREE per class) instead of being freed, so a server in steady state
+/// stops calling malloc for incoming frames. Thread-safe, slabs may be released on a
+/// different thread than the one that acquired them.
+class buffer_pool {
+public:
+    buffer_pool() = default;
+
+    ~buffer_pool() {
+        for (auto& c : _classes) {
+            for (uint8_t* p : c.free) { std::free(p); }
+        }
+    }
+
+    buffer_pool(const buffer_pool&) = delete;
+    buffer_pool& operator=(const buffer_pool&) = delete;
+
+    /// Pool shared by the transport and the reactors.
+    static buffer_pool& global() {
+        static buffer_pool pool;
+        return pool;
+    }
+
+    /// @param size number of bytes needed
+    /// @return slab of at least size bytes, empty if the allocation failed
+    [[nodiscard]] slab acquire(size_t size) {
+        size_t capacity;
+        uint8_t* p = take(size, capacity);
+        return p ? slab(p, size, capacity, this) : slab();
+    }
+
+    /// Raw memory for allocators, served like acquire().
+    /// @return at least size bytes, nullptr if the allocation failed
+    [[nodiscard]] void* allocate(size_t size) {
+        size_t capacity;
+        return take(size, capacity);
+    }
+
+    /// Hands back memory from allocate(), size must be the one it was asked for.
+    void deallocate(void* p, size_t size) noexcept {
+        size_t cls = size_class(size);
+        give_back(static_cast<uint8_t*>(p), cls < N_CLASSES ? size_t{1} << (cls + POOL_MIN_CLASS_SHIFT) : size);
+    }
+
+    /// Number of free slabs held for requests of the given size.
+    size_t free_count(size_t size) {
+        size_t cls = size_class(size);
+        if (cls >= N_CLASSES) { return 0; }
+        std::lock_guard<std::mutex> lock(_classes[cls].mutex);
+        return _classes[cls].free.size();
+    }
+
+    /// Number of acquire() calls served from a free list.
+    uint64_t hit_count() const noexcept { return _hits.load(std::memory_order_relaxed); }
+
+    /// Number of acquire() calls that had to allocate.
+    uint64_t miss_count() const noexcept { return _misses.load(std::memory_order_relaxed); }
+
+private:
+    friend class slab;
+
+    static constexpr size_t N_CLASSES = POOL_MAX_CLASS_SHIFT - POOL_MIN_CLASS_SHIFT + 1;
+
+    struct size_class_list {
+        std::mutex              mutex;
+        std::vector<uint8_t*>   free;
+    };
+
+    /// @param capacity set to the number of bytes actually reserved
+    uint8_t* take(size_t size, size_t& capacity) {
+        size_t cls = size_class(size);
+        if (cls >= N_CLASSES) { // too large to be worth keeping around
+            _misses.fetch_add(1, std::memory_order_relaxed);
+            capacity = size;
+            return static_cast<uint8_t*>(std::malloc(size));
+        }
+
+        capacity = size_t{1} << (cls + POOL_MIN_CLASS_SHIFT);
+        {
+            std::lock_guard<std::mutex> lock(_classes[cls].mutex);
+            if (!_classes[cls].free.empty()) {
+                uint8_t* p = _classes[cls].free.back();
+                _classes[cls].free.pop_back();
+                _hits.fetch_add(1, std::memory_order_relaxed);
+                return p;
+            }
+        }
+
+        _misses.fetch_add(1, std::memory_order_relaxed);
+        return static_cast<uint8_t*>(std::malloc(capacity));
+    }
+
+    static size_t size_class(size_t size) noexcept {
+        size_t cls = 0;
+        while (cls < N_CLASSES && (size_t{1} << (cls + POOL_MIN_CLASS_SHIFT)) < size) { cls++; }
+        return cls;
+    }
+
+    void give_back(uint8_t* p, size_t capacity) noexcept {
+        size_t cls = size_class(capacity);
+        if (cls < N_CLASSES && (size_t{1} << (cls + POOL_MIN_CLASS_SHIFT)) == capacity) {
+            std::lock_guard<std::mutex> lock(_classes[cls].mutex);
+            if (_classes[cls].free.size() < POOL_MAX_FREE) {
+                _classes[cls].free.push_back(p);
+                return;
+            }
+        }
+        std::free(p);
+    }
+
+    size_class_list         _classes[N_CLASSES];
+    std::atomic<uint64_t>   _hits = 0;
+    std::atomic<uint64_t>   _misses = 0;
+};
+
+inline void slab::release() noexcept {
+    if (_data) { _owner->give_back(_data, _capacity); }
+    _data = nullptr;
+    _size = 0;
+    _capacity = 0;
+    _owner = nullptr;
+}
+
+} // namespace srpc
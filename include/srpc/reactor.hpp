@@ -0,0 +1,374 @@
+#pragma once
+
+#include "pool.hpp"
+#include "packer.hpp"
+#include "executor.hpp"
+#include "coro.hpp"
+#include "transport.hpp"
+#include <list>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <utility>
+#include <functional>
+#include <unordered_map>
+#include <sys/uio.h>
+#include <sys/eventfd.h>
+
+namespace srpc {
+
+#define REACTOR_MAX_IOV 128   // iovecs handed to one sendmsg, the header and each payload segment take one
+
+/// A response waiting to be written: the frame header and the chain holding the
+/// payload, so that both go out in the same vectored write without being copied.
+struct out_frame {
+    uint8_t         header[FRAME_HEADER_SZ];
+    iobuf           payload;
+};
+
+/// Per-connection state owned by a reactor. Frames are reassembled by reader, 
+/// responses are queued in wframes until the socket accepts them. format is settled by the client's handshake, if any.
+/// A peer that shuts down its side (read_closed) still gets the answers to what it
+/// sent: the connection is closed once pending is back to 0 and wframes written.
+struct connection {
+    using ptr = std::unique_ptr<connection>;
+
+    explicit connection(int32_t fd) : fd(fd), woffset(0) {}
+    virtual ~connection() { close(fd); }
+
+    int32_t                             fd;
+    transport::frame_reader             reader;
+
+    /// woffset counts the bytes of wframes.front() (header included) already written.
+    /// List nodes stay put, so iovecs into queued frames remain valid while new responses
+    /// are appended. Written frames are moved to spare_frames and reused, a connection in 
+    /// steady state queues its responses without allocating.
+    std::list<out_frame>                wframes;
+    std::list<out_frame>                spare_frames;
+    size_t                              woffset;
+    wire_format                         format = wire_format::FIXED;
+    bool                                read_closed = false;
+    size_t                              pending = 0;    // requests dispatched, not answered yet
+};
+
+class reactor;
+
+/// Hands the response to one request back to the reactor that read it. Thread-safe,
+/// must be called exactly once, possibly long after the handler returned (e.g. by a
+/// coroutine that suspended).
+class responder {
+public:
+    responder(reactor* r, uint64_t conn_id, uint64_t request_id) noexcept
+        : _reactor(r), _conn_id(conn_id), _request_id(request_id) {}
+
+    /// @param response packer holding the response payload
+    void operator()(packer::ptr response) const;
+
+private:
+    reactor*    _reactor;
+    uint64_t    _conn_id;
+    uint64_t    _request_id;
+};
+
+/// Backend independent part of a server event loop: framing and dispatch to the
+/// handler, inline or on an executor. The I/O backends (epoll,
+/// io_uring) derive from it and decide how bytes get in and out of the sockets.
+///
+/// Without an executor the handler runs inline on the loop thread. With one, each
+/// frame is handed to the executor and the loop thread only does I/O; finished
+/// responses are posted back to the loop and written from there as soon as they are
+/// done, tagged with the request id of the frame they answer. A slow call does not
+/// hold back the responses to calls that arrived after it on the same connection.
+///
+/// The reactor is also the scheduler of the requests it dispatched: coroutine
+/// handlers that suspend are resumed on the loop thread.
+class reactor : public scheduler {
+public:
+    using ptr = std::unique_ptr<reactor>;
+
+    /// @param request  packer holding the payload of one request frame
+    /// @param done     to be called with the response, now or later. A handler that throws
+    ///                 must not have called it: the reactor answers for it then
+    using frame_handler = std::function<void(packer::ptr request, responder done)>;
+
+    reactor(frame_handler handler, work_stealing_executor::ptr executor)
+        : _running(true), _handler(std::move(handler)), _executor(std::move(executor)) {
+        _wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    }
+
+    virtual ~reactor() {
+        wait_in_flight();
+        close(_wake_fd);
+    }
+
+    reactor(const reactor&) = delete;
+    reactor& operator=(const reactor&) = delete;
+
+    /// Takes ownership of an already listening socket.
+    /// @return 0 on success, -1 on failure
+    virtual int32_t adopt_listener(int32_t listening_fd) noexcept = 0;
+
+    /// Runs the loop on the calling thread until stop() is called.
+    void run() {
+        _loop_owner = this;
+        scheduler::scope s(this);
+        loop();
+        _loop_owner = nullptr;
+    }
+
+    /// Thread-safe, runs fn on the loop thread.
+    void post(std::function<void()> fn) override {
+        {
+            std::lock_guard<std::mutex> lock(_completions_mutex);
+            _posted.push_back(std::move(fn));
+        }
+        wake();
+    }
+
+    /// Thread-safe, wakes the loop up and makes run() return.
+    void stop() noexcept {
+        _running.store(false, std::memory_order_release);
+        wake();
+    }
+
+    size_t connection_count() const noexcept { return _connections.size(); }
+
+protected:
+    friend class responder;
+
+    /// The backend's event loop, returns once running() turns false.
+    virtual void loop() = 0;
+
+    /// Writes whatever the backend can of conn.wframes.
+    /// @return false on a write error, the connection is then dropped
+    virtual bool flush(uint64_t id, connection& conn) noexcept = 0;
+
+    /// Closes the connection and forgets about it.
+    virtual void drop(uint64_t id) noexcept = 0;
+
+    bool running() const noexcept { return _running.load(std::memory_order_acquire); }
+
+    void wake() noexcept {
+        uint64_t one = 1;
+        [[maybe_unused]] ssize_t w = write(_wake_fd, &one, sizeof(one));
+    }
+
+    /// Requests still being handled (on the executor, or suspended coroutines) post back
+    /// into this reactor, backends call this before tearing down anything they touch.
+    /// Functions posted meanwhile still run, so coroutines can finish.
+    void wait_in_flight() noexcept {
+        while (_in_flight.load(std::memory_order_acquire) > 0) {
+            run_posted();
+            std::this_thread::yield();
+        }
+    }
+
+    /// Fills iov with the unwritten part of the queued frames, header and payload
+    /// segments of each frame back to back, so one sendmsg can carry several responses.
+    /// @return number of iovecs filled, at most max
+    static size_t gather(const connection& conn, struct iovec* iov, size_t max) noexcept {
+        size_t n = 0, skip = conn.woffset;
+        for (auto it = conn.wframes.begin(); it != conn.wframes.end() && n < max; ++it, skip = 0) {
+            if (skip < FRAME_HEADER_SZ) {
+                iov[n++] = { const_cast<uint8_t*>(it->header + skip), FRAME_HEADER_SZ - skip };
+                skip = 0;
+            } else {
+                skip -= FRAME_HEADER_SZ;
+            }
+            n += it->payload.to_iov(skip, iov + n, max - n);
+        }
+        return n;
+    }
+
+    /// Drops the first n written bytes from the queued frames, a partially written
+    /// frame stays at the front with woffset marking where to resume.
+    static void consume(connection& conn, size_t n) noexcept {
+        n += conn.woffset;
+        while (!conn.wframes.empty()) {
+            size_t frame_size = FRAME_HEADER_SZ + conn.wframes.front().payload.size();
+            if (n < frame_size) { break; }
+            n -= frame_size;
+            conn.wframes.front().payload.clear(); // lets go of the response and its arena
+            conn.spare_frames.splice(conn.spare_frames.end(), conn.wframes, conn.wframes.begin());
+        }
+        conn.woffset = conn.wframes.empty() ? 0 : n;
+    }
+
+    /// Writes what the backend can of the queued responses. Drops the connection if that
+    /// failed, or if the peer shut down its side and has nothing left to be answered.
+    void flush_or_drop(uint64_t id, connection& conn) {
+        if (!flush(id, conn) || (conn.read_closed && conn.pending == 0 && conn.wframes.empty())) { drop(id); }
+    }
+
+    /// Dispatches every frame completed by the n bytes just read from conn. Payloads are
+    /// copied once, from data into the slab they are handed to the handler in.
+    /// The backend flushes responses produced meanwhile once this returns.
+    /// @return false if the peer sent a frame larger than FRAME_MAX_SZ (or one that could 
+    ///         not be allocated), the connection is then to be dropped
+    bool parse_frames(uint64_t id, connection& conn, const uint8_t* data, size_t n) {
+        bool parsing = std::exchange(_parsing, true);
+        bool ok = conn.reader.feed(data, n, [this, id, &conn] (uint64_t request_id, message_t&& payload) {
+            on_frame(id, conn, request_id, std::move(payload));
+        });
+        _parsing = parsing;
+        return ok;
+    }
+
+    /// Like parse_frames(), for n bytes the backend received straight into conn.reader.space().
+    void payload_received(uint64_t id, connection& conn, size_t n) {
+        bool parsing = std::exchange(_parsing, true);
+        conn.reader.received(n, [this, id, &conn] (uint64_t request_id, message_t&& payload) {
+            on_frame(id, conn, request_id, std::move(payload));
+        });
+        _parsing = parsing;
+    }
+
+    /// Moves responses finished on other threads onto their connections and runs
+    /// posted functions. Called on the loop thread after a wake up.
+    void drain_completions() {
+        {
+            std::lock_guard<std::mutex> lock(_completions_mutex);
+            _draining.swap(_completions); // both keep their capacity from one wake up to the next
+        }
+
+        for (auto& c : _draining) {
+            auto it = _connections.find(c.conn_id);
+            if (it == _connections.end()) { continue; } // peer went away meanwhile
+
+            complete(*it->second, c.request_id, std::move(c.response));
+            flush_or_drop(c.conn_id, *it->second);
+        }
+        _draining.clear();
+        run_posted();
+    }
+
+    std::atomic<bool>                               _running;
+    int32_t                                         _wake_fd = -1;
+    uint64_t                                        _next_conn_id = FIRST_CONN_ID;
+    std::unordered_map<uint64_t, connection::ptr>   _connections;
+
+    /// ids below this one tag the backend's own descriptors (wake fd, listener)
+    static constexpr uint64_t FIRST_CONN_ID = 16;
+
+private:
+    /// A response finished on the executor, waiting to be written by the loop thread.
+    struct completion {
+        uint64_t    conn_id;
+        uint64_t    request_id;
+        packer::ptr response;
+    };
+
+    /// Counted in flight from here until its responder is called.
+    void dispatch(uint64_t id, uint64_t request_id, packer::ptr request) {
+        _in_flight.fetch_add(1, std::memory_order_relaxed);
+        if (!_executor) {
+            run_handler(id, request_id, std::move(request));
+            return;
+        }
+
+        _executor->submit([this, id, request_id, request = std::move(request)] () mutable {
+            scheduler::scope s(this); // coroutines started here resume on the loop
+            run_handler(id, request_id, std::move(request));
+        });
+    }
+
+    /// Every dispatched request gets its response, or _in_flight would never drop back
+    /// and the backend's destructor would wait for it forever.
+    void run_handler(uint64_t id, uint64_t request_id, packer::ptr request) noexcept {
+        responder done(this, id, request_id);
+        try {
+            _handler(std::move(request), done);
+        } catch (...) {
+            fprintf(stderr, "srpc::reactor::dispatch(): handler threw.\n");
+            packer::ptr rp = std::make_shared<packer>();
+            (*rp) << static_cast<uint8_t>(RPC_ERR_HANDLER_FAILED);
+            done(std::move(rp));
+        }
+    }
+
+    /// Called through a responder from any thread.
+    void respond(uint64_t conn_id, uint64_t request_id, packer::ptr response) {
+        if (_loop_owner == this) {
+            // on the loop thread: queue directly, and write unless parse_frames is
+            // still going (the backend flushes after it)
+            auto it = _connections.find(conn_id);
+            if (it != _connections.end()) {
+                complete(*it->second, request_id, std::move(response));
+                if (!_parsing) { flush_or_drop(conn_id, *it->second); }
+            }
+        } else {
+            {
+                std::lock_guard<std::mutex> lock(_completions_mutex);
+                _completions.push_back({conn_id, request_id, std::move(response)});
+            }
+            wake();
+        }
+        _in_flight.fetch_sub(1, std::memory_order_release);
+    }
+
+    void run_posted() {
+        std::vector<std::function<void()>> posted;
+        {
+            std::lock_guard<std::mutex> lock(_completions_mutex);
+            posted.swap(_posted);
+        }
+        for (auto& fn : posted) { fn(); }
+    }
+
+    void on_frame(uint64_t id, connection& conn, uint64_t request_id, message_t payload) {
+        if (request_id == HANDSHAKE_REQUEST_ID) {
+            handshake(conn, payload.data(), static_cast<uint32_t>(payload.size()));
+            return;
+        }
+        request_arena::ptr arena = request_arena::create(); // freed once the response is written
+        conn.pending++;
+        dispatch(id, request_id, make_in<packer>(arena, std::move(payload), conn.format, arena));
+    }
+
+    /// Settles the connection's wire format and queues the answer.
+    void handshake(connection& conn, const uint8_t* payload, uint32_t size) {
+        uint8_t asked = size > 0 ? payload[0] : static_cast<uint8_t>(wire_format::FIXED);
+        conn.format = asked <= static_cast<uint8_t>(wire_format::COMPACT) 
+            ? static_cast<wire_format>(asked) : wire_format::FIXED;
+
+        packer::ptr answer = std::make_shared<packer>();
+        (*answer) << static_cast<uint8_t>(conn.format);
+        complete(conn, HANDSHAKE_REQUEST_ID, std::move(answer));
+    }
+
+    /// Called on the loop thread once a response is ready, queues it for writing.
+    void complete(connection& conn, uint64_t request_id, packer::ptr response) {
+        if (request_id != HANDSHAKE_REQUEST_ID) { conn.pending--; }
+        if (conn.spare_frames.empty()) {
+            conn.wframes.emplace_back();
+        } else {
+            conn.wframes.splice(conn.wframes.end(), conn.spare_frames, conn.spare_frames.begin());
+        }
+        out_frame& f = conn.wframes.back();
+        f.payload = response->release_chain();
+        transport::encode_header(f.header, static_cast<uint32_t>(f.payload.size()), request_id);
+    }
+
+    frame_handler                   _handler;
+    work_stealing_executor::ptr     _executor;
+
+    std::mutex                          _completions_mutex;
+    std::vector<completion>             _completions;
+    std::vector<completion>             _draining;      // loop thread only, see drain_completions()
+    std::vector<std::function<void()>>  _posted;
+    std::atomic<size_t>                 _in_flight = 0;
+    bool                                _parsing = false;
+
+    /// The reactor whose loop the calling thread is running, if any.
+    static inline thread_local reactor* _loop_owner = nullptr;
+};
+
+inline void responder::operator()(packer::ptr response) const {
+    _reactor->respond(_conn_id, _request_id, std::move(response));
+}
+
+} // namespace srpc
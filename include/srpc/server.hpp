@@ -3,43 +3,78 @@
 #include "core.hpp"
 #include "transport.hpp"
 #include "packer.hpp"
+#include "event_loop.hpp"
+#include "uring_loop.hpp"
+#include "coro.hpp"
+#include <array>
+#include <new>
+#include <mutex>
+#include <future>
+#include <thread>
+#include <string>
+#include <vector>
+#include <utility>
+#include <stdexcept>
+#include <pthread.h>
 #include <functional>
 #include <type_traits>
-#include <unordered_map>
 
 namespace srpc {
 
+#define SERVER_MAX_METHODS      65536   // method ids must stay below this, the dispatch table is indexed by them
+
 class server {
 public:
     server() = default;
     ~server() = default;
 
-    packer::ptr call(std::string const& funcname, packer::ptr p) {
-        packer::ptr rp = std::make_shared<packer>(); // packer to populate with return value
+    /// Receives the packer holding the response payload.
+    using respond_fn = std::function<void(packer::ptr response)>;
 
-        auto it = _function_registry.find(funcname);
-        if (it == _function_registry.end()) {
-            fprintf(stderr, "srpc::server::call(): function %s not registered.\n", funcname.c_str());
-            (*rp) << static_cast<uint8_t>(RPC_ERR_FUNCTION_NOT_REGISTERED);
+    /// Calls a registered method. done runs before this returns for plain methods, and 
+    /// whenever the coroutine finishes for methods returning task<R>.
+    void call(uint32_t method_id, packer::ptr p, respond_fn done) {
+        if (p->failed()) { // too short to hold a method id
+            fprintf(stderr, "srpc::server::call(): malformed request frame.\n");
+            done(status_response(*p, RPC_ERR_MALFORMED_MESSAGE));
+            return;
+        }
+        if (method_id >= _methods.size() || !_methods[method_id].invoke) {
+            fprintf(stderr, "srpc::server::call(): method %u not registered.\n", method_id);
+            done(status_response(*p, RPC_ERR_FUNCTION_NOT_REGISTERED));
+            return;
         }
 
-        auto func = it->second;
-        func(rp.get(), p.get());
-            
+        const method_slot& m = _methods[method_id];
+        m.invoke(m.instance, std::move(p), std::move(done));
+    }
+
+    /// Blocking call(), waits for coroutine methods to finish. The response is returned
+    /// in one piece, ready to be read from.
+    packer::ptr call(uint32_t method_id, packer::ptr p) {
+        std::promise<packer::ptr> response;
+        std::future<packer::ptr> f = response.get_future();
+        call(method_id, std::move(p), [&response] (packer::ptr rp) { response.set_value(std::move(rp)); });
+
+        packer::ptr rp = f.get();
+        if (rp->chained()) {
+            wire_format format = rp->format();
+            rp = std::make_shared<packer>(rp->release_chain().flatten());
+            rp->set_format(format);
+        }
         return rp;
     }
     
     /// @tparam S                   (derived from servicer_base) servicer class
-    /// @param  service_instance    instance of S
+    /// @param  service_instance    instance of S, must outlive the server
+    /// @throws std::logic_error if a method id of S is already taken, by S itself or by a 
+    ///         service registered before it. None of S's methods are registered then.
     template <SrpcService S>
     void register_service(S& service_instance) {
-        static_assert(std::tuple_size_v<decltype(S::methods)> > 0, "S::methods is empty!");
-        std::apply(
-            [this, &service_instance] (const auto&... method) {
-                (register_method(std::get<MEMBER_NAME>(method), std::get<MEMBER_ADDR>(method), service_instance), ...);
-            },
-            S::methods
-        );
+        constexpr size_t n_methods = std::tuple_size_v<decltype(S::methods)>;
+        static_assert(n_methods > 0, "S::methods is empty!");
+        check_method_ids<S>(std::make_index_sequence<n_methods>{});
+        register_methods<S>(service_instance, std::make_index_sequence<n_methods>{});
     }
     
     void start(std::string const&& port) {
@@ -55,66 +90,282 @@ public:
                 continue;
             }
 
-            message_t msg = transport::recv_data(accepted_fd);  
-
-            // deserialize the method name and service name        
-            packer::ptr p = std::make_shared<packer>(msg.data(), msg.size());
-            std::string funcname;
-            (*p) >> funcname;
-
-            // call the service's method
-            packer::ptr r = call(funcname, p);
-            assert(r->offset() == 0);
+            uint64_t request_id = 0;
+            message_t msg = transport::recv_frame(accepted_fd, request_id);  
+            if (request_id == HANDSHAKE_REQUEST_ID) { // only FIXED is spoken here
+                uint8_t format = static_cast<uint8_t>(wire_format::FIXED);
+                transport::send_data(accepted_fd, &format, sizeof(format), HANDSHAKE_REQUEST_ID);
+                msg = transport::recv_frame(accepted_fd, request_id);
+            }
+            if (!msg) {
+                close(accepted_fd);
+                continue;
+            }
+            packer::ptr r = handle_frame(std::make_shared<packer>(std::move(msg)));
 
-            transport::send_data(accepted_fd, r->data(), r->size());
+            transport::send_data(accepted_fd, r->data(), r->size(), request_id);
 
             close(accepted_fd);
         }
         close(listening_fd);
     }
 
+    /// Serves on event loops instead of one request per accept. Connections are kept 
+    /// open and may carry any number of request frames. Blocks the calling thread until
+    /// stop() is called. The loops use io_uring if transport::set_backend() selected it 
+    /// and the kernel supports it, edge-triggered epoll otherwise.
+    /// @param port         port to listen on
+    /// @param n_reactors   number of reactor threads. Each one owns a listening socket bound 
+    ///                     with SO_REUSEPORT so the kernel spreads connections across them 
+    ///                     without a shared accept lock. The calling thread runs the first one.
+    void start_reactor(std::string const& port, size_t n_reactors = 1) {
+        std::unique_lock<std::mutex> lock(_loop_mutex);
+        if (_stopped || n_reactors == 0) { return; }
+
+        for (size_t i = 0; i < n_reactors; i++) {
+            reactor::ptr loop = make_reactor();
+            if (loop->adopt_listener(transport::create_server_socket(port, n_reactors > 1)) < 0) {
+                fprintf(stderr, "srpc::server::start_reactor(): could not listen on port %s.\n", port.c_str());
+                _loops.clear();
+                return;
+            }
+            _loops.push_back(std::move(loop));
+        }
+        lock.unlock();
+
+        std::vector<std::thread> reactor_threads;
+        for (size_t i = 1; i < n_reactors; i++) {
+            reactor_threads.emplace_back([this, i] () { 
+                pin_to_core(i);
+                _loops[i]->run(); 
+            });
+        }
+        _loops[0]->run();
+
+        for (auto& t : reactor_threads) { t.join(); }
+        lock.lock();
+        _loops.clear();
+    }
+
+    /// Runs handlers on ex instead of inline on the reactor threads, so that slow methods 
+    /// do not hold up I/O for other connections. Must be called before start_reactor().
+    void set_executor(work_stealing_executor::ptr ex) { _executor = std::move(ex); }
+
+    work_stealing_executor::ptr executor() const noexcept { return _executor; }
+
+    /// Thread-safe, makes start_reactor() return.
+    void stop() {
+        std::lock_guard<std::mutex> lock(_loop_mutex);
+        _stopped = true;
+        for (auto& loop : _loops) { loop->stop(); }
+    }
+
     void __testable_start(std::string const&&);
 
 private:
 
-    /// @brief
-    /// @tparam F
-    /// @tparam S
-    template <typename F, SrpcService S> 
-    void register_method(std::string const& name, F func, S& instance) {
+    /// Keeps reactor thread i on core i (mod the core count) so each core serves its own 
+    /// connections. The calling thread, which runs reactor 0, is left unpinned.
+    static void pin_to_core(size_t i) noexcept {
+        size_t n_cores = std::thread::hardware_concurrency();
+        if (n_cores == 0) { return; }
+
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(i % n_cores, &cpus);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    }
+
+    /// Response made of a status code alone, for requests no handler ran for.
+    /// @param p the request packer, the response goes in its arena
+    static packer::ptr status_response(packer const& p, rpc_status_code code) {
+        packer::ptr rp = make_in<packer>(p.arena(), wire_format::FIXED, p.arena());
+        (*rp) << static_cast<uint8_t>(code);
+        return rp;
+    }
+
+    reactor::ptr make_reactor() {
+        reactor::frame_handler handler = [this] (packer::ptr request, responder done) { 
+            if (!request->arena()) {
+                handle_frame(std::move(request), done);
+                return;
+            }
+            // too big for respond_fn's inline storage: kept in the request's arena instead, 
+            // which lives until the response is written
+            responder* r = new (request->arena()->allocate(sizeof(responder), alignof(responder))) responder(done);
+            handle_frame(std::move(request), [r] (packer::ptr response) { (*r)(std::move(response)); }); 
+        };
+        if (transport::get_backend() == transport::backend::IO_URING) {
+            auto loop = std::make_unique<uring_loop>(handler, _executor);
+            if (loop->ok()) { return loop; }
+            fprintf(stderr, "srpc::server::make_reactor(): io_uring unavailable, falling back to epoll.\n");
+        }
+        return std::make_unique<event_loop>(handler, _executor);
+    }
+
+    /// Decodes the method id from one request frame and calls it.
+    /// @return packer holding the response payload
+    packer::ptr handle_frame(packer::ptr p) {
+        uint32_t method_id = 0;
+        (*p) >> method_id;
+
+        packer::ptr r = call(method_id, p);
+        assert(r->offset() == 0);
+        return r;
+    }
+
+    /// Decodes the method id from one request frame and calls it.
+    /// @param done receives the packer holding the response payload
+    void handle_frame(packer::ptr p, respond_fn done) {
+        uint32_t method_id = 0;
+        (*p) >> method_id;
+        call(method_id, std::move(p), std::move(done));
+    }
+
+    /// Entry of the dispatch table: the method's call_proxy and the servicer it runs on.
+    struct method_slot {
+        void (*invoke)(void* instance, packer::ptr cp, respond_fn done) = nullptr;
+        void* instance = nullptr;
+    };
+
+    template <SrpcService S, size_t... I>
+    void register_methods(S& instance, std::index_sequence<I...>) {
+        (register_method<S, I>(instance), ...);
+    }
+
+    /// Id of the I-th entry of S::methods.
+    template <SrpcService S, size_t I>
+    static constexpr uint32_t method_id() noexcept {
+        using entry = std::decay_t<decltype(std::get<I>(S::methods))>;
+        static_assert(std::tuple_size_v<entry> > MEMBER_ID, "servicer methods need an id, declare them with SERVICE_METHOD");
+        if constexpr (std::tuple_size_v<entry> > MEMBER_ID) {
+            constexpr uint32_t id = std::get<MEMBER_ID>(std::get<I>(S::methods));
+            static_assert(id < SERVER_MAX_METHODS, "method id out of range");
+            return id;
+        }
+        return 0;
+    }
+
+    /// Throws unless every method id of S is free. Two services (or contracts) numbering 
+    /// their methods alike would otherwise leave some of them unreachable.
+    template <SrpcService S, size_t... I>
+    void check_method_ids(std::index_sequence<I...>) const {
+        constexpr std::array<uint32_t, sizeof...(I)> ids { method_id<S, I>()... };
+        const std::array<const char*, sizeof...(I)> names { std::get<MEMBER_NAME>(std::get<I>(S::methods))... };
+        for (size_t i = 0; i < ids.size(); i++) {
+            bool taken = ids[i] < _methods.size() && _methods[ids[i]].invoke;
+            for (size_t j = 0; j < i; j++) { taken = taken || ids[j] == ids[i]; }
+            if (taken) {
+                throw std::logic_error("srpc::server::register_service(): method id " + std::to_string(ids[i]) 
+                        + " of " + names[i] + " is already taken.");
+            }
+        }
+    }
+
+    /// Puts the I-th entry of S::methods in the dispatch table, at its method id.
+    /// @tparam S servicer class
+    /// @tparam I index into S::methods
+    template <SrpcService S, size_t I> 
+    void register_method(S& instance) {
+        constexpr auto& method = std::get<I>(S::methods);
+        constexpr auto func = std::get<MEMBER_ADDR>(method);
+        constexpr uint32_t id = method_id<S, I>();
+        using F = std::remove_const_t<decltype(func)>;
         using input_type = typename function_traits<F>::input_type;
-        using return_type = typename function_traits<F>::return_type;
+        using return_type = task_result_t<typename function_traits<F>::return_type>;
         static_assert(std::is_base_of_v<message_base, std::decay_t<input_type>>);
         static_assert(std::is_base_of_v<message_base, std::decay_t<return_type>>);
- 
-        _function_registry[name] = std::bind(
-                &server::call_proxy<F, S>, this, func, instance, std::placeholders::_1, std::placeholders::_2);
+
+        if (_methods.size() <= id) { _methods.resize(id + 1); } // free, see check_method_ids()
+        _methods[id] = method_slot{ &server::call_proxy<func, S>, &instance };
     }
   
+    /// Instantiated once per method, so the member function pointer is a constant the
+    /// compiler sees through rather than state carried in a std::function.
+    /// @tparam func        member function pointer
     /// @tparam S           servicer class
-    /// @tparam F           member function of S
-    /// @param  func        member function pointer of type F
     /// @param  instance    instance of S
-    /// @param  rp          packer to be populated with return value (return packer)
     /// @param  cp          packer containing data to be read from (client packer)
-    template <typename F, SrpcService S>
-    void call_proxy(F func, S& instance, packer* rp, packer* cp) { call_proxy_impl(func, instance, rp, cp); }
+    /// @param  done        receives the packer populated with the return value
+    template <auto func, SrpcService S>
+    static void call_proxy(void* instance, packer::ptr cp, respond_fn done) { 
+        call_proxy_impl(func, *static_cast<S*>(instance), std::move(cp), std::move(done)); 
+    }
     
     
     /// @tparam R function return type 
-    /// @tparam I function input type
+    /// @tparam I function input type, the message or its *_view to decode without copying
     template <SrpcMessage R, typename C, SrpcMessage I, SrpcService S>
-    void call_proxy_impl(R (C::*func)(I&), S& instance, packer* rp, packer* cp) {
-        I* arg = cp->getv<I>();
-        R result = (instance.*func)(*arg); // function call not a cast
+    static void call_proxy_impl(R (C::*func)(I&), S& instance, packer::ptr cp, respond_fn done) {
+        I arg = make_arg<I>(*cp);
+        (*cp) >> arg;
+        if (cp->failed()) {
+            fprintf(stderr, "srpc::server::call_proxy(): malformed request to %s.\n", I::name);
+            done(status_response(*cp, RPC_ERR_MALFORMED_MESSAGE));
+            return;
+        }
+        // a throwing handler fails its own call, not the reactor running it
+        packer::ptr rp;
+        try {
+            // function call not a cast. The result is packed where it is, large blobs are 
+            // referenced from it and the chain keeps it alive
+            auto result = make_in<R>(cp->arena(), (instance.*func)(arg));
+            rp = make_in<packer>(cp->arena(), cp->format(), cp->arena());
+            rp->set_chained(true);
+            rp->pack_response(RPC_SUCCESS, *result);
+            rp->hold(std::move(result));
+        } catch (std::exception const& e) {
+            fprintf(stderr, "srpc::server::call_proxy(): handler for %s threw: %s\n", I::name, e.what());
+            rp = status_response(*cp, RPC_ERR_HANDLER_FAILED);
+        } catch (...) {
+            fprintf(stderr, "srpc::server::call_proxy(): handler for %s threw.\n", I::name);
+            rp = status_response(*cp, RPC_ERR_HANDLER_FAILED);
+        }
+        done(std::move(rp));
+    }
 
-        response_t<R> response;
-        response.set_code(RPC_SUCCESS);
-        response.set_value(result);
-        rp->pack_response(response);
+    /// An empty argument to decode the request into. Messages with arena fields get the
+    /// request arena as allocator, so their strings are not allocated from the heap.
+    template <typename I>
+    static I make_arg(packer const& p) {
+        if constexpr (std::uses_allocator_v<I, std::pmr::polymorphic_allocator<>>) {
+            if (p.arena()) { return I(std::pmr::polymorphic_allocator<>(p.arena().get())); }
+        }
+        return I{};
     }
 
-    std::unordered_map<std::string, std::function<void(packer*, packer*)>> _function_registry; 
+    /// Coroutine methods. The coroutine starts on the calling thread; whatever it awaits
+    /// resumes it on the reactor that read the request, so no thread waits meanwhile.
+    template <SrpcMessage R, typename C, SrpcMessage I, SrpcService S>
+    static void call_proxy_impl(task<R> (C::*func)(I&), S& instance, packer::ptr cp, respond_fn done) {
+        auto arg = make_in<I>(cp->arena(), make_arg<I>(*cp)); // referenced by the coroutine until it finishes
+        (*cp) >> *arg;
+        if (cp->failed()) {
+            fprintf(stderr, "srpc::server::call_proxy(): malformed request to %s.\n", I::name);
+            done(status_response(*cp, RPC_ERR_MALFORMED_MESSAGE));
+            return;
+        }
+        // cp holds the frame that *_view arguments point into
+        (instance.*func)(*arg).start([arg, cp, done = std::move(done)] (std::optional<R> result) {
+            if (!result) {
+                done(status_response(*cp, RPC_ERR_HANDLER_FAILED));
+                return;
+            }
+            packer::ptr rp = make_in<packer>(cp->arena(), cp->format(), cp->arena());
+            auto value = make_in<R>(cp->arena(), std::move(*result));
+            rp->set_chained(true);
+            rp->pack_response(RPC_SUCCESS, *value);
+            rp->hold(std::move(value));
+            done(std::move(rp));
+        });
+    }
+
+    std::vector<method_slot>                    _methods;   // indexed by method id
+
+    work_stealing_executor::ptr                 _executor;
+    std::mutex                                  _loop_mutex;
+    std::vector<reactor::ptr>                   _loops;
+    bool                                        _stopped = false;
 };
 
 } //namespace srpc
@@ -15,12 +15,19 @@ enum class token_t : size_t {
     SERVICE     ,
     METHOD      ,
     RETURNS     ,
+    REPEATED    ,
+    MAP         ,
+    ARENA       ,
 
     LBRACE      ,
     RBRACE      ,
     LPAREN      ,
     RPAREN      ,
     SEMICOLON   ,   
+    LANGLE      ,
+    RANGLE      ,
+    COMMA       ,
+    EQUALS      ,
 
     INT8_T      ,
     INT16_T     ,
@@ -29,6 +36,13 @@ enum class token_t : size_t {
     CHAR_T      ,
     STRING_T    ,
     BOOL_T      ,
+    UINT8_T     ,
+    UINT16_T    ,
+    UINT32_T    ,
+    UINT64_T    ,
+    FLOAT_T     ,
+    DOUBLE_T    ,
+    BYTES_T     ,
 
     INT_LIT     ,   
 
@@ -40,6 +54,9 @@ const std::unordered_map<std::string_view, token_t> keywords {
     {"service", token_t::SERVICE},
     {"method", token_t::METHOD},
     {"returns", token_t::RETURNS},
+    {"repeated", token_t::REPEATED},
+    {"map", token_t::MAP},
+    {"arena", token_t::ARENA},
     {"int8", token_t::INT8_T},
     {"int16", token_t::INT16_T},
     {"int32", token_t::INT32_T},
@@ -47,13 +64,21 @@ const std::unordered_map<std::string_view, token_t> keywords {
     {"char", token_t::CHAR_T},
     {"string", token_t::STRING_T},
     {"bool", token_t::BOOL_T},
+    {"uint8", token_t::UINT8_T},
+    {"uint16", token_t::UINT16_T},
+    {"uint32", token_t::UINT32_T},
+    {"uint64", token_t::UINT64_T},
+    {"float", token_t::FLOAT_T},
+    {"double", token_t::DOUBLE_T},
+    {"bytes", token_t::BYTES_T},
 }; 
 
 const std::array<std::string, static_cast<size_t>(token_t::COUNT)> inv_map {
     "ILLEGAL", "EOFT",
-    "IDENTIFIER", "MESSAGE", "SERVICE", "METHOD", "RETURNS"
-    "LBRACE", "RBRACE", "LPAREN", "RPAREN", "SEMICOLON"
+    "IDENTIFIER", "MESSAGE", "SERVICE", "METHOD", "RETURNS", "REPEATED", "MAP", "ARENA",
+    "LBRACE", "RBRACE", "LPAREN", "RPAREN", "SEMICOLON", "LANGLE", "RANGLE", "COMMA", "EQUALS",
     "INT8_T", "INT16_T", "INT32_T", "INT64_T", "CHAR_T", "STRING_T", "BOOL_T",
+    "UINT8_T", "UINT16_T", "UINT32_T", "UINT64_T", "FLOAT_T", "DOUBLE_T", "BYTES_T",
     "INT_LIT"
 };
 
@@ -7,31 +7,94 @@
 #include <netinet/in.h>
 #include <netdb.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <sys/uio.h>
+#include <endian.h>
+#include <atomic>
 #include <string>
 #include <cstring>
+#include <algorithm>
+#include "pool.hpp"
+#include "iobuf.hpp"
+#include "uring.hpp"
 
 namespace srpc {
 
-#define SOCKET_SEND_FLAGS 0
-#define BACKLOG_SZ 8
+#define SOCKET_SEND_FLAGS MSG_NOSIGNAL
+#define SEND_MAX_IOV 64
+#define BACKLOG_SZ SOMAXCONN
 
-struct message_t {
-    message_t() = default;
-    message_t(uint8_t* data, size_t size) : _data(data), _size(size) {};
-    message_t(size_t size) : _size(size) { _data = (uint8_t*) std::malloc(size); }
+/// A received frame payload, held in a slab of the global buffer_pool and handed
+/// back to it when the last owner (e.g. the packer that adopted it) goes away.
+using message_t = slab;
 
-    const uint8_t* data() const noexcept { return _data; }
-    const size_t size() const noexcept { return _size; }
+namespace transport {
 
-private:
-    size_t      _size;
-    uint8_t*    _data;
+/// Every frame starts with the payload length and the request id, both in network
+/// byte order. The id lets many calls share one connection: the server echoes it
+/// on the response, which may come back in any order.
+#define FRAME_HEADER_SZ (sizeof(uint32_t) + sizeof(uint64_t))
+
+/// Largest payload accepted in a frame. The length comes from the peer: a bigger one 
+/// fails the receive and the connection is closed, rather than buffering up to 4 GiB.
+#ifndef FRAME_MAX_SZ
+#define FRAME_MAX_SZ (64u << 20)
+#endif
+
+/// Request id reserved for the handshake a client may open a connection with. Its
+/// payload is the wire_format the client asks for (one byte); the server answers on
+/// the same id with the format the connection will use from then on, FIXED if it
+/// does not know the one asked for. Connections without a handshake use FIXED.
+#define HANDSHAKE_REQUEST_ID UINT64_MAX
+
+inline void encode_header(uint8_t* header, uint32_t len, uint64_t request_id) noexcept {
+    uint32_t len_network = htonl(len);
+    uint64_t id_network = htobe64(request_id);
+    std::memcpy(header, &len_network, sizeof(len_network));
+    std::memcpy(header + sizeof(len_network), &id_network, sizeof(id_network));
+}
+
+inline void decode_header(const uint8_t* header, uint32_t& len, uint64_t& request_id) noexcept {
+    uint32_t len_network;
+    uint64_t id_network;
+    std::memcpy(&len_network, header, sizeof(len_network));
+    std::memcpy(&id_network, header + sizeof(len_network), sizeof(id_network));
+    len = ntohl(len_network);
+    request_id = be64toh(id_network);
+}
+
+/// I/O backend used by send_data() / recv_data() and by server::start_reactor().
+enum class backend : uint8_t {
+    SOCKETS = 0,    // plain blocking send/recv, epoll on the server
+    IO_URING        // io_uring submissions, falls back to SOCKETS where io_uring is unavailable
 };
 
-namespace transport {
+inline std::atomic<backend> active_backend = backend::SOCKETS;
+
+/// Selects the backend at runtime, process wide.
+inline void set_backend(backend b) noexcept { active_backend.store(b, std::memory_order_relaxed); }
+
+inline backend get_backend() noexcept { return active_backend.load(std::memory_order_relaxed); }
+
+/// Selects a backend for as long as it lives, then restores the one selected before.
+class scoped_backend {
+public:
+    explicit scoped_backend(backend b) noexcept : _previous(get_backend()) { set_backend(b); }
+    ~scoped_backend() { set_backend(_previous); }
+
+    scoped_backend(const scoped_backend&) = delete;
+    scoped_backend& operator=(const scoped_backend&) = delete;
+
+private:
+    backend _previous;
+};
 
-[[nodiscard]] inline int32_t create_server_socket(const std::string& port) { 
-    int32_t status, listening_fd, accepted_fd;
+/// @param port        port to listen on
+/// @param reuse_port  set SO_REUSEPORT so that several sockets (one per reactor thread) 
+///                    can bind the same port and have the kernel balance connections across them
+[[nodiscard]] inline int32_t create_server_socket(const std::string& port, bool reuse_port = false) { 
+    int32_t status, listening_fd;
     struct addrinfo hints, *servinfo;
 
     std::memset(&hints, 0, sizeof(hints));
@@ -46,14 +109,27 @@ namespace transport {
 
     if ((listening_fd = socket(servinfo->ai_family, servinfo->ai_socktype, servinfo->ai_protocol)) < 0) {
         fprintf(stderr, "srpc::transport::create_server_socket(): error creating socket.\n");
+        freeaddrinfo(servinfo);
+        return -1;
+    }
+
+    // SO_REUSEADDR lets a restarted server bind while old connections sit in TIME_WAIT
+    int32_t one = 1;
+    if (setsockopt(listening_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0 ||
+            (reuse_port && setsockopt(listening_fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0)) {
+        fprintf(stderr, "srpc::transport::create_server_socket(): setsockopt failed.\n");
+        freeaddrinfo(servinfo);
+        close(listening_fd);
         return -1;
     }
 
     if (bind(listening_fd, servinfo->ai_addr, servinfo->ai_addrlen) < 0) {
         fprintf(stderr, "srpc::transport::create_server_socket(): bind failed.\n");
+        freeaddrinfo(servinfo);
         close(listening_fd);
         return -1;
     }
+    freeaddrinfo(servinfo);
 
     if (listen(listening_fd, BACKLOG_SZ) < 0) { 
         fprintf(stderr, "srpc::transport::create_server_socket(): listen failed.\n");
@@ -65,63 +141,267 @@ namespace transport {
 }
 
 [[nodiscard]] inline int32_t create_client_socket(const std::string& server_ip, const std::string& port) {
-    int32_t status, client_fd;
-    struct addrinfo hints, *servinfo;
+    int32_t status, client_fd = -1;
+    struct addrinfo hints, *servinfo, *p;
 
     std::memset(&hints, 0, sizeof(hints));
     hints.ai_family = AF_UNSPEC;     // dont care ipv4 or ipv6
     hints.ai_socktype = SOCK_STREAM; // tcp, use DGRAM for udp
 
-    if ((status = getaddrinfo(nullptr, port.c_str(), &hints, &servinfo)) != 0) {
+    if ((status = getaddrinfo(server_ip.c_str(), port.c_str(), &hints, &servinfo)) != 0) {
         fprintf(stderr, "srpc::transport::create_client_socket(): getaddrinfo error: %s\n" , gai_strerror(status));
         return -1;
     }
 
-    if ((client_fd = socket(servinfo->ai_family, servinfo->ai_socktype, servinfo->ai_protocol)) < 0) {
-        fprintf(stderr, "srpc::transport::create_client_socket(): error creating socket.\n");
-        return -1;
+    // connect to the first address that accepts us
+    for (p = servinfo; p != nullptr; p = p->ai_next) {
+        if ((client_fd = socket(p->ai_family, p->ai_socktype, p->ai_protocol)) < 0) {
+            continue;
+        }
+        if (connect(client_fd, p->ai_addr, p->ai_addrlen) == 0) {
+            break;
+        }
+        close(client_fd);
+        client_fd = -1;
     }
+    freeaddrinfo(servinfo);
 
-    if (connect(client_fd, servinfo->ai_addr, servinfo->ai_addrlen) < 0) {
+    if (client_fd < 0) {
         fprintf(stderr, "srpc::transport::create_client_socket(): error connecting socket.\n");
-        close(client_fd);
         return -1;
     }
     
     return client_fd;
 }
 
-inline void send_data(int32_t socket_fd, const uint8_t* data, size_t len) {
-    uint32_t size_network = htonl(len);
-    if (send(socket_fd, &size_network, sizeof(size_network), SOCKET_SEND_FLAGS) != sizeof(size_network)) {
-        fprintf(stderr, "srpc::transport::send_data(): failed to send data size.\n");
-        return;
+/// Puts the socket into non-blocking mode, used by the event loop.
+/// @return 0 on success, -1 on failure
+inline int32_t set_nonblocking(int32_t socket_fd) noexcept {
+    int32_t flags = fcntl(socket_fd, F_GETFL, 0);
+    if (flags < 0 || fcntl(socket_fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        fprintf(stderr, "srpc::transport::set_nonblocking(): fcntl failed.\n");
+        return -1;
     }
+    return 0;
+}
 
-    if (send(socket_fd, data, len, SOCKET_SEND_FLAGS) != static_cast<ssize_t>(len)) {
-        fprintf(stderr, "srpc::transport::send_data(): failed to send data payload.\n");
-        return;
+/// Writes every byte described by iov with as few sendmsg calls as the socket allows,
+/// resuming from where a partial write stopped. iov is modified in the process.
+/// @return 0 on success, -1 on failure
+inline int32_t send_iov(int32_t socket_fd, struct iovec* iov, size_t count) {
+    while (count > 0) {
+        struct msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+
+        ssize_t n = -1;
+        if (get_backend() == backend::IO_URING) { n = uring_transport::send_msg(socket_fd, &msg); }
+        if (n < 0) { n = sendmsg(socket_fd, &msg, SOCKET_SEND_FLAGS); }
+        if (n < 0) {
+            if (errno == EINTR) { continue; }
+            return -1;
+        }
+
+        // skip what was written, the first remaining iovec may be cut in half
+        size_t written = static_cast<size_t>(n);
+        while (count > 0 && written >= iov->iov_len) {
+            written -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = static_cast<uint8_t*>(iov->iov_base) + written;
+            iov->iov_len -= written;
+        }
     }
+    return 0;
 }
 
-[[nodiscard]] inline message_t recv_data(int socket_fd) {
-    uint32_t size_network;
-    if (recv(socket_fd, &size_network, sizeof(size_network), MSG_WAITALL) != sizeof(size_network)) {
-        fprintf(stderr, "srpc::transport::recv_data(): failed to receive data size.\n");
+/// Sends one frame, header and payload in a single syscall.
+/// @param request_id  correlates a response with its request, echoed back by the server
+inline void send_data(int32_t socket_fd, const uint8_t* data, size_t len, uint64_t request_id = 0) {
+    uint8_t header[FRAME_HEADER_SZ];
+    encode_header(header, static_cast<uint32_t>(len), request_id);
+    struct iovec iov[2] = {
+        { header, sizeof(header) },
+        { const_cast<uint8_t*>(data), len }
+    };
+
+    if (send_iov(socket_fd, iov, 2) < 0) {
+        fprintf(stderr, "srpc::transport::send_data(): failed to send frame.\n");
+    }
+}
+
+/// Sends one frame whose payload is a chain of segments, each handed to sendmsg as is.
+/// Chains longer than SEND_MAX_IOV segments take several syscalls.
+/// @return 0 on success, -1 on failure
+inline int32_t send_chain(int32_t socket_fd, iobuf const& payload, uint64_t request_id = 0) {
+    uint8_t header[FRAME_HEADER_SZ];
+    encode_header(header, static_cast<uint32_t>(payload.size()), request_id);
+    struct iovec iov[SEND_MAX_IOV];
+    iov[0] = { header, sizeof(header) };
+
+    size_t first = 1, sent = 0;
+    do {
+        size_t n = first + payload.to_iov(sent, iov + first, SEND_MAX_IOV - first);
+        for (size_t i = first; i < n; i++) { sent += iov[i].iov_len; }
+        if (send_iov(socket_fd, iov, n) < 0) {
+            fprintf(stderr, "srpc::transport::send_chain(): failed to send frame.\n");
+            return -1;
+        }
+        first = 0;
+    } while (sent < payload.size());
+    return 0;
+}
+
+/// A payload to be sent as one frame by send_frames().
+struct frame_view {
+    const uint8_t*  data;
+    size_t          len;
+    uint64_t        request_id = 0;
+};
+
+/// Sends several frames, batching up to SEND_MAX_IOV / 2 frames into each syscall.
+/// @return 0 on success, -1 on failure
+inline int32_t send_frames(int32_t socket_fd, const frame_view* frames, size_t count) {
+    uint8_t headers[SEND_MAX_IOV / 2][FRAME_HEADER_SZ];
+    struct iovec iov[SEND_MAX_IOV];
+
+    for (size_t i = 0; i < count; ) {
+        size_t n = 0;
+        for (; n < SEND_MAX_IOV / 2 && i < count; n++, i++) {
+            encode_header(headers[n], static_cast<uint32_t>(frames[i].len), frames[i].request_id);
+            iov[2 * n] = { headers[n], FRAME_HEADER_SZ };
+            iov[2 * n + 1] = { const_cast<uint8_t*>(frames[i].data), frames[i].len };
+        }
+        if (send_iov(socket_fd, iov, 2 * n) < 0) {
+            fprintf(stderr, "srpc::transport::send_frames(): failed to send frames.\n");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/// Blocks until len bytes are received, through the selected backend.
+/// @return number of bytes received
+inline ssize_t recv_exact(int32_t socket_fd, void* data, size_t len) {
+    if (get_backend() == backend::IO_URING) {
+        ssize_t n = uring_transport::recv_exact(socket_fd, data, len);
+        if (n >= 0 || uring_transport::thread_ring() != nullptr) { return n; }
+    }
+    return recv(socket_fd, data, len, MSG_WAITALL);
+}
+
+/// Receives one frame.
+/// @param request_id  set to the id carried in the frame header
+/// @return the payload, empty on failure
+[[nodiscard]] inline message_t recv_frame(int32_t socket_fd, uint64_t& request_id) {
+    uint8_t header[FRAME_HEADER_SZ];
+    if (recv_exact(socket_fd, header, sizeof(header)) != sizeof(header)) {
         return message_t{}; 
     }
 
-    uint32_t size = ntohl(size_network);
-    uint8_t* data = new uint8_t[size];
+    uint32_t size;
+    decode_header(header, size, request_id);
+    if (size > FRAME_MAX_SZ) {
+        fprintf(stderr, "srpc::transport::recv_frame(): %u byte frame exceeds FRAME_MAX_SZ.\n", size);
+        return message_t{};
+    }
+    message_t msg = buffer_pool::global().acquire(size);
+    if (!msg) {
+        fprintf(stderr, "srpc::transport::recv_frame(): failed to allocate %u bytes.\n", size);
+        return message_t{};
+    }
 
-    if (recv(socket_fd, data, size, MSG_WAITALL) != static_cast<ssize_t>(size)) {
-        fprintf(stderr, "srpc::transport::recv_data(): failed to receive data payload.\n");
+    if (recv_exact(socket_fd, msg.data(), size) != static_cast<ssize_t>(size)) {
+        fprintf(stderr, "srpc::transport::recv_frame(): failed to receive data payload.\n");
         return message_t{}; 
     }
 
-    return message_t(data, size);
+    return msg;
+}
+
+[[nodiscard]] inline message_t recv_data(int socket_fd) {
+    uint64_t request_id;
+    message_t msg = recv_frame(socket_fd, request_id);
+    if (!msg) { fprintf(stderr, "srpc::transport::recv_data(): failed to receive frame.\n"); }
+    return msg;
 }
 
+/// Reassembles frames from a stream read in pieces of any size. Only a partial header is
+/// buffered: once it is complete the payload goes straight into a slab of the size it 
+/// announces, so each payload byte is copied at most once. Callers expecting a large 
+/// payload can even have the socket write it there, see space() and received().
+class frame_reader {
+public:
+    /// Consumes n bytes read from the stream, calling on_frame(request_id, message_t&&)
+    /// for every frame they complete.
+    /// @return false if a frame exceeds FRAME_MAX_SZ or could not be allocated, the 
+    ///         stream cannot be resynchronised and is to be closed
+    template <typename F>
+    bool feed(const uint8_t* data, size_t n, F&& on_frame) {
+        while (n > 0) {
+            if (_payload) {
+                size_t len = std::min(n, remaining());
+                std::memcpy(_payload.data() + _filled, data, len);
+                data += len;
+                n -= len;
+                received(len, on_frame);
+                continue;
+            }
+
+            size_t len = std::min(n, FRAME_HEADER_SZ - _header_filled);
+            std::memcpy(_header + _header_filled, data, len);
+            _header_filled += len;
+            data += len;
+            n -= len;
+            if (_header_filled == FRAME_HEADER_SZ && !start(on_frame)) { return false; }
+        }
+        return true;
+    }
+
+    /// Where the rest of the current payload goes, nullptr between frames.
+    uint8_t* space() noexcept { return _payload ? _payload.data() + _filled : nullptr; }
+
+    /// Bytes of the current payload still to be received.
+    size_t remaining() const noexcept { return _payload ? _payload.size() - _filled : 0; }
+
+    /// Accounts for n bytes written to space(), calling on_frame once the payload is complete.
+    template <typename F>
+    void received(size_t n, F&& on_frame) {
+        _filled += n;
+        if (_filled < _payload.size()) { return; }
+        _filled = 0;
+        message_t payload = std::move(_payload); // the reader is between frames whatever on_frame does
+        on_frame(_request_id, std::move(payload));
+    }
+
+private:
+    template <typename F>
+    bool start(F&& on_frame) {
+        uint32_t size;
+        decode_header(_header, size, _request_id);
+        _header_filled = 0;
+        if (size > FRAME_MAX_SZ) {
+            fprintf(stderr, "srpc::transport::frame_reader::start(): %u byte frame exceeds FRAME_MAX_SZ.\n", size);
+            return false;
+        }
+        _payload = buffer_pool::global().acquire(size);
+        if (!_payload) {
+            fprintf(stderr, "srpc::transport::frame_reader::start(): failed to allocate %u bytes.\n", size);
+            return false;
+        }
+        if (size == 0) { received(0, on_frame); }
+        return true;
+    }
+
+    uint8_t     _header[FRAME_HEADER_SZ];
+    size_t      _header_filled = 0;
+    message_t   _payload;
+    size_t      _filled = 0;
+    uint64_t    _request_id = 0;
+};
+
 } // namespace transport
 
 } // namespace srpc
@@ -0,0 +1,330 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <linux/io_uring.h>
+
+namespace srpc {
+
+#define URING_SUBMIT_RETRIES    64  // io_uring_enter calls tried while the kernel answers EAGAIN/EBUSY
+
+/// Minimal io_uring wrapper on top of the raw syscalls: one submission and one
+/// completion ring, plus an optional ring of provided (kernel registered) buffers
+/// that multishot receives pick from.
+class uring {
+public:
+    /// @param entries  submission queue size, the completion queue is twice as large
+    explicit uring(uint32_t entries) {
+        struct io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+
+        _fd = static_cast<int32_t>(syscall(__NR_io_uring_setup, entries, &params));
+        if (_fd < 0) { return; }
+
+        _sq_ring_sz = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+        _cq_ring_sz = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+        bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap) { _sq_ring_sz = _cq_ring_sz = std::max(_sq_ring_sz, _cq_ring_sz); }
+
+        _sq_ring = mmap(nullptr, _sq_ring_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                _fd, IORING_OFF_SQ_RING);
+        _cq_ring = single_mmap ? _sq_ring
+            : mmap(nullptr, _cq_ring_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    _fd, IORING_OFF_CQ_RING);
+        _sqes_sz = params.sq_entries * sizeof(struct io_uring_sqe);
+        _sqes = static_cast<struct io_uring_sqe*>(mmap(nullptr, _sqes_sz, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQES));
+
+        if (_sq_ring == MAP_FAILED || _cq_ring == MAP_FAILED || _sqes == MAP_FAILED) {
+            fprintf(stderr, "srpc::uring::uring(): mmap failed.\n");
+            teardown();
+            return;
+        }
+
+        uint8_t* sq = static_cast<uint8_t*>(_sq_ring);
+        _sq_head = reinterpret_cast<uint32_t*>(sq + params.sq_off.head);
+        _sq_tail = reinterpret_cast<uint32_t*>(sq + params.sq_off.tail);
+        _sq_mask = *reinterpret_cast<uint32_t*>(sq + params.sq_off.ring_mask);
+        _sq_entries = *reinterpret_cast<uint32_t*>(sq + params.sq_off.ring_entries);
+        _sq_array = reinterpret_cast<uint32_t*>(sq + params.sq_off.array);
+        _sq_flags = reinterpret_cast<uint32_t*>(sq + params.sq_off.flags);
+        _sq_local_tail = *_sq_tail;
+
+        uint8_t* cq = static_cast<uint8_t*>(_cq_ring);
+        _cq_head = reinterpret_cast<uint32_t*>(cq + params.cq_off.head);
+        _cq_tail = reinterpret_cast<uint32_t*>(cq + params.cq_off.tail);
+        _cq_mask = *reinterpret_cast<uint32_t*>(cq + params.cq_off.ring_mask);
+        _cqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+    }
+
+    ~uring() { teardown(); }
+
+    uring(const uring&) = delete;
+    uring& operator=(const uring&) = delete;
+
+    /// false if the kernel does not support io_uring (or it is disabled)
+    bool ok() const noexcept { return _fd >= 0; }
+
+    /// Ring file descriptor, readable (for poll/epoll) while completions are available.
+    int32_t fd() const noexcept { return _fd; }
+
+    /// @return a zeroed submission entry, or nullptr if the submission queue is full
+    [[nodiscard]] struct io_uring_sqe* get_sqe() noexcept {
+        uint32_t head = std::atomic_ref<uint32_t>(*_sq_head).load(std::memory_order_acquire);
+        if (_sq_local_tail - head >= _sq_entries) { return nullptr; }
+
+        uint32_t idx = _sq_local_tail & _sq_mask;
+        struct io_uring_sqe* sqe = &_sqes[idx];
+        std::memset(sqe, 0, sizeof(*sqe));
+        _sq_array[idx] = idx;
+        _sq_local_tail++;
+        _to_submit++;
+        return sqe;
+    }
+
+    /// Hands every queued submission entry to the kernel in one syscall.
+    /// @param wait_nr  number of completions to wait for
+    /// @return number of entries submitted, or -errno
+    int32_t submit(uint32_t wait_nr = 0) noexcept {
+        std::atomic_ref<uint32_t>(*_sq_tail).store(_sq_local_tail, std::memory_order_release);
+
+        uint32_t flags = wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0;
+        int32_t ret;
+        do {
+            ret = static_cast<int32_t>(syscall(__NR_io_uring_enter, _fd, _to_submit, wait_nr, flags, nullptr, 0));
+        } while (ret < 0 && errno == EINTR);
+
+        if (ret < 0) { return -errno; }
+        _to_submit -= static_cast<uint32_t>(ret);
+        return ret;
+    }
+
+    /// Takes back the entries queued since the last submit that the kernel did not 
+    /// consume, for when it refused them: they would otherwise be picked up later and 
+    /// point at memory the caller has since given up.
+    void discard_unsubmitted() noexcept {
+        _sq_local_tail -= _to_submit;
+        _to_submit = 0;
+        std::atomic_ref<uint32_t>(*_sq_tail).store(_sq_local_tail, std::memory_order_release);
+    }
+
+    /// Calls f(const io_uring_cqe&) for every available completion and consumes them.
+    /// @return number of completions seen
+    template <typename F>
+    size_t for_each_cqe(F&& f) {
+        uint32_t head = *_cq_head;
+        uint32_t tail = std::atomic_ref<uint32_t>(*_cq_tail).load(std::memory_order_acquire);
+        size_t seen = 0;
+        for (; head != tail; head++, seen++) {
+            f(_cqes[head & _cq_mask]);
+        }
+        std::atomic_ref<uint32_t>(*_cq_head).store(head, std::memory_order_release);
+        return seen;
+    }
+
+    /// true if completions did not fit the completion queue and wait in the kernel,
+    /// flush_overflow() moves them in
+    bool cq_overflowed() const noexcept {
+        return std::atomic_ref<uint32_t>(*_sq_flags).load(std::memory_order_acquire) & IORING_SQ_CQ_OVERFLOW;
+    }
+
+    /// Moves overflowed completions into the completion queue, without waiting.
+    void flush_overflow() noexcept {
+        syscall(__NR_io_uring_enter, _fd, 0, 0, IORING_ENTER_GETEVENTS, nullptr, 0);
+    }
+
+    /// Registers n buffers of buf_size bytes as provided buffer group bgid. Receives
+    /// submitted with IOSQE_BUFFER_SELECT pick a buffer from it, which must be handed
+    /// back with recycle_buffer() once consumed.
+    /// @param n    number of buffers, must be a power of two
+    /// @return 0 on success, -errno on failure
+    int32_t register_buffer_ring(uint16_t bgid, uint32_t n, uint32_t buf_size) noexcept {
+        _br_sz = n * sizeof(struct io_uring_buf);
+        void* br = mmap(nullptr, _br_sz, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+        if (br == MAP_FAILED) { return -errno; }
+        _br = static_cast<struct io_uring_buf*>(br);
+
+        struct io_uring_buf_reg reg;
+        std::memset(&reg, 0, sizeof(reg));
+        reg.ring_addr = reinterpret_cast<uint64_t>(_br);
+        reg.ring_entries = n;
+        reg.bgid = bgid;
+        if (syscall(__NR_io_uring_register, _fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+            int32_t err = errno;
+            munmap(_br, _br_sz);
+            _br = nullptr;
+            return -err;
+        }
+
+        _br_mask = n - 1;
+        _br_buf_size = buf_size;
+        _br_tail = 0;
+        _br_storage.resize(static_cast<size_t>(n) * buf_size);
+        for (uint32_t i = 0; i < n; i++) { add_buffer(static_cast<uint16_t>(i)); }
+        publish_buffers();
+        return 0;
+    }
+
+    /// Start of provided buffer bid.
+    uint8_t* buffer(uint16_t bid) noexcept { return _br_storage.data() + static_cast<size_t>(bid) * _br_buf_size; }
+
+    /// Hands provided buffer bid back to the kernel.
+    void recycle_buffer(uint16_t bid) noexcept {
+        add_buffer(bid);
+        publish_buffers();
+    }
+
+private:
+    void add_buffer(uint16_t bid) noexcept {
+        struct io_uring_buf* buf = &_br[_br_tail & _br_mask];
+        buf->addr = reinterpret_cast<uint64_t>(buffer(bid));
+        buf->len = _br_buf_size;
+        buf->bid = bid;
+        _br_tail++;
+    }
+
+    /// The ring tail overlays the reserved field of the first entry (see io_uring_buf_ring). 
+    /// It is addressed directly because the header's flexible array member does not 
+    /// start at offset 0 when compiled as C++.
+    void publish_buffers() noexcept {
+        std::atomic_ref<uint16_t>(_br[0].resv).store(_br_tail, std::memory_order_release);
+    }
+
+    void teardown() noexcept {
+        if (_br) { munmap(_br, _br_sz); _br = nullptr; }
+        if (_sqes && _sqes != MAP_FAILED) { munmap(_sqes, _sqes_sz); }
+        if (_cq_ring && _cq_ring != MAP_FAILED && _cq_ring != _sq_ring) { munmap(_cq_ring, _cq_ring_sz); }
+        if (_sq_ring && _sq_ring != MAP_FAILED) { munmap(_sq_ring, _sq_ring_sz); }
+        _sqes = nullptr;
+        _cq_ring = _sq_ring = nullptr;
+        if (_fd >= 0) { close(_fd); _fd = -1; }
+    }
+
+    int32_t                     _fd = -1;
+
+    void*                       _sq_ring = nullptr;
+    size_t                      _sq_ring_sz = 0;
+    uint32_t*                   _sq_head = nullptr;
+    uint32_t*                   _sq_tail = nullptr;
+    uint32_t*                   _sq_array = nullptr;
+    uint32_t*                   _sq_flags = nullptr;
+    uint32_t                    _sq_mask = 0;
+    uint32_t                    _sq_entries = 0;
+    uint32_t                    _sq_local_tail = 0;
+    uint32_t                    _to_submit = 0;
+    struct io_uring_sqe*        _sqes = nullptr;
+    size_t                      _sqes_sz = 0;
+
+    void*                       _cq_ring = nullptr;
+    size_t                      _cq_ring_sz = 0;
+    uint32_t*                   _cq_head = nullptr;
+    uint32_t*                   _cq_tail = nullptr;
+    uint32_t                    _cq_mask = 0;
+    struct io_uring_cqe*        _cqes = nullptr;
+
+    struct io_uring_buf*        _br = nullptr;
+    size_t                      _br_sz = 0;
+    uint32_t                    _br_mask = 0;
+    uint32_t                    _br_buf_size = 0;
+    uint16_t                    _br_tail = 0;
+    std::vector<uint8_t>        _br_storage;
+};
+
+namespace uring_transport {
+
+/// Ring used by the blocking client side transport, one per thread. Each send or receive
+/// is one submission waited for on its own, so it costs the same single syscall as 
+/// sendmsg()/recv() and batches nothing: the caller's buffers must be written before
+/// it returns. Responses to client_connection calls are read by client_io instead.
+inline uring* thread_ring() {
+    static thread_local uring ring(8);
+    return ring.ok() ? &ring : nullptr;
+}
+
+/// Submits the one entry queued on ring and waits for its completion. An entry the kernel 
+/// refuses is taken back out of the ring. If waiting fails once the kernel owns it, the 
+/// socket is shut down so the operation completes, and reaped before returning: the caller's 
+/// buffers are never left to the kernel.
+/// @return the completion's result, -1 if it could not be submitted or waited for
+inline ssize_t submit_and_wait(uring* ring, int32_t socket_fd) {
+    int32_t submitted = -EAGAIN;
+    for (int32_t i = 0; i < URING_SUBMIT_RETRIES && submitted <= 0; i++) {
+        submitted = ring->submit(1);
+        if (submitted < 0 && submitted != -EAGAIN && submitted != -EBUSY) { break; }
+    }
+    if (submitted <= 0) {
+        ring->discard_unsubmitted();
+        return -1;
+    }
+
+    ssize_t res = -1;
+    bool failed = false;
+    while (ring->for_each_cqe([&res] (const struct io_uring_cqe& cqe) { res = cqe.res; }) == 0) {
+        if (failed) {
+            sched_yield(); // lets the kernel run the completion's task work
+        } else if (ring->submit(1) < 0) {
+            shutdown(socket_fd, SHUT_RDWR);
+            failed = true;
+        }
+    }
+    return failed ? -1 : res;
+}
+
+/// Sends the iovecs of msg with a single IORING_OP_SENDMSG.
+/// @return number of bytes sent, -1 if io_uring is unavailable or the send failed
+inline ssize_t send_msg(int32_t socket_fd, const struct msghdr* msg) {
+    uring* ring = thread_ring();
+    if (!ring) { return -1; }
+
+    struct io_uring_sqe* sqe = ring->get_sqe();
+    if (!sqe) { return -1; }
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = socket_fd;
+    sqe->addr = reinterpret_cast<uint64_t>(msg);
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+
+    ssize_t res = submit_and_wait(ring, socket_fd);
+    return res < 0 ? -1 : res;
+}
+
+/// Receives exactly len bytes, resubmitting after a short read until the peer closes 
+/// the connection.
+/// @return number of bytes received, -1 if io_uring is unavailable or the receive failed
+inline ssize_t recv_exact(int32_t socket_fd, void* data, size_t len) {
+    uring* ring = thread_ring();
+    if (!ring) { return -1; }
+
+    uint8_t* out = static_cast<uint8_t*>(data);
+    size_t received = 0;
+    while (received < len) {
+        struct io_uring_sqe* sqe = ring->get_sqe();
+        if (!sqe) { return -1; }
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = socket_fd;
+        sqe->addr = reinterpret_cast<uint64_t>(out + received);
+        sqe->len = static_cast<uint32_t>(len - received);
+        sqe->msg_flags = MSG_WAITALL;
+
+        ssize_t res = submit_and_wait(ring, socket_fd);
+        if (res == -EINTR || res == -EAGAIN) { continue; }
+        if (res < 0) { return -1; }
+        if (res == 0) { break; }
+        received += static_cast<size_t>(res);
+    }
+    return static_cast<ssize_t>(received);
+}
+
+} // namespace uring_transport
+
+} // namespace srpc
@@ -0,0 +1,310 @@
+#pragma once
+
+#include "reactor.hpp"
+#include "uring.hpp"
+#include <cerrno>
+#include <cstdint>
+#include <netinet/tcp.h>
+
+namespace srpc {
+
+#define URING_LOOP_ENTRIES  1024
+#define URING_BUF_GROUP     0
+#define URING_BUF_COUNT     256     // must be a power of two
+#define URING_BUF_SIZE      16384
+
+/// io_uring reactor. Uses a multishot accept on the listening socket, a multishot
+/// receive per connection that fills buffers from a kernel registered buffer ring,
+/// and one send in flight per connection. Everything queued while handling a batch
+/// of completions is submitted with a single io_uring_enter.
+class uring_loop : public reactor {
+public:
+    explicit uring_loop(frame_handler handler, work_stealing_executor::ptr executor = nullptr)
+        : reactor(std::move(handler), std::move(executor)), _ring(URING_LOOP_ENTRIES) {
+        if (_ring.ok() && _ring.register_buffer_ring(URING_BUF_GROUP, URING_BUF_COUNT, URING_BUF_SIZE) == 0) {
+            _ok = true;
+        }
+    }
+
+    ~uring_loop() override {
+        wait_in_flight();
+        _connections.clear();
+        if (_listening_fd != -1) { close(_listening_fd); }
+    }
+
+    /// false if io_uring (or one of the features used here) is unavailable,
+    /// the caller should fall back to the epoll event_loop
+    bool ok() const noexcept { return _ok; }
+
+    int32_t adopt_listener(int32_t listening_fd) noexcept override {
+        if (!_ok || listening_fd < 0) { return -1; }
+        _listening_fd = listening_fd;
+        return 0;
+    }
+
+protected:
+    void loop() override {
+        while (running()) {
+            // (re)armed here rather than in handle_cqe, so that a full ring only delays them
+            if (!_wake_armed) { arm_wake(); }
+            if (!_accept_armed) { arm_accept(); }
+
+            int32_t ret = _ring.submit(1);
+            if (ret < 0 && ret != -EAGAIN && ret != -EBUSY) {
+                fprintf(stderr, "srpc::uring_loop::run(): io_uring_enter failed.\n");
+                break;
+            }
+            _ring.for_each_cqe([this] (const struct io_uring_cqe& cqe) { handle_cqe(cqe); });
+        }
+        shutdown_connections();
+    }
+
+    /// Starts sending the queued frames unless a send is already in flight, in which
+    /// case they are picked up when that one completes.
+    /// @return false if the send could not be queued
+    bool flush(uint64_t id, connection& c) noexcept override {
+        auto& conn = static_cast<uring_connection&>(c);
+        if (conn.sending || conn.closing || conn.wframes.empty()) { return true; }
+
+        return arm_send(id, conn);
+    }
+
+    /// Shuts the socket down so the kernel completes whatever is in flight on it, the
+    /// connection is destroyed once the last of those completions arrived.
+    void drop(uint64_t id) noexcept override {
+        auto it = _connections.find(id);
+        if (it == _connections.end()) { return; }
+        auto& conn = static_cast<uring_connection&>(*it->second);
+
+        if (!conn.closing) {
+            conn.closing = true;
+            shutdown(conn.fd, SHUT_RDWR);
+        }
+        if (conn.ops == 0) { _connections.erase(it); }
+    }
+
+private:
+    enum op : uint64_t { OP_WAKE = 1, OP_ACCEPT, OP_RECV, OP_SEND, OP_CANCEL };
+
+    static constexpr uint64_t OP_SHIFT = 56;
+    static constexpr uint64_t ID_MASK = (1ull << OP_SHIFT) - 1;
+
+    struct uring_connection : connection {
+        explicit uring_connection(int32_t fd) : connection(fd) {}
+
+        struct iovec            iov[REACTOR_MAX_IOV];   // handed to the in-flight sendmsg
+        struct msghdr           msg{};
+        bool                    sending = false;
+        bool                    closing = false;
+        uint32_t                ops = 0;            // submissions the kernel still owns
+    };
+
+    static uint64_t tag(op o, uint64_t id) noexcept { return (static_cast<uint64_t>(o) << OP_SHIFT) | id; }
+
+    /// Gets a submission entry, flushing the queue to the kernel if it is full.
+    /// @return nullptr if the kernel still refuses new submissions after URING_SUBMIT_RETRIES
+    ///         tries, typically because its completion queue is full until this loop reaps it
+    struct io_uring_sqe* sqe() noexcept {
+        struct io_uring_sqe* e = _ring.get_sqe();
+        for (int32_t i = 0; e == nullptr && i < URING_SUBMIT_RETRIES; i++) {
+            int32_t ret = _ring.submit();
+            if (ret < 0 && ret != -EAGAIN && ret != -EBUSY) { break; }
+            e = _ring.get_sqe();
+        }
+        if (e == nullptr) { fprintf(stderr, "srpc::uring_loop::sqe(): submission queue is full.\n"); }
+        return e;
+    }
+
+    void arm_wake() noexcept {
+        struct io_uring_sqe* e = sqe();
+        if (!e) { return; }
+        e->opcode = IORING_OP_READ;
+        e->fd = _wake_fd;
+        e->addr = reinterpret_cast<uint64_t>(&_wake_buf);
+        e->len = sizeof(_wake_buf);
+        e->user_data = tag(OP_WAKE, 0);
+        _wake_armed = true;
+    }
+
+    void arm_accept() noexcept {
+        struct io_uring_sqe* e = sqe();
+        if (!e) { return; }
+        e->opcode = IORING_OP_ACCEPT;
+        e->fd = _listening_fd;
+        e->ioprio = IORING_ACCEPT_MULTISHOT;
+        e->accept_flags = SOCK_CLOEXEC;
+        e->user_data = tag(OP_ACCEPT, 0);
+        _accept_armed = true;
+    }
+
+    bool arm_recv(uint64_t id, uring_connection& conn) noexcept {
+        struct io_uring_sqe* e = sqe();
+        if (!e) { return false; }
+        e->opcode = IORING_OP_RECV;
+        e->fd = conn.fd;
+        e->ioprio = IORING_RECV_MULTISHOT;
+        e->flags = IOSQE_BUFFER_SELECT;
+        e->buf_group = URING_BUF_GROUP;
+        e->user_data = tag(OP_RECV, id);
+        conn.ops++;
+        return true;
+    }
+
+    bool arm_send(uint64_t id, uring_connection& conn) noexcept {
+        struct io_uring_sqe* e = sqe();
+        if (!e) { return false; }
+        conn.msg.msg_iov = conn.iov;
+        conn.msg.msg_iovlen = gather(conn, conn.iov, REACTOR_MAX_IOV);
+
+        e->opcode = IORING_OP_SENDMSG;
+        e->fd = conn.fd;
+        e->addr = reinterpret_cast<uint64_t>(&conn.msg);
+        e->len = 1;
+        e->msg_flags = MSG_NOSIGNAL;
+        e->user_data = tag(OP_SEND, id);
+        conn.sending = true;
+        conn.ops++;
+        return true;
+    }
+
+    void handle_cqe(const struct io_uring_cqe& cqe) {
+        op o = static_cast<op>(cqe.user_data >> OP_SHIFT);
+        uint64_t id = cqe.user_data & ID_MASK;
+        bool more = cqe.flags & IORING_CQE_F_MORE;
+
+        switch (o) {
+        case OP_WAKE:
+            _wake_armed = false;
+            drain_completions();
+            break;
+        case OP_ACCEPT:
+            if (cqe.res >= 0) {
+                accept_connection(cqe.res);
+            } else if (cqe.res != -ECANCELED) {
+                fprintf(stderr, "srpc::uring_loop::handle_cqe(): accept failed.\n");
+            }
+            if (!more) { _accept_armed = false; }
+            break;
+        case OP_RECV:
+            handle_recv(id, cqe, more);
+            break;
+        case OP_SEND:
+            handle_send(id, cqe);
+            break;
+        case OP_CANCEL:
+            break;
+        }
+    }
+
+    void accept_connection(int32_t fd) {
+        int32_t one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        uint64_t id = _next_conn_id++;
+        auto conn = std::make_unique<uring_connection>(fd);
+        if (!arm_recv(id, *conn)) { return; } // conn closes the socket
+        _connections[id] = std::move(conn);
+    }
+
+    void handle_recv(uint64_t id, const struct io_uring_cqe& cqe, bool more) {
+        auto it = _connections.find(id);
+        if (it == _connections.end()) { return; }
+        auto& conn = static_cast<uring_connection&>(*it->second);
+        if (!more) { conn.ops--; }
+
+        if (cqe.res > 0) {
+            uint16_t bid = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+            bool parsed = conn.closing || parse_frames(id, conn, _ring.buffer(bid), static_cast<size_t>(cqe.res));
+            _ring.recycle_buffer(bid);
+
+            if (!conn.closing) {
+                if (!parsed) {
+                    drop(id);
+                    return;
+                }
+                if (!flush(id, conn) || (!more && !arm_recv(id, conn))) {
+                    drop(id);
+                    return;
+                }
+            }
+        } else if (cqe.res == -ENOBUFS && !conn.closing) {
+            // every provided buffer is in use, try again once some have been recycled
+            if (!more && !arm_recv(id, conn)) {
+                drop(id);
+                return;
+            }
+        } else if (cqe.res == 0 && !conn.closing) {
+            // the peer shut down its side, answer what it sent before closing
+            conn.read_closed = true;
+            flush_or_drop(id, conn);
+            return;
+        } else if (!more) {
+            drop(id); // peer closed, error, or the socket was shut down by us
+            return;
+        }
+
+        if (conn.closing && conn.ops == 0) { drop(id); }
+    }
+
+    void handle_send(uint64_t id, const struct io_uring_cqe& cqe) {
+        auto it = _connections.find(id);
+        if (it == _connections.end()) { return; }
+        auto& conn = static_cast<uring_connection&>(*it->second);
+        conn.ops--;
+        conn.sending = false;
+
+        if (cqe.res < 0) {
+            drop(id);
+            return;
+        }
+
+        consume(conn, cqe.res);
+        if (conn.closing) {
+            if (conn.ops == 0) { drop(id); }
+        } else {
+            flush_or_drop(id, conn); // the rest of a partial write and whatever was queued meanwhile
+        }
+    }
+
+    /// Shuts every connection down and waits for the kernel to hand back the buffers
+    /// still referenced by in-flight submissions. The multishot accept is cancelled and
+    /// waited for too: it holds the listening socket, which would otherwise keep the port
+    /// bound after close() until the ring is torn down.
+    void shutdown_connections() {
+        std::vector<uint64_t> ids;
+        for (auto& [id, conn] : _connections) { ids.push_back(id); }
+        for (uint64_t id : ids) { drop(id); }
+
+        if (_accept_armed) {
+            struct io_uring_sqe* e = sqe();
+            if (e) {
+                e->opcode = IORING_OP_ASYNC_CANCEL;
+                e->addr = tag(OP_ACCEPT, 0);
+                e->user_data = tag(OP_CANCEL, 0);
+            } else {
+                _accept_armed = false; // cannot be cancelled, closed with the ring
+            }
+        }
+
+        while ((!_connections.empty() || _accept_armed) && _ring.submit(1) >= 0) {
+            _ring.for_each_cqe([this] (const struct io_uring_cqe& cqe) {
+                op o = static_cast<op>(cqe.user_data >> OP_SHIFT);
+                if (o == OP_RECV || o == OP_SEND) {
+                    handle_cqe(cqe);
+                } else if (o == OP_ACCEPT) {
+                    if (cqe.res >= 0) { close(cqe.res); } // accepted while stopping
+                    if (!(cqe.flags & IORING_CQE_F_MORE)) { _accept_armed = false; }
+                }
+            });
+        }
+    }
+
+    uring       _ring;
+    bool        _ok = false;
+    int32_t     _listening_fd = -1;
+    uint64_t    _wake_buf = 0;
+    bool        _wake_armed = false;
+    bool        _accept_armed = false;
+};
+
+} // namespace srpc
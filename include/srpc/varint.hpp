@@ -0,0 +1,84 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <endian.h>
+#include <type_traits>
+
+namespace srpc {
+
+#define VARINT_MAX_BYTES 10   // a uint64_t takes at most ten 7-bit groups
+
+/// LEB128 varints, the integer encoding of wire_format::COMPACT. Seven bits per byte,
+/// least significant group first, the high bit set on every byte but the last.
+/// Signed values are zigzag mapped first so that small negative numbers stay short.
+namespace varint {
+
+/// 0, -1, 1, -2, 2 ... become 0, 1, 2, 3, 4 ...
+template <typename T> requires std::is_signed_v<T>
+constexpr std::make_unsigned_t<T> zigzag(T v) noexcept {
+    using U = std::make_unsigned_t<T>;
+    return (static_cast<U>(v) << 1) ^ static_cast<U>(v >> (sizeof(T) * 8 - 1));
+}
+
+template <typename T> requires std::is_signed_v<T>
+constexpr T unzigzag(std::make_unsigned_t<T> u) noexcept {
+    return static_cast<T>((u >> 1) ^ (~(u & 1) + 1));
+}
+
+/// @param out  room for VARINT_MAX_BYTES
+/// @return number of bytes written
+inline size_t encode(uint64_t v, uint8_t* out) noexcept {
+    size_t n = 0;
+    while (v >= 0x80) {
+        out[n++] = static_cast<uint8_t>(v) | 0x80;
+        v >>= 7;
+    }
+    out[n++] = static_cast<uint8_t>(v);
+    return n;
+}
+
+/// Number of bytes encode() writes for v.
+constexpr size_t encoded_size(uint64_t v) noexcept {
+    return 1 + (std::bit_width(v | 1) - 1) / 7;
+}
+
+/// @param p        encoded bytes
+/// @param avail    bytes readable from p
+/// @param v        decoded value
+/// @return number of bytes consumed, 0 if p does not hold a complete varint
+inline size_t decode(const uint8_t* p, size_t avail, uint64_t& v) noexcept {
+    if (avail >= sizeof(uint64_t)) {
+        // Fast path, values below 2^56: find the last byte in one 8-byte load and
+        // squeeze out the continuation bits with three shift/mask steps, no loop.
+        uint64_t word;
+        std::memcpy(&word, p, sizeof(word));
+        word = le64toh(word);
+        uint64_t stops = ~word & 0x8080808080808080ull;
+        if (stops != 0) {
+            size_t len = std::countr_zero(stops) / 8 + 1;
+            uint64_t x = word & (~uint64_t{0} >> (64 - 8 * len)) & 0x7f7f7f7f7f7f7f7full;
+            x = (x & 0x007f007f007f007full) | ((x & 0x7f007f007f007f00ull) >> 1);
+            x = (x & 0x00003fff00003fffull) | ((x & 0x3fff00003fff0000ull) >> 2);
+            x = (x & 0x000000000fffffffull) | ((x & 0x0fffffff00000000ull) >> 4);
+            v = x;
+            return len;
+        }
+    }
+
+    uint64_t result = 0;
+    for (size_t i = 0; i < avail && i < VARINT_MAX_BYTES; i++) {
+        result |= static_cast<uint64_t>(p[i] & 0x7f) << (7 * i);
+        if (!(p[i] & 0x80)) {
+            v = result;
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+} // namespace varint
+
+} // namespace srpc
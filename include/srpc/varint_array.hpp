@@ -0,0 +1,365 @@
+#pragma once
+
+#include "varint.hpp"
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <algorithm>
+#include <type_traits>
+
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(SRPC_NO_SIMD)
+#include <immintrin.h>
+#define SRPC_VARINT_X86 1
+#endif
+
+namespace srpc {
+
+/// Bulk varint encoding of 32 and 64-bit integer arrays, used by the packer for repeated
+/// fields in wire_format::COMPACT. Runs of values taking one byte (and, when encoding,
+/// runs taking two) are converted a whole vector register at a time; anything else
+/// goes through the scalar varint::encode() / varint::decode(). The byte stream is the
+/// same whichever kernel produced it.
+namespace varint {
+
+/// Instruction sets the array kernels can use.
+enum class simd : uint8_t { NONE = 0, SSE4, AVX2 };
+
+/// Best instruction set of the running CPU, detected once.
+inline simd cpu_simd() noexcept {
+#ifdef SRPC_VARINT_X86
+    static const simd level = __builtin_cpu_supports("avx2") ? simd::AVX2
+        : __builtin_cpu_supports("sse4.1") ? simd::SSE4 : simd::NONE;
+    return level;
+#else
+    return simd::NONE;
+#endif
+}
+
+template <typename T>
+concept array_element = std::is_integral_v<T> && !std::is_same_v<T, bool> && (sizeof(T) == 4 || sizeof(T) == 8);
+
+namespace detail {
+
+template <typename T>
+inline uint64_t to_wire(T v) noexcept {
+    if constexpr (std::is_signed_v<T>) { return zigzag(v); } else { return v; }
+}
+
+template <typename T>
+inline T from_wire(uint64_t u) noexcept {
+    if constexpr (std::is_signed_v<T>) {
+        return unzigzag<T>(static_cast<std::make_unsigned_t<T>>(u));
+    } else {
+        return static_cast<T>(u);
+    }
+}
+
+template <typename T>
+inline size_t encode_scalar(const T* in, size_t n, uint8_t* out) noexcept {
+    size_t w = 0;
+    for (size_t i = 0; i < n; i++) { w += encode(to_wire(in[i]), out + w); }
+    return w;
+}
+
+template <typename T>
+inline size_t decode_scalar(const uint8_t* p, size_t avail, T* out, size_t n) noexcept {
+    size_t i = 0, r = 0;
+    while (i < n) {
+        uint64_t u = 0;
+        size_t len = decode(p + r, avail - r, u);
+        if (len == 0) { return 0; }
+        out[i++] = from_wire<T>(u);
+        r += len;
+    }
+    return r;
+}
+
+#ifdef SRPC_VARINT_X86
+
+template <typename T>
+__attribute__((target("sse4.1")))
+size_t encode_sse4(const T* in, size_t n, uint8_t* out) noexcept {
+    constexpr size_t lanes = 16 / sizeof(T);
+    size_t i = 0, w = 0;
+    for (; i + lanes <= n; i += lanes) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        if constexpr (sizeof(T) == 4) {
+            if constexpr (std::is_signed_v<T>) { v = _mm_xor_si128(_mm_slli_epi32(v, 1), _mm_srai_epi32(v, 31)); }
+            if (_mm_testz_si128(v, _mm_set1_epi32(~0x7f))) {
+                __m128i b = _mm_shuffle_epi8(v, _mm_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1));
+                uint32_t bytes = _mm_cvtsi128_si32(b);
+                std::memcpy(out + w, &bytes, sizeof(bytes));
+                w += lanes;
+                continue;
+            }
+            if (_mm_testz_si128(v, _mm_set1_epi32(~0x3fff)) &&
+                _mm_testz_si128(_mm_cmpgt_epi32(_mm_set1_epi32(0x80), v), _mm_set1_epi32(-1))) {
+                __m128i two = _mm_or_si128(_mm_or_si128(_mm_and_si128(v, _mm_set1_epi32(0x7f)), _mm_set1_epi32(0x80)),
+                    _mm_slli_epi32(_mm_srli_epi32(v, 7), 8));
+                uint64_t bytes = _mm_cvtsi128_si64(_mm_packus_epi32(two, two));
+                std::memcpy(out + w, &bytes, sizeof(bytes));
+                w += 2 * lanes;
+                continue;
+            }
+        } else {
+            if constexpr (std::is_signed_v<T>) {
+                __m128i sign = _mm_shuffle_epi32(_mm_srai_epi32(v, 31), _MM_SHUFFLE(3, 3, 1, 1));
+                v = _mm_xor_si128(_mm_slli_epi64(v, 1), sign);
+            }
+            if (_mm_testz_si128(v, _mm_set1_epi64x(~0x7fll))) {
+                uint16_t bytes = _mm_extract_epi16(_mm_shuffle_epi8(v, _mm_setr_epi8(0, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)), 0);
+                std::memcpy(out + w, &bytes, sizeof(bytes));
+                w += lanes;
+                continue;
+            }
+            // the high halves are zero below 2^14, comparing the low ones is enough
+            if (_mm_testz_si128(v, _mm_set1_epi64x(~0x3fffll)) &&
+                _mm_testz_si128(_mm_cmpgt_epi32(_mm_set1_epi64x(0x80), v), _mm_set1_epi32(-1))) {
+                __m128i two = _mm_or_si128(_mm_or_si128(_mm_and_si128(v, _mm_set1_epi64x(0x7f)), _mm_set1_epi64x(0x80)),
+                    _mm_slli_epi64(_mm_srli_epi64(v, 7), 8));
+                uint32_t bytes = _mm_cvtsi128_si32(_mm_shuffle_epi8(two, _mm_setr_epi8(0, 1, 8, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)));
+                std::memcpy(out + w, &bytes, sizeof(bytes));
+                w += 2 * lanes;
+                continue;
+            }
+        }
+        w += encode_scalar(in + i, lanes, out + w);
+    }
+    return w + encode_scalar(in + i, n - i, out + w);
+}
+
+template <typename T>
+__attribute__((target("avx2")))
+size_t encode_avx2(const T* in, size_t n, uint8_t* out) noexcept {
+    constexpr size_t lanes = 32 / sizeof(T);
+    size_t i = 0, w = 0;
+    for (; i + lanes <= n; i += lanes) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+        if constexpr (sizeof(T) == 4) {
+            if constexpr (std::is_signed_v<T>) { v = _mm256_xor_si256(_mm256_slli_epi32(v, 1), _mm256_srai_epi32(v, 31)); }
+            if (_mm256_testz_si256(v, _mm256_set1_epi32(~0x7f))) {
+                __m256i b = _mm256_shuffle_epi8(v, _mm256_setr_epi8(
+                    0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                    0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1));
+                uint32_t lo = _mm256_extract_epi32(b, 0), hi = _mm256_extract_epi32(b, 4);
+                std::memcpy(out + w, &lo, sizeof(lo));
+                std::memcpy(out + w + 4, &hi, sizeof(hi));
+                w += lanes;
+                continue;
+            }
+            if (_mm256_testz_si256(v, _mm256_set1_epi32(~0x3fff)) &&
+                _mm256_testz_si256(_mm256_cmpgt_epi32(_mm256_set1_epi32(0x80), v), _mm256_set1_epi32(-1))) {
+                __m256i two = _mm256_or_si256(_mm256_or_si256(_mm256_and_si256(v, _mm256_set1_epi32(0x7f)), _mm256_set1_epi32(0x80)),
+                    _mm256_slli_epi32(_mm256_srli_epi32(v, 7), 8));
+                __m256i packed = _mm256_packus_epi32(two, two);
+                uint64_t lo = _mm256_extract_epi64(packed, 0), hi = _mm256_extract_epi64(packed, 2);
+                std::memcpy(out + w, &lo, sizeof(lo));
+                std::memcpy(out + w + 8, &hi, sizeof(hi));
+                w += 2 * lanes;
+                continue;
+            }
+        } else {
+            if constexpr (std::is_signed_v<T>) {
+                __m256i sign = _mm256_shuffle_epi32(_mm256_srai_epi32(v, 31), _MM_SHUFFLE(3, 3, 1, 1));
+                v = _mm256_xor_si256(_mm256_slli_epi64(v, 1), sign);
+            }
+            if (_mm256_testz_si256(v, _mm256_set1_epi64x(~0x7fll))) {
+                __m256i b = _mm256_shuffle_epi8(v, _mm256_setr_epi8(
+                    0, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                    0, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1));
+                uint16_t lo = _mm256_extract_epi16(b, 0), hi = _mm256_extract_epi16(b, 8);
+                std::memcpy(out + w, &lo, sizeof(lo));
+                std::memcpy(out + w + 2, &hi, sizeof(hi));
+                w += lanes;
+                continue;
+            }
+            // the high halves are zero below 2^14, comparing the low ones is enough
+            if (_mm256_testz_si256(v, _mm256_set1_epi64x(~0x3fffll)) &&
+                _mm256_testz_si256(_mm256_cmpgt_epi32(_mm256_set1_epi64x(0x80), v), _mm256_set1_epi32(-1))) {
+                __m256i two = _mm256_or_si256(_mm256_or_si256(_mm256_and_si256(v, _mm256_set1_epi64x(0x7f)), _mm256_set1_epi64x(0x80)),
+                    _mm256_slli_epi64(_mm256_srli_epi64(v, 7), 8));
+                __m256i b = _mm256_shuffle_epi8(two, _mm256_setr_epi8(
+                    0, 1, 8, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                    0, 1, 8, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1));
+                uint32_t lo = _mm256_extract_epi32(b, 0), hi = _mm256_extract_epi32(b, 4);
+                std::memcpy(out + w, &lo, sizeof(lo));
+                std::memcpy(out + w + 4, &hi, sizeof(hi));
+                w += 2 * lanes;
+                continue;
+            }
+        }
+        w += encode_scalar(in + i, lanes, out + w);
+    }
+    return w + encode_scalar(in + i, n - i, out + w);
+}
+
+/// Undoes zigzag in every lane of u when T is signed.
+template <typename T>
+__attribute__((target("sse4.1"), always_inline))
+inline __m128i unzigzag_lanes(__m128i u) noexcept {
+    if constexpr (sizeof(T) == 4 && std::is_signed_v<T>) {
+        return _mm_xor_si128(_mm_srli_epi32(u, 1), _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(u, _mm_set1_epi32(1))));
+    } else if constexpr (std::is_signed_v<T>) {
+        return _mm_xor_si128(_mm_srli_epi64(u, 1), _mm_sub_epi64(_mm_setzero_si128(), _mm_and_si128(u, _mm_set1_epi64x(1))));
+    } else {
+        return u;
+    }
+}
+
+template <typename T>
+__attribute__((target("avx2"), always_inline))
+inline __m256i unzigzag_lanes(__m256i u) noexcept {
+    if constexpr (sizeof(T) == 4 && std::is_signed_v<T>) {
+        return _mm256_xor_si256(_mm256_srli_epi32(u, 1), _mm256_sub_epi32(_mm256_setzero_si256(), _mm256_and_si256(u, _mm256_set1_epi32(1))));
+    } else if constexpr (std::is_signed_v<T>) {
+        return _mm256_xor_si256(_mm256_srli_epi64(u, 1), _mm256_sub_epi64(_mm256_setzero_si256(), _mm256_and_si256(u, _mm256_set1_epi64x(1))));
+    } else {
+        return u;
+    }
+}
+
+/// Decoders look ahead one register of bytes: a run of bytes without continuation bits
+/// is a run of one-byte varints, alternating continuation bits a run of two-byte ones.
+/// Either is widened to integers in place; anything else is decoded one value at a time.
+template <typename T>
+__attribute__((target("sse4.1")))
+size_t decode_sse4(const uint8_t* p, size_t avail, T* out, size_t n) noexcept {
+    constexpr size_t widen = 16 / sizeof(T); // values per conversion
+
+    size_t i = 0, r = 0;
+    while (i < n) {
+        if (avail - r >= 16) {
+            uint32_t stops = _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + r)));
+            size_t ones = std::min<size_t>(std::countr_zero(stops | 0x10000u), n - i) / widen * widen;
+            for (size_t k = 0; k < ones; k += widen) {
+                __m128i u;
+                if constexpr (sizeof(T) == 4) {
+                    uint32_t bytes;
+                    std::memcpy(&bytes, p + r + k, sizeof(bytes));
+                    u = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(bytes));
+                } else {
+                    uint16_t bytes;
+                    std::memcpy(&bytes, p + r + k, sizeof(bytes));
+                    u = _mm_cvtepu8_epi64(_mm_cvtsi32_si128(bytes));
+                }
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + k), unzigzag_lanes<T>(u));
+            }
+            if (ones > 0) {
+                i += ones;
+                r += ones;
+                continue;
+            }
+
+            size_t twos = std::min<size_t>(std::countr_zero((stops ^ 0x5555u) | 0x10000u) / 2, n - i) / widen * widen;
+            for (size_t k = 0; k < twos; k += widen) {
+                __m128i x;
+                if constexpr (sizeof(T) == 4) {
+                    x = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p + r + 2 * k)));
+                } else {
+                    uint32_t bytes;
+                    std::memcpy(&bytes, p + r + 2 * k, sizeof(bytes));
+                    x = _mm_cvtepu16_epi64(_mm_cvtsi32_si128(bytes));
+                }
+                __m128i u = _mm_or_si128(_mm_and_si128(x, _mm_set1_epi32(0x7f)), _mm_and_si128(_mm_srli_epi32(x, 1), _mm_set1_epi32(0x3f80)));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + k), unzigzag_lanes<T>(u));
+            }
+            if (twos > 0) {
+                i += twos;
+                r += 2 * twos;
+                continue;
+            }
+        }
+        uint64_t u = 0;
+        size_t len = decode(p + r, avail - r, u);
+        if (len == 0) { return 0; }
+        out[i++] = from_wire<T>(u);
+        r += len;
+    }
+    return r;
+}
+
+template <typename T>
+__attribute__((target("avx2")))
+size_t decode_avx2(const uint8_t* p, size_t avail, T* out, size_t n) noexcept {
+    constexpr size_t widen = 32 / sizeof(T); // values per conversion
+
+    size_t i = 0, r = 0;
+    while (i < n) {
+        if (avail - r >= 32) {
+            uint64_t stops = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + r))));
+            size_t ones = std::min<size_t>(std::countr_zero(stops | (uint64_t{1} << 32)), n - i) / widen * widen;
+            for (size_t k = 0; k < ones; k += widen) {
+                __m256i u;
+                if constexpr (sizeof(T) == 4) {
+                    u = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p + r + k)));
+                } else {
+                    uint32_t bytes;
+                    std::memcpy(&bytes, p + r + k, sizeof(bytes));
+                    u = _mm256_cvtepu8_epi64(_mm_cvtsi32_si128(bytes));
+                }
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i + k), unzigzag_lanes<T>(u));
+            }
+            if (ones > 0) {
+                i += ones;
+                r += ones;
+                continue;
+            }
+
+            size_t twos = std::min<size_t>(std::countr_zero((stops ^ 0x55555555u) | (uint64_t{1} << 32)) / 2, n - i) / widen * widen;
+            for (size_t k = 0; k < twos; k += widen) {
+                __m256i x;
+                if constexpr (sizeof(T) == 4) {
+                    x = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + r + 2 * k)));
+                } else {
+                    x = _mm256_cvtepu16_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p + r + 2 * k)));
+                }
+                __m256i u = _mm256_or_si256(_mm256_and_si256(x, _mm256_set1_epi32(0x7f)), _mm256_and_si256(_mm256_srli_epi32(x, 1), _mm256_set1_epi32(0x3f80)));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i + k), unzigzag_lanes<T>(u));
+            }
+            if (twos > 0) {
+                i += twos;
+                r += 2 * twos;
+                continue;
+            }
+        }
+        uint64_t u = 0;
+        size_t len = decode(p + r, avail - r, u);
+        if (len == 0) { return 0; }
+        out[i++] = from_wire<T>(u);
+        r += len;
+    }
+    return r;
+}
+
+#endif // SRPC_VARINT_X86
+
+} // namespace detail
+
+/// @param out  room for n * VARINT_MAX_BYTES, or exactly as many bytes as the values encode to
+/// @return number of bytes written
+template <array_element T>
+size_t encode_array(const T* in, size_t n, uint8_t* out, simd level = cpu_simd()) noexcept {
+#ifdef SRPC_VARINT_X86
+    if (level == simd::AVX2) { return detail::encode_avx2(in, n, out); }
+    if (level == simd::SSE4) { return detail::encode_sse4(in, n, out); }
+#endif
+    return detail::encode_scalar(in, n, out);
+}
+
+/// @param p        encoded bytes
+/// @param avail    bytes readable from p
+/// @param out      room for n values
+/// @return number of bytes consumed, 0 if p does not hold n complete varints
+template <array_element T>
+size_t decode_array(const uint8_t* p, size_t avail, T* out, size_t n, simd level = cpu_simd()) noexcept {
+#ifdef SRPC_VARINT_X86
+    if (level == simd::AVX2) { return detail::decode_avx2(p, avail, out, n); }
+    if (level == simd::SSE4) { return detail::decode_sse4(p, avail, out, n); }
+#endif
+    return detail::decode_scalar(p, avail, out, n);
+}
+
+} // namespace varint
+
+} // namespace srpc
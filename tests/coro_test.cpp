@@ -0,0 +1,86 @@
+#include <srpc/coro.hpp>
+
+#include <vector>
+#include <stdexcept>
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/catch_message.hpp>
+
+namespace srpc {
+
+/// Runs posted functions when asked to, like a reactor's loop would.
+struct manual_scheduler : scheduler {
+    void post(std::function<void()> fn) override { queue.push_back(std::move(fn)); }
+
+    void run() {
+        while (!queue.empty()) {
+            auto fn = std::move(queue.front());
+            queue.erase(queue.begin());
+            fn();
+        }
+    }
+
+    std::vector<std::function<void()>> queue;
+};
+
+task<int> add_one(int v) { co_return v + 1; }
+
+task<int> add_two(int v) {
+    int once = co_await add_one(v);
+    co_return co_await add_one(once);
+}
+
+task<int> fails() {
+    throw std::runtime_error("boom");
+    co_return 0;
+}
+
+TEST_CASE("tasks await tasks", "[coro]") {
+    std::optional<int> result;
+    add_two(40).start([&result] (std::optional<int> v) { result = v; }, nullptr);
+    REQUIRE(result == 42);
+}
+
+TEST_CASE("detached task reports exceptions as nullopt", "[coro]") {
+    bool called = false;
+    std::optional<int> result = 7;
+    fails().start([&] (std::optional<int> v) { called = true; result = v; }, nullptr);
+    REQUIRE(called);
+    REQUIRE(!result.has_value());
+}
+
+TEST_CASE("callback awaitable resumes on the scheduler", "[coro]") {
+    manual_scheduler sched;
+    std::function<void(int)> complete;
+
+    auto waiter = [&complete] () -> task<int> {
+        int v = co_await callback_awaitable<int>([&complete] (std::function<void(int)> done) { 
+            complete = std::move(done); 
+        });
+        co_return v * 2;
+    };
+
+    std::optional<int> result;
+    waiter().start([&result] (std::optional<int> v) { result = v; }, &sched);
+    REQUIRE(!result.has_value());
+
+    complete(21);                   // as if the response arrived on another thread
+    REQUIRE(!result.has_value());   // not resumed yet, only posted
+    REQUIRE(sched.queue.size() == 1);
+
+    sched.run();
+    REQUIRE(result == 42);
+}
+
+TEST_CASE("callback awaitable completed before suspending does not suspend", "[coro]") {
+    auto waiter = [] () -> task<int> {
+        co_return co_await callback_awaitable<int>([] (std::function<void(int)> done) { done(5); });
+    };
+
+    manual_scheduler sched;
+    std::optional<int> result;
+    waiter().start([&result] (std::optional<int> v) { result = v; }, &sched);
+    REQUIRE(result == 5);
+    REQUIRE(sched.queue.empty());
+}
+
+} // namespace srpc
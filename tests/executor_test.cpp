@@ -0,0 +1,78 @@
+#include <srpc/executor.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <stdexcept>
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/catch_message.hpp>
+
+namespace srpc {
+
+void wait_for_executed(work_stealing_executor& ex, uint64_t n) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (ex.executed_count() < n && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+TEST_CASE("executor runs submitted tasks", "[executor]") {
+    constexpr int32_t n_tasks = 1000;
+
+    work_stealing_executor ex(4);
+    std::atomic<int32_t> sum = 0;
+    for (int32_t i = 0; i < n_tasks; i++) {
+        ex.submit([&sum, i] () { sum += i; });
+    }
+    wait_for_executed(ex, n_tasks);
+
+    REQUIRE(ex.worker_count() == 4);
+    REQUIRE(ex.executed_count() == n_tasks);
+    REQUIRE(ex.queue_depth() == 0);
+    REQUIRE(sum == n_tasks * (n_tasks - 1) / 2);
+}
+
+TEST_CASE("idle workers steal from a busy worker", "[executor][steal]") {
+    constexpr int32_t n_tasks = 64;
+
+    work_stealing_executor ex(4);
+    std::atomic<int32_t> done = 0;
+
+    // tasks submitted from a worker land on that worker's own deque
+    ex.submit([&ex, &done] () {
+        for (int32_t i = 0; i < n_tasks; i++) {
+            ex.submit([&done] () {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                done++;
+            });
+        }
+    });
+    wait_for_executed(ex, n_tasks + 1);
+
+    REQUIRE(done == n_tasks);
+    REQUIRE(ex.steal_count() > 0);
+}
+
+TEST_CASE("a throwing task leaves its worker running", "[executor]") {
+    work_stealing_executor ex(1);
+    std::atomic<int32_t> done = 0;
+    ex.submit([] () { throw std::runtime_error("task failed"); });
+    ex.submit([&done] () { done++; });
+    wait_for_executed(ex, 2);
+
+    REQUIRE(ex.executed_count() == 2);
+    REQUIRE(done == 1);
+}
+
+TEST_CASE("executor drains queue on destruction", "[executor]") {
+    std::atomic<int32_t> done = 0;
+    {
+        work_stealing_executor ex(2);
+        for (int32_t i = 0; i < 100; i++) {
+            ex.submit([&done] () { done++; });
+        }
+    }
+    REQUIRE(done == 100);
+}
+
+} // namespace srpc
@@ -44,11 +44,18 @@ TEST_CASE("generate header file message", "[generate][message]") {
                 STRUCT_MEMBER(Request, arg1, "Request::arg1"),
                 STRUCT_MEMBER(Request, arg2, "Request::arg2")
             );
-            void unpack(srpc::buffer::ptr bp) override {
-                srpc::packer p(bp);
+            void encode(srpc::packer& p) const {
+                p << arg1;
+                p << arg2;
+            }
+            void decode(srpc::packer& p) {
                 p >> arg1;
                 p >> arg2;
             }
+            constexpr size_t encoded_size(srpc::wire_format f) const noexcept {
+                return srpc::packer::encoded_size(arg1, f)
+                    + srpc::packer::encoded_size(arg2, f);
+            }
         };
         )");
 
@@ -89,18 +96,282 @@ TEST_CASE("generate header file message", "[generate][message]") {
                 STRUCT_MEMBER(request, arg2, "request::arg2"),
                 STRUCT_MEMBER(request, arg3, "request::arg3")
             );
-            void unpack(srpc::buffer::ptr bp) override {
-                srpc::packer p(bp);
+            void encode(srpc::packer& p) const {
+                p << arg1;
+                p << arg2;
+                p << arg3;
+            }
+            void decode(srpc::packer& p) {
                 p >> arg1;
                 p >> arg2;
-                arg3 = *(p->getv());
+                p >> arg3;
+            }
+            constexpr size_t encoded_size(srpc::wire_format f) const noexcept {
+                return srpc::packer::encoded_size(arg1, f)
+                    + srpc::packer::encoded_size(arg2, f)
+                    + srpc::packer::encoded_size(arg3, f);
             }
         };)");
 
-        REQUIRE(res == expected); 
+        REQUIRE(res == expected);
+    }
+
+    SECTION("fixed-layout message") {
+        contract::elements.clear();
+        contract::element_index_map.clear();
+        std::string input = R"(
+            message point {
+                int32 x;
+                int64 y;
+            }
+            message segment {
+                bool closed;
+                point from;
+                point to;
+            }
+        )";
+        lexer l(input);
+        parser p(l);
+        p.parse_contract();
+        REQUIRE(p.errors().size() == 0);
+
+        auto msg = dynamic_pointer_cast<message>(contract::elements[contract::element_index_map["segment"]]);
+        std::string res = remove_whitespace(generator::handle_message(msg));
+
+        std::string expected = remove_whitespace(R"(
+        struct segment : public srpc::message_base {
+            bool closed;
+            point from;
+            point to;
+
+            // overrides
+            static constexpr const char* name = "segment";
+            static constexpr auto fields = std::make_tuple(
+                STRUCT_MEMBER(segment, closed, "segment::closed"),
+                STRUCT_MEMBER(segment, from, "segment::from"),
+                STRUCT_MEMBER(segment, to, "segment::to")
+            );
+            void encode(srpc::packer& p) const {
+                p << closed;
+                p << from;
+                p << to;
+            }
+            void decode(srpc::packer& p) {
+                p >> closed;
+                p >> from;
+                p >> to;
+            }
+            constexpr size_t encoded_size(srpc::wire_format f) const noexcept {
+                if (f == srpc::wire_format::FIXED) { return wire_size; }
+                return srpc::packer::encoded_size(closed, f)
+                    + srpc::packer::encoded_size(from, f)
+                    + srpc::packer::encoded_size(to, f);
+            }
+
+            // fixed layout
+            static constexpr size_t wire_size = 25;
+            void encode_to(uint8_t* out) const {
+                std::memcpy(out + 0, &closed, sizeof(closed));
+                from.encode_to(out + 1);
+                to.encode_to(out + 13);
+            }
+            void decode_from(const uint8_t* in) {
+                std::memcpy(&closed, in + 0, sizeof(closed));
+                from.decode_from(in + 1);
+                to.decode_from(in + 13);
+            }
+        };)");
+
+        REQUIRE(res == expected);
+        REQUIRE(generator::fixed_wire_size("point") == 12);
+    }
+
+    SECTION("repeated fields") {
+        contract::elements.clear();
+        contract::element_index_map.clear();
+        std::string input = R"(
+            message point {
+                int32 x;
+            }
+            message path {
+                repeated point points;
+                repeated int64 stamps;
+            }
+        )";
+        lexer l(input);
+        parser p(l);
+        p.parse_contract();
+        REQUIRE(p.errors().size() == 0);
+
+        auto msg = dynamic_pointer_cast<message>(contract::elements[contract::element_index_map["path"]]);
+        std::string res = remove_whitespace(generator::handle_message(msg));
+
+        std::string expected = remove_whitespace(R"(
+        struct path : public srpc::message_base {
+            std::vector<point> points;
+            std::vector<int64_t> stamps;
+
+            // overrides
+            static constexpr const char* name = "path";
+            static constexpr auto fields = std::make_tuple(
+                STRUCT_MEMBER(path, points, "path::points"),
+                STRUCT_MEMBER(path, stamps, "path::stamps")
+            );
+            void encode(srpc::packer& p) const {
+                p << points;
+                p << stamps;
+            }
+            void decode(srpc::packer& p) {
+                p >> points;
+                p >> stamps;
+            }
+            constexpr size_t encoded_size(srpc::wire_format f) const noexcept {
+                return srpc::packer::encoded_size(points, f)
+                    + srpc::packer::encoded_size(stamps, f);
+            }
+        };)");
+
+        REQUIRE(res == expected);
+        REQUIRE(generator::fixed_wire_size("path") == 0);
+
+        std::string view = remove_whitespace(generator::handle_message_view(msg));
+        REQUIRE(view.find("std::vector<point_view>points;") != std::string::npos);
+        REQUIRE(view.find("std::vector<int64_t>stamps;") != std::string::npos);
+    }
+
+    SECTION("unsigned, floating point and bytes") {
+        contract::elements.clear();
+        contract::element_index_map.clear();
+        std::string input = R"(
+            message tick {
+                uint16 venue;
+                double price;
+                float size;
+            }
+            message blob {
+                uint64 id;
+                bytes data;
+            }
+        )";
+        lexer l(input);
+        parser p(l);
+        p.parse_contract();
+        REQUIRE(p.errors().size() == 0);
+
+        REQUIRE(generator::fixed_wire_size("tick") == 14);
+        REQUIRE(generator::fixed_wire_size("blob") == 0);
+
+        auto msg = dynamic_pointer_cast<message>(contract::elements[contract::element_index_map["blob"]]);
+        std::string res = remove_whitespace(generator::handle_message(msg));
+        REQUIRE(res.find("uint64_tid;std::vector<uint8_t>data;") != std::string::npos);
+
+        std::string view = remove_whitespace(generator::handle_message_view(msg));
+        REQUIRE(view.find("uint64_tid;std::span<constuint8_t>data;") != std::string::npos);
+    }
+
+    SECTION("map fields") {
+        contract::elements.clear();
+        contract::element_index_map.clear();
+        std::string input = R"(
+            message point {
+                int32 x;
+            }
+            message atlas {
+                map<string, point> places;
+            }
+        )";
+        lexer l(input);
+        parser p(l);
+        p.parse_contract();
+        REQUIRE(p.errors().size() == 0);
+
+        auto msg = dynamic_pointer_cast<message>(contract::elements[contract::element_index_map["atlas"]]);
+        std::string res = remove_whitespace(generator::handle_message(msg));
+        REQUIRE(res.find("std::unordered_map<std::string,point>places;") != std::string::npos);
+        REQUIRE(res.find("wire_size") == std::string::npos);
+
+        std::string view = remove_whitespace(generator::handle_message_view(msg));
+        REQUIRE(view.find("std::unordered_map<std::string_view,point_view>places;") != std::string::npos);
+    }
+
+    SECTION("arena fields") {
+        contract::elements.clear();
+        contract::element_index_map.clear();
+        std::string input = R"(
+            message upload {
+                arena string name;
+                arena bytes data;
+                int32 size;
+            }
+        )";
+        lexer l(input);
+        parser p(l);
+        p.parse_contract();
+        REQUIRE(p.errors().size() == 0);
+
+        auto msg = dynamic_pointer_cast<message>(contract::elements[contract::element_index_map["upload"]]);
+        std::string res = remove_whitespace(generator::handle_message(msg));
+        REQUIRE(res.find(remove_whitespace(R"(
+            std::pmr::string name;
+            std::pmr::vector<uint8_t> data;
+            int32_t size;
+
+            // arena fields
+            using allocator_type = std::pmr::polymorphic_allocator<>;
+            upload() = default;
+            explicit upload(allocator_type alloc) : name(alloc), data(alloc) {}
+            allocator_type get_allocator() const noexcept { return name.get_allocator(); }
+        )")) != std::string::npos);
+
+        std::string view = remove_whitespace(generator::handle_message_view(msg));
+        REQUIRE(view.find("std::string_viewname;std::span<constuint8_t>data;") != std::string::npos);
     }
 }
 
+TEST_CASE("generate header file message view", "[generate][message][view]") {
+    contract::elements.clear();
+    contract::element_index_map.clear();
+    std::string input = R"(
+        message nested_request {
+            bool random_flag;
+        }
+        message request {
+            string arg1;
+            int32 arg2;
+            nested_request arg3;
+        }
+    )";
+    lexer l(input);
+    parser p(l); 
+    p.parse_contract();
+    REQUIRE(p.errors().size() == 0);
+
+    auto msg = dynamic_pointer_cast<message>(contract::elements[contract::element_index_map["request"]]);
+    std::string res = remove_whitespace(generator::handle_message_view(msg));
+
+    std::string expected = remove_whitespace(R"(
+    struct request_view : public srpc::message_base {
+        std::string_view arg1;
+        int32_t arg2;
+        nested_request_view arg3;
+
+        // overrides
+        static constexpr const char* name = "request";
+        static constexpr auto fields = std::make_tuple(
+            STRUCT_MEMBER(request_view, arg1, "request::arg1"),
+            STRUCT_MEMBER(request_view, arg2, "request::arg2"),
+            STRUCT_MEMBER(request_view, arg3, "request::arg3")
+        );
+        void decode(srpc::packer& p) {
+            p >> arg1;
+            p >> arg2;
+            p >> arg3;
+        }
+    };)");
+
+    REQUIRE(res == expected); 
+}
+
 TEST_CASE("generate header file service", "[generate][service]") {
     SECTION("single method") {
         contract::elements.clear();
@@ -116,51 +387,64 @@ TEST_CASE("generate header file service", "[generate][service]") {
         REQUIRE(p.errors().size() == 0);
 
         std::string expected = remove_whitespace(R"(
+        struct my_service_method_ids {
+            static constexpr uint32_t some_method = 0;
+        };
+
         struct my_service_stub {
-	        my_service_stub() {
-	        	if (!_init) {
-	        		srpc::message_registry["request"] = []() -> std::unique_ptr<request> { 
-                        return std::make_unique<request>(); 
-                    };
-	        		srpc::message_registry["response"] = []() -> std::unique_ptr<response> { 
-                        return std::make_unique<response>(); 
-                    };
-	        	}
-	        	_init = true;
-	        }
 
 	        void register_insecure_channel(std::string server_ip, std::string port) {
-	        	if (_socket != -1) { close(_socket); }
-	        	_socket = srpc::transport::create_client_socket(server_ip, port);
+	        	_channel = srpc::channel::create(server_ip, port);
 	        }
 
-            response some_method(request& req) {
-                srpc::packer pr;
-                srpc::request_t<request> request;
-                request.set_method_name("my_service_servicer::some_method");
-                request.set_value(std::move(req));
-                pr.pack_request(request);
+	        void register_channel(srpc::channel::ptr channel) {
+	        	_channel = std::move(channel);
+	        }
+
+            response some_method(const request& req) {
+                srpc::packer pr(_channel->format());
+                pr.set_chained(true);
+                pr.pack_request(my_service_method_ids::some_method, req);
 
-		        srpc::transport::send_data(_socket, (*pr.buf()).data(), pr.size());
-                srpc::message_t res = srpc::transport::recv_data(_socket);
-                srpc::packer rpr(res.data(), res.size());
+                srpc::message_t res = _channel->call(pr.release_chain());
+                srpc::packer rpr(std::move(res), pr.format());
         
-        		srpc::response_t<response> msg = rpr.unpack_response<response>(); 
-        		return msg.value();
+        		return rpr.unpack_response<response>().take_value();
         	}
 
+            void some_method_async(const request& req, std::function<void(response)> done) {
+                srpc::packer pr(_channel->format());
+                pr.set_chained(true);
+                pr.pack_request(my_service_method_ids::some_method, req);
+
+                _channel->call_then(pr.release_chain(), [done = std::move(done), format = pr.format()] (srpc::message_t res) {
+                    srpc::packer rpr(std::move(res), format);
+                    done(rpr.unpack_response<response>().take_value());
+                });
+            }
+
+            std::future<response> some_method_async(const request& req) {
+                auto p = std::make_shared<std::promise<response>>();
+                std::future<response> f = p->get_future();
+                some_method_async(req, [p] (response v) { p->set_value(std::move(v)); });
+                return f;
+            }
+
+            srpc::callback_awaitable<response> some_method_co(const request& req) {
+                return srpc::callback_awaitable<response>([this, req] (std::function<void(response)> done) mutable {
+                    some_method_async(req, std::move(done));
+                });
+            }
+
         private:
-        	static bool _init;
-	        int32_t     _socket= -1;
+	        srpc::channel::ptr _channel;
         };
         
-        inline bool my_service_stub::_init = false;
-        
         struct my_service_servicer : srpc::servicer_base {
-        	virtual response some_method(request& req) { throw std::runtime_error("Method not implemented!"); }
+        	virtual response some_method([[maybe_unused]] request& req) { throw std::runtime_error("Method not implemented!"); }
             static constexpr const char* name = "my_service";
             static constexpr auto methods = std::make_tuple(
-                STRUCT_MEMBER(my_service_servicer, some_method, "my_service_servicer::some_method")
+                SERVICE_METHOD(my_service_servicer, some_method, "my_service_servicer::some_method", my_service_method_ids::some_method)
             );
         };
         )");
@@ -170,6 +454,34 @@ TEST_CASE("generate header file service", "[generate][service]") {
         REQUIRE(res == expected); 
     }
 
+    SECTION("view inputs") {
+        contract::elements.clear();
+        contract::element_index_map.clear();
+        std::string input = R"(
+        message request {
+            string view;
+        }
+        message response {
+            int32 length;
+        }
+        service my_service {
+            method measure(view request) returns (response);
+        }
+        )";
+        lexer l(input);
+        parser p(l); 
+        p.parse_contract();
+        REQUIRE(p.errors().size() == 0);
+
+        auto svc = dynamic_pointer_cast<service>(contract::elements[contract::element_index_map["my_service"]]);
+        REQUIRE(svc->methods()[0]->view_input);
+        REQUIRE(svc->methods()[0]->input_t == "request");
+        std::string res = remove_whitespace(generator::handle_service(svc));
+        REQUIRE(res.find("responsemeasure(constrequest&req){") != std::string::npos); // the stub sends the message
+        REQUIRE(res.find(remove_whitespace(
+            "virtual response measure([[maybe_unused]] request_view& req)")) != std::string::npos);
+    }
+
     SECTION("generated message") {
         contract::elements.clear();
         contract::element_index_map.clear();
@@ -12,16 +12,20 @@ struct expected {
 };
 
 TEST_CASE("Symbol Test", "[symbol]") {
-    std::string input = "{}";
+    std::string input = "{}<,>=";
     std::vector<expected> test_case = {
         {token_t::LBRACE, "{"},
         {token_t::RBRACE, "}"},
+        {token_t::LANGLE, "<"},
+        {token_t::COMMA, ","},
+        {token_t::RANGLE, ">"},
+        {token_t::EQUALS, "="},
         {token_t::EOFT, ""}
     };
 
     lexer l(input);
     token cur_token;
-    for (int i = 0; i < test_case.size(); i++) {
+    for (size_t i = 0; i < test_case.size(); i++) {
         cur_token = l.next_token();
         INFO("token number: "<<i);
         // CAPTURE(l._input, l._input_len, l._cursor, l._peek_cursor, l._cur_char);
@@ -31,7 +35,7 @@ TEST_CASE("Symbol Test", "[symbol]") {
 }
 
 TEST_CASE("Keyword Test", "[keyword]") {
-    std::string input = "service message int8 int16 int32 int64 char string";
+    std::string input = "service message int8 int16 int32 int64 char string repeated map arena uint8 uint16 uint32 uint64 float double bytes";
     std::vector<expected> test_case = {
         {token_t::SERVICE, "service"},
         {token_t::MESSAGE, "message"},
@@ -41,12 +45,22 @@ TEST_CASE("Keyword Test", "[keyword]") {
         {token_t::INT64_T, "int64"},
         {token_t::CHAR_T, "char"},
         {token_t::STRING_T, "string"},
+        {token_t::REPEATED, "repeated"},
+        {token_t::MAP, "map"},
+        {token_t::ARENA, "arena"},
+        {token_t::UINT8_T, "uint8"},
+        {token_t::UINT16_T, "uint16"},
+        {token_t::UINT32_T, "uint32"},
+        {token_t::UINT64_T, "uint64"},
+        {token_t::FLOAT_T, "float"},
+        {token_t::DOUBLE_T, "double"},
+        {token_t::BYTES_T, "bytes"},
         {token_t::EOFT, ""},
     };
 
     lexer l(input);
     token cur_token;
-    for (int i = 0; i < test_case.size(); i++) {
+    for (size_t i = 0; i < test_case.size(); i++) {
         cur_token = l.next_token();
         INFO("token number: "<<i);
         // CAPTURE(l._input, l._input_len, l._cursor, l._peek_cursor, l._cur_char);
@@ -87,7 +101,7 @@ TEST_CASE("Message", "[message]") {
 
         lexer l(input);
         token cur_token;
-        for (int i = 0; i < test_case.size(); i++) {
+        for (size_t i = 0; i < test_case.size(); i++) {
             cur_token = l.next_token();
             INFO("token number: "<<i);
             // CAPTURE(l._input, l._input_len, l._cursor, l._peek_cursor, l._cur_char);
@@ -126,7 +140,7 @@ TEST_CASE("Service", "[service]") {
 
         lexer l(input);
         token cur_token;
-        for (int i = 0; i < test_case.size(); i++) {
+        for (size_t i = 0; i < test_case.size(); i++) {
             cur_token = l.next_token();
             INFO("token number: "<<i);
             // CAPTURE(l._input, l._input_len, l._cursor, l._peek_cursor, l._cur_char);
@@ -1,5 +1,7 @@
 #include <cstdint>
 #include <limits>
+#include <map>
+#include <unordered_map>
 #include <srpc/core.hpp>
 #include <srpc/packer.hpp>
 
@@ -18,10 +20,6 @@ struct single_primitive : public message_base {
     );
 
     constexpr bool operator==(const single_primitive& other) const noexcept { return arg1 == other.arg1; }
-    void unpack(buffer::ptr bp) override {
-        packer p(bp);
-        p >> arg1;
-    }
 };
 
 struct multiple_primitives : public message_base { 
@@ -45,14 +43,6 @@ struct multiple_primitives : public message_base {
             arg3 == other.arg3 &&
             arg4 == other.arg4; 
     }
-
-    void unpack(buffer::ptr bp) override {
-        packer p(bp);
-        p >> arg1;
-        p >> arg2;
-        p >> arg3;
-        p >> arg4;
-    }
 };
 
 struct nested_message : public message_base {
@@ -73,21 +63,650 @@ struct nested_message : public message_base {
             arg2 == other.arg2 &&
             arg3 == other.arg3;
     }
+};
 
-    void unpack(buffer::ptr bp) override {
-        packer p(bp);
+/// Shaped like a generated message: has its own codec next to the fields tuple.
+struct coded_message : public message_base {
+    int32_t arg1;
+    single_primitive arg2;
+    int32_t decoded = 0;
+
+    static constexpr const char* name = "coded_message";
+    static constexpr auto fields = std::make_tuple(
+        STRUCT_MEMBER(coded_message, arg1, "coded_message::arg1"),
+        STRUCT_MEMBER(coded_message, arg2, "coded_message::arg2")
+    );
+
+    void encode(packer& p) const {
+        p << arg1;
+        p << arg2;
+    }
+    void decode(packer& p) {
         p >> arg1;
-        
-        single_primitive arg2_;
-        arg2_.unpack(bp);
-        arg2 = std::move(arg2_);
+        p >> arg2;
+        decoded++;
+    }
+};
+
+TEST_CASE("generated codecs are used by static type", "[pack][unpack]") {
+    coded_message m;
+    m.arg1 = 300;
+    m.arg2.arg1 = 9;
+
+    packer pr;
+    response_t<coded_message> res;
+    res.set_value(m);
+    pr.pack_response(res);
+
+    std::vector<uint8_t> packed { 0, 44, 1, 0, 0, 9 };
+    REQUIRE(packed == *pr.buf());
+
+    response_t<coded_message> r = pr.unpack_response<coded_message>();
+    REQUIRE(r.code() == RPC_SUCCESS);
+    REQUIRE(r.value().arg1 == 300);
+    REQUIRE(r.value().arg2 == m.arg2);
+    REQUIRE(r.value().decoded == 1);
+    REQUIRE(pr.size() == 0);
+}
+
+/// Shaped like a generated fixed-layout message.
+struct fixed_message : public message_base {
+    int32_t arg1;
+    int64_t arg2;
+    int32_t copied = 0;
+
+    static constexpr const char* name = "fixed_message";
+    static constexpr auto fields = std::make_tuple(
+        STRUCT_MEMBER(fixed_message, arg1, "fixed_message::arg1"),
+        STRUCT_MEMBER(fixed_message, arg2, "fixed_message::arg2")
+    );
+
+    void encode(packer& p) const {
+        p << arg1;
+        p << arg2;
+    }
+    void decode(packer& p) {
+        p >> arg1;
+        p >> arg2;
+    }
+
+    static constexpr size_t wire_size = 12;
+    void encode_to(uint8_t* out) const {
+        std::memcpy(out + 0, &arg1, sizeof(arg1));
+        std::memcpy(out + 4, &arg2, sizeof(arg2));
+    }
+    void decode_from(const uint8_t* in) {
+        std::memcpy(&arg1, in + 0, sizeof(arg1));
+        std::memcpy(&arg2, in + 4, sizeof(arg2));
+        copied++;
+    }
+};
+
+TEST_CASE("fixed-layout messages are copied whole", "[pack][unpack][fixed]") {
+    fixed_message m;
+    m.arg1 = 300;
+    m.arg2 = -2;
+
+    SECTION("fixed format") {
+        packer pr;
+        pr << m;
+        std::vector<uint8_t> packed { 44, 1, 0, 0, 254, 255, 255, 255, 255, 255, 255, 255 };
+        REQUIRE(packed == *pr.buf());
+
+        fixed_message out;
+        pr >> out;
+        REQUIRE(out.arg1 == 300);
+        REQUIRE(out.arg2 == -2);
+        REQUIRE(out.copied == 1);
+        REQUIRE(pr.size() == 0);
+    }
+
+    SECTION("compact format keeps the field-wise codec") {
+        packer pr(wire_format::COMPACT);
+        pr << m;
+        REQUIRE(pr.size() == 3);
+
+        fixed_message out;
+        pr >> out;
+        REQUIRE(out.arg1 == 300);
+        REQUIRE(out.arg2 == -2);
+        REQUIRE(out.copied == 0);
+    }
+}
+
+TEST_CASE("encoded size matches the packed bytes", "[pack][size]") {
+    nested_message nm;
+    nm.arg1 = -3;
+    nm.arg2.arg1 = 5;
+    nm.arg3.arg1 = 22;
+    nm.arg3.arg2 = 'z';
+    nm.arg3.arg3 = 1 << 20;
+    nm.arg3.arg4 = std::string(3000, 'x');
+
+    fixed_message fm;
+    fm.arg1 = 300;
+    fm.arg2 = -2;
+
+    for (wire_format f : { wire_format::FIXED, wire_format::COMPACT }) {
+        CAPTURE(static_cast<int>(f));
+        packer pr(f);
+        request_t<nested_message> req;
+        req.set_value(nested_message(nm));
+        req.set_method_id(7);
+        pr.pack_request(req);
+        REQUIRE(pr.size() == packer::encoded_size(req.method_id(), f) + packer::encoded_size(nm, f));
+        REQUIRE(pr.buf()->capacity() == pr.size()); // reserved once, up front
+
+        packer fpr(f);
+        fpr << fm;
+        REQUIRE(fpr.size() == packer::encoded_size(fm, f));
+    }
+    static_assert(packer::encoded_size(int64_t{-1}, wire_format::COMPACT) == 1);
+    static_assert(packer::encoded_size(int64_t{-1}, wire_format::FIXED) == 8);
+}
+
+struct repeated_message : public message_base {
+    std::vector<int32_t> arg1;
+    std::vector<std::string> arg2;
+    std::vector<single_primitive> arg3;
+    std::vector<bool> arg4;
+
+    static constexpr const char* name = "repeated_message";
+    static constexpr auto fields = std::make_tuple(
+        STRUCT_MEMBER(repeated_message, arg1, "repeated_message::arg1"),
+        STRUCT_MEMBER(repeated_message, arg2, "repeated_message::arg2"),
+        STRUCT_MEMBER(repeated_message, arg3, "repeated_message::arg3"),
+        STRUCT_MEMBER(repeated_message, arg4, "repeated_message::arg4")
+    );
+};
+
+TEST_CASE("repeated fields", "[pack][unpack][repeated]") {
+    repeated_message m;
+    m.arg1 = { 1, -2, 300 };
+    m.arg2 = { "ab", "" };
+    m.arg3.resize(2);
+    m.arg3[1].arg1 = 9;
+    m.arg4 = { true, false, true };
+
+    SECTION("numbers are one contiguous block") {
+        packer pr;
+        pr << m.arg1;
+        std::vector<uint8_t> packed {
+            3, 0, 0, 0, 0, 0, 0, 0,
+            1, 0, 0, 0, 254, 255, 255, 255, 44, 1, 0, 0
+        };
+        REQUIRE(packed == *pr.buf());
+    }
+
+    for (wire_format f : { wire_format::FIXED, wire_format::COMPACT }) {
+        CAPTURE(static_cast<int>(f));
+        packer pr(f);
+        pr << m;
+        REQUIRE(pr.size() == packer::encoded_size(m, f));
+
+        repeated_message out;
+        out.arg1 = { 7 }; // replaced, not appended to
+        pr >> out;
+        REQUIRE(out.arg1 == m.arg1);
+        REQUIRE(out.arg2 == m.arg2);
+        REQUIRE(out.arg3 == m.arg3);
+        REQUIRE(out.arg4 == m.arg4);
+        REQUIRE(pr.size() == 0);
+    }
+
+    SECTION("count larger than the message") {
+        packer pr;
+        pr << size_t{1000} << int32_t{1};
+        std::vector<int32_t> out;
+        pr >> out;
+        REQUIRE(out.empty());
+        REQUIRE(pr.size() == 0);
+    }
+}
+
+/// Four levels deep, shaped like generated messages: two fixed-layout ones at the
+/// bottom, then repeated and singular nested fields above them.
+struct deep_point : public message_base {
+    int32_t x;
+    int32_t y;
+
+    static constexpr const char* name = "deep_point";
+    static constexpr auto fields = std::make_tuple(
+        STRUCT_MEMBER(deep_point, x, "deep_point::x"),
+        STRUCT_MEMBER(deep_point, y, "deep_point::y")
+    );
+
+    void encode(packer& p) const {
+        p << x;
+        p << y;
+    }
+    void decode(packer& p) {
+        p >> x;
+        p >> y;
+    }
+
+    static constexpr size_t wire_size = 8;
+    void encode_to(uint8_t* out) const {
+        std::memcpy(out + 0, &x, sizeof(x));
+        std::memcpy(out + 4, &y, sizeof(y));
+    }
+    void decode_from(const uint8_t* in) {
+        std::memcpy(&x, in + 0, sizeof(x));
+        std::memcpy(&y, in + 4, sizeof(y));
+    }
+
+    bool operator==(const deep_point& other) const noexcept { return x == other.x && y == other.y; }
+};
+
+struct deep_segment : public message_base {
+    deep_point a;
+    deep_point b;
+
+    static constexpr const char* name = "deep_segment";
+    static constexpr auto fields = std::make_tuple(
+        STRUCT_MEMBER(deep_segment, a, "deep_segment::a"),
+        STRUCT_MEMBER(deep_segment, b, "deep_segment::b")
+    );
+
+    void encode(packer& p) const {
+        p << a;
+        p << b;
+    }
+    void decode(packer& p) {
+        p >> a;
+        p >> b;
+    }
+
+    static constexpr size_t wire_size = 16;
+    void encode_to(uint8_t* out) const {
+        a.encode_to(out + 0);
+        b.encode_to(out + 8);
+    }
+    void decode_from(const uint8_t* in) {
+        a.decode_from(in + 0);
+        b.decode_from(in + 8);
+    }
+
+    bool operator==(const deep_segment& other) const noexcept { return a == other.a && b == other.b; }
+};
+
+struct deep_shape : public message_base {
+    std::string label;
+    std::vector<deep_segment> edges;
+    deep_segment bbox;
+
+    static constexpr const char* name = "deep_shape";
+    static constexpr auto fields = std::make_tuple(
+        STRUCT_MEMBER(deep_shape, label, "deep_shape::label"),
+        STRUCT_MEMBER(deep_shape, edges, "deep_shape::edges"),
+        STRUCT_MEMBER(deep_shape, bbox, "deep_shape::bbox")
+    );
+
+    void encode(packer& p) const {
+        p << label;
+        p << edges;
+        p << bbox;
+    }
+    void decode(packer& p) {
+        p >> label;
+        p >> edges;
+        p >> bbox;
+    }
+
+    bool operator==(const deep_shape& other) const noexcept {
+        return label == other.label && edges == other.edges && bbox == other.bbox;
+    }
+};
+
+struct deep_scene : public message_base {
+    int64_t id;
+    std::vector<deep_shape> shapes;
+    deep_shape root;
+
+    static constexpr const char* name = "deep_scene";
+    static constexpr auto fields = std::make_tuple(
+        STRUCT_MEMBER(deep_scene, id, "deep_scene::id"),
+        STRUCT_MEMBER(deep_scene, shapes, "deep_scene::shapes"),
+        STRUCT_MEMBER(deep_scene, root, "deep_scene::root")
+    );
 
-        multiple_primitives arg3_;
-        arg3_.unpack(bp);
-        arg3 = std::move(arg3_);
+    void encode(packer& p) const {
+        p << id;
+        p << shapes;
+        p << root;
     }
+    void decode(packer& p) {
+        p >> id;
+        p >> shapes;
+        p >> root;
+    }
+};
+
+static deep_segment make_segment(int32_t x1, int32_t y1, int32_t x2, int32_t y2) {
+    deep_segment s;
+    s.a.x = x1;
+    s.a.y = y1;
+    s.b.x = x2;
+    s.b.y = y2;
+    return s;
+}
+
+TEST_CASE("deeply nested messages", "[pack][unpack][nested]") {
+    deep_scene m;
+    m.id = -40000;
+    m.shapes.resize(3);
+    for (size_t i = 0; i < m.shapes.size(); i++) {
+        deep_shape& s = m.shapes[i];
+        s.label = "shape" + std::to_string(i);
+        for (int32_t j = 0; j < static_cast<int32_t>(i) * 2 + 1; j++) {
+            s.edges.push_back(make_segment(j, -j, j * 1000, 70000));
+        }
+        s.bbox = make_segment(-1, -2, 3, 4);
+    }
+    m.root.label = "root";
+    m.root.edges.push_back(make_segment(5, 6, 7, 8));
+    m.root.bbox = make_segment(5, 6, 7, 8);
+
+    SECTION("fixed-layout children are laid out in place") {
+        packer pr;
+        pr << m.root.bbox;
+        REQUIRE(pr.size() == deep_segment::wire_size);
+
+        pr << m.shapes[2].edges;
+        REQUIRE(pr.size() == deep_segment::wire_size + sizeof(size_t) + 5 * deep_segment::wire_size);
+
+        deep_segment bbox;
+        std::vector<deep_segment> edges { {}, {} };
+        pr >> bbox >> edges;
+        REQUIRE(bbox == m.root.bbox);
+        REQUIRE(edges == m.shapes[2].edges);
+        REQUIRE(pr.size() == 0);
+    }
+
+    for (wire_format f : { wire_format::FIXED, wire_format::COMPACT }) {
+        CAPTURE(static_cast<int>(f));
+        packer pr(f);
+        request_t<deep_scene> req;
+        req.set_value(deep_scene(m));
+        req.set_method_id(3);
+        pr.pack_request(req);
+        REQUIRE(pr.size() == packer::encoded_size(req.method_id(), f) + packer::encoded_size(m, f));
+
+        request_t<deep_scene> out = pr.unpack_request<deep_scene>();
+        REQUIRE(out.method_id() == 3);
+        REQUIRE(out.value().id == m.id);
+        REQUIRE(out.value().shapes == m.shapes);
+        REQUIRE(out.value().root == m.root);
+        REQUIRE(pr.size() == 0);
+    }
+
+    SECTION("count of fixed-layout children larger than the message") {
+        packer pr;
+        pr << size_t{1000};
+        pr << m.root.bbox;
+        std::vector<deep_segment> out;
+        pr >> out;
+        REQUIRE(out.empty());
+        REQUIRE(pr.size() == 0);
+    }
+}
+
+TEST_CASE("truncated and malformed messages fail the packer", "[unpack][malformed]") {
+    SECTION("string shorter than its length") {
+        std::vector<uint8_t> bytes { 5, 0, 0 };
+        packer pr(bytes);
+        std::string out = "kept?";
+        pr >> out;
+        REQUIRE(pr.failed());
+        REQUIRE(out.empty());
+        REQUIRE(pr.size() == 0);
+    }
+
+    SECTION("lengths are not truncated to 32 bits") {
+        packer pr;
+        pr << (size_t{1} << 32) + 1 << std::string("ab");
+        std::string_view out;
+        pr >> out;
+        REQUIRE(pr.failed());
+        REQUIRE(out.empty());
+        REQUIRE(pr.size() == 0);
+        REQUIRE(pr.offset() == pr.buf()->size());
+    }
+
+    SECTION("reads past the end stop there") {
+        packer pr;
+        pr << int32_t{7};
+        int32_t a = 0;
+        int64_t b = 9;
+        pr >> a >> b;
+        REQUIRE(a == 7);
+        REQUIRE(b == 0);
+        REQUIRE(pr.failed());
+
+        pr.clear();
+        REQUIRE(!pr.failed());
+    }
+
+    SECTION("unterminated varint") {
+        std::vector<uint8_t> bytes { 0x80, 0x80 };
+        packer pr(bytes);
+        pr.set_format(wire_format::COMPACT);
+        int64_t out = 1;
+        pr >> out;
+        REQUIRE(pr.failed());
+        REQUIRE(out == 0);
+    }
+
+    SECTION("responses report the message malformed") {
+        packer pr;
+        response_t<multiple_primitives> res;
+        res.set_value(multiple_primitives{});
+        pr.pack_response(res);
+        std::vector<uint8_t> truncated(pr.buf()->data(), pr.buf()->data() + pr.size() - 3);
+
+        packer rpr(truncated);
+        REQUIRE(rpr.unpack_response<multiple_primitives>().code() == RPC_ERR_MALFORMED_MESSAGE);
+    }
+
+    SECTION("requests leave it to the caller") {
+        std::vector<uint8_t> bytes { 1, 0 };
+        packer pr(bytes);
+        request_t<fixed_message> req = pr.unpack_request<fixed_message>();
+        REQUIRE(pr.failed());
+        REQUIRE(req.method_id() == 0);
+    }
+}
+
+TEST_CASE("map fields", "[pack][unpack][map]") {
+    SECTION("keys and values are contiguous blocks") {
+        std::unordered_map<int32_t, int64_t> m { {7, -1} };
+        packer pr;
+        pr << m;
+        std::vector<uint8_t> packed {
+            1, 0, 0, 0, 0, 0, 0, 0,
+            7, 0, 0, 0,
+            255, 255, 255, 255, 255, 255, 255, 255
+        };
+        REQUIRE(packed == *pr.buf());
+    }
+
+    std::unordered_map<int64_t, int32_t> numbers;
+    for (int32_t i = 0; i < 500; i++) { numbers[i * 3 - 700] = i; }
+    std::unordered_map<std::string, single_primitive> named;
+    named["a"].arg1 = 1;
+    named["bcd"].arg1 = -2;
+    std::map<char, std::string> ordered { {'x', "ex"}, {'y', ""} };
+
+    for (wire_format f : { wire_format::FIXED, wire_format::COMPACT }) {
+        CAPTURE(static_cast<int>(f));
+        packer pr(f);
+        pr << numbers << named << ordered;
+        REQUIRE(pr.size() == packer::encoded_size(numbers, f) + packer::encoded_size(named, f) + packer::encoded_size(ordered, f));
+
+        std::unordered_map<int64_t, int32_t> numbers_out { {1, 1} }; // replaced, not merged
+        std::unordered_map<std::string, single_primitive> named_out;
+        std::map<char, std::string> ordered_out;
+        pr >> numbers_out >> named_out >> ordered_out;
+        REQUIRE(numbers_out == numbers);
+        REQUIRE(named_out == named);
+        REQUIRE(ordered_out == ordered);
+        REQUIRE(pr.size() == 0);
+    }
+}
+
+struct scalar_message : public message_base {
+    uint8_t arg1;
+    uint16_t arg2;
+    uint32_t arg3;
+    uint64_t arg4;
+    float arg5;
+    double arg6;
+    std::vector<uint8_t> arg7;
+
+    static constexpr const char* name = "scalar_message";
+    static constexpr auto fields = std::make_tuple(
+        STRUCT_MEMBER(scalar_message, arg1, "scalar_message::arg1"),
+        STRUCT_MEMBER(scalar_message, arg2, "scalar_message::arg2"),
+        STRUCT_MEMBER(scalar_message, arg3, "scalar_message::arg3"),
+        STRUCT_MEMBER(scalar_message, arg4, "scalar_message::arg4"),
+        STRUCT_MEMBER(scalar_message, arg5, "scalar_message::arg5"),
+        STRUCT_MEMBER(scalar_message, arg6, "scalar_message::arg6"),
+        STRUCT_MEMBER(scalar_message, arg7, "scalar_message::arg7")
+    );
+};
+
+struct scalar_message_view : public message_base {
+    uint64_t arg4;
+    std::span<const uint8_t> arg7;
+
+    static constexpr const char* name = "scalar_message";
+    static constexpr auto fields = std::make_tuple(
+        STRUCT_MEMBER(scalar_message_view, arg4, "scalar_message::arg4"),
+        STRUCT_MEMBER(scalar_message_view, arg7, "scalar_message::arg7")
+    );
 };
 
+TEST_CASE("unsigned, floating point and bytes fields", "[pack][unpack][scalar]") {
+    scalar_message m;
+    m.arg1 = 255;
+    m.arg2 = 65535;
+    m.arg3 = 4000000000u;
+    m.arg4 = std::numeric_limits<uint64_t>::max();
+    m.arg5 = 1.5f;
+    m.arg6 = -0.1;
+    m.arg7 = { 0, 1, 255, 0 };
+
+    for (wire_format f : { wire_format::FIXED, wire_format::COMPACT }) {
+        CAPTURE(static_cast<int>(f));
+        packer pr(f);
+        pr << m;
+        REQUIRE(pr.size() == packer::encoded_size(m, f));
+
+        scalar_message out;
+        pr >> out;
+        REQUIRE(out.arg1 == m.arg1);
+        REQUIRE(out.arg2 == m.arg2);
+        REQUIRE(out.arg3 == m.arg3);
+        REQUIRE(out.arg4 == m.arg4);
+        REQUIRE(out.arg5 == m.arg5);
+        REQUIRE(out.arg6 == m.arg6);
+        REQUIRE(out.arg7 == m.arg7);
+        REQUIRE(pr.size() == 0);
+    }
+
+    SECTION("bytes are sent like strings") {
+        packer pr;
+        pr << m.arg7;
+        std::vector<uint8_t> packed { 4, 0, 0, 0, 0, 0, 0, 0, 0, 1, 255, 0 };
+        REQUIRE(packed == *pr.buf());
+    }
+
+    SECTION("views point into the buffer") {
+        packer pr;
+        pr << m.arg4 << std::span<const uint8_t>(m.arg7);
+        scalar_message_view view;
+        pr >> view;
+        REQUIRE(view.arg4 == m.arg4);
+        REQUIRE(view.arg7.size() == m.arg7.size());
+        REQUIRE(view.arg7.data() == pr.buf()->data() + sizeof(uint64_t) + sizeof(size_t));
+        REQUIRE(std::equal(view.arg7.begin(), view.arg7.end(), m.arg7.begin()));
+    }
+}
+
+TEST_CASE("chained packers reference large blobs", "[pack][iobuf]") {
+    scalar_message m;
+    m.arg1 = 1;
+    m.arg2 = 2;
+    m.arg3 = 3;
+    m.arg4 = 4;
+    m.arg5 = 5.0f;
+    m.arg6 = 6.0;
+
+    for (wire_format f : { wire_format::FIXED, wire_format::COMPACT }) {
+        CAPTURE(static_cast<int>(f));
+        for (size_t size : { size_t{16}, size_t{IOBUF_REF_MIN}, size_t{1} << 20 }) {
+            CAPTURE(size);
+            m.arg7.assign(size, 0xab);
+
+            packer flat(f);
+            flat << m;
+
+            packer pr(f);
+            pr.set_chained(true);
+            pr << m;
+            iobuf chain = pr.release_chain();
+            REQUIRE(pr.size() == 0);
+            REQUIRE(chain.size() == flat.size());
+            REQUIRE(chain.flatten() == std::vector<uint8_t>(flat.data(), flat.data() + flat.size()));
+
+            bool referenced = false;
+            for (const auto& seg : chain.segments()) { referenced |= seg.data == m.arg7.data(); }
+            REQUIRE(referenced == (size >= IOBUF_REF_MIN));
+            REQUIRE(chain.segments().size() == (referenced ? 2 : 1));
+
+            // segments cut from the buffer stay alive with the chain
+            iobuf moved = std::move(chain);
+            packer back(moved.flatten());
+            back.set_format(f);
+            scalar_message out;
+            back >> out;
+            REQUIRE(out.arg7 == m.arg7);
+            REQUIRE(out.arg6 == m.arg6);
+        }
+    }
+}
+
+TEST_CASE("chained packers reserve what they copy once", "[pack][iobuf][size]") {
+    nested_message nm;
+    nm.arg1 = -3;
+    nm.arg2.arg1 = 5;
+    nm.arg3.arg1 = 22;
+    nm.arg3.arg2 = 'z';
+    nm.arg3.arg3 = 1 << 20;
+
+    for (wire_format f : { wire_format::FIXED, wire_format::COMPACT }) {
+        CAPTURE(static_cast<int>(f));
+        for (size_t size : { size_t{3000}, size_t{IOBUF_REF_MIN} }) {
+            CAPTURE(size);
+            nm.arg3.arg4 = std::string(size, 'x');
+            size_t copied = packer::encoded_size(uint32_t{7}, f) + packer::encoded_size(nm, f) 
+                - packer::referenced_size(nm, f);
+            REQUIRE(packer::referenced_size(nm, f) == (size >= IOBUF_REF_MIN ? size : 0));
+
+            packer pr(f);
+            pr.set_chained(true);
+            buffer::ptr first = pr.buf();
+            pr.pack_request(7, nm);
+            REQUIRE(first->capacity() == copied); // reserved once, up front
+
+            iobuf chain = pr.release_chain();
+            REQUIRE(chain.size() == copied + packer::referenced_size(nm, f));
+            REQUIRE(chain.segments().front().data == first->data()); // not reallocated
+            REQUIRE(chain.segments().front().len == copied);
+        }
+    }
+}
+
 TEST_CASE("pack requests", "[pack][request]") {
     SECTION("single primitive") {
         single_primitive sp;
@@ -96,14 +715,11 @@ TEST_CASE("pack requests", "[pack][request]") {
         packer pr;
         request_t<single_primitive> req;
         req.set_value(std::move(sp));
-        req.set_method_name("test");
+        req.set_method_id(7);
         pr.pack_request(req);
 
         std::vector<uint8_t> packed {
-            4, 0, 0, 0, 0, 0, 0, 0, 
-            't', 'e', 's', 't',
-            16, 0, 0, 0, 0, 0, 0, 0, 
-            's', 'i', 'n', 'g', 'l', 'e', '_', 'p', 'r', 'i', 'm', 'i', 't', 'i', 'v', 'e',
+            7, 0, 0, 0, 
             5, 
         };
         CAPTURE(*pr.buf());
@@ -120,14 +736,11 @@ TEST_CASE("pack requests", "[pack][request]") {
         packer pr;
         request_t<multiple_primitives> req;
         req.set_value(std::move(mp));
-        req.set_method_name("test");
+        req.set_method_id(7);
         pr.pack_request(req);
 
         std::vector<uint8_t> packed {
-            4, 0, 0, 0, 0, 0, 0, 0, 
-            't', 'e', 's', 't',
-            19, 0, 0, 0, 0, 0, 0, 0, 
-            'm', 'u', 'l', 't', 'i', 'p', 'l', 'e', '_', 'p', 'r', 'i', 'm', 'i', 't', 'i', 'v', 'e', 's',
+            7, 0, 0, 0, 
             22,
             'z',
             255, 255, 255, 255, 255, 255, 255, 127, 
@@ -156,14 +769,11 @@ TEST_CASE("pack requests", "[pack][request]") {
         packer pr;
         request_t<nested_message> req;
         req.set_value(std::move(nm));
-        req.set_method_name("test");
+        req.set_method_id(7);
         pr.pack_request(req);
 
         std::vector<uint8_t> packed {
-            4, 0, 0, 0, 0, 0, 0, 0, 
-            't', 'e', 's', 't',
-            14, 0, 0, 0, 0, 0, 0, 0, 
-            'n', 'e', 's', 't', 'e', 'd', '_', 'm', 'e', 's', 's', 'a', 'g', 'e',
+            7, 0, 0, 0, 
             255, 255, 255, 255, 255, 255, 255, 127, 
             5, 
             22,
@@ -190,8 +800,6 @@ TEST_CASE("pack response", "[pack][response]") {
 
         std::vector<uint8_t> packed {
             0,
-            16, 0, 0, 0, 0, 0, 0, 0, 
-            's', 'i', 'n', 'g', 'l', 'e', '_', 'p', 'r', 'i', 'm', 'i', 't', 'i', 'v', 'e',
             5, 
         };
         CAPTURE(*pr.buf());
@@ -213,8 +821,6 @@ TEST_CASE("pack response", "[pack][response]") {
 
         std::vector<uint8_t> packed {
             2,
-            19, 0, 0, 0, 0, 0, 0, 0, 
-            'm', 'u', 'l', 't', 'i', 'p', 'l', 'e', '_', 'p', 'r', 'i', 'm', 'i', 't', 'i', 'v', 'e', 's',
             22,
             'z',
             255, 255, 255, 255, 255, 255, 255, 127, 
@@ -248,8 +854,6 @@ TEST_CASE("pack response", "[pack][response]") {
 
         std::vector<uint8_t> packed {
             1,
-            14, 0, 0, 0, 0, 0, 0, 0, 
-            'n', 'e', 's', 't', 'e', 'd', '_', 'm', 'e', 's', 's', 'a', 'g', 'e',
             255, 255, 255, 255, 255, 255, 255, 127, 
             5, 
             22,
@@ -264,31 +868,18 @@ TEST_CASE("pack response", "[pack][response]") {
 }
 
 TEST_CASE("unpack request", "[unpack][request]") {
-    message_registry["single_primitive"] = []() -> std::unique_ptr<single_primitive> { 
-        return std::make_unique<single_primitive>(); 
-    };
-    message_registry["multiple_primitives"] = []() -> std::unique_ptr<multiple_primitives> { 
-        return std::make_unique<multiple_primitives>(); 
-    };
-    message_registry["nested_message"] = []() -> std::unique_ptr<nested_message> { 
-        return std::make_unique<nested_message>(); 
-    };
-
     SECTION("single primitive") {
         single_primitive sp;
         sp.arg1 = 5;
 
         std::vector<uint8_t> bytes {
-            4, 0, 0, 0, 0, 0, 0, 0, 
-            't', 'e', 's', 't',
-            16, 0, 0, 0, 0, 0, 0, 0, 
-            's', 'i', 'n', 'g', 'l', 'e', '_', 'p', 'r', 'i', 'm', 'i', 't', 'i', 'v', 'e',
+            7, 0, 0, 0, 
             5, 
         };
         packer pr(bytes);
         request_t<single_primitive> r = pr.unpack_request<single_primitive>();
         REQUIRE(r.value() == sp); 
-        REQUIRE(r.method_name() == "test");
+        REQUIRE(r.method_id() == 7);
     }
 
     SECTION("multiple primitives") {
@@ -299,10 +890,7 @@ TEST_CASE("unpack request", "[unpack][request]") {
         mp.arg4 = "testing_string";
 
         std::vector<uint8_t> bytes {
-            11, 0, 0, 0, 0, 0, 0, 0, 
-            't', 'e', 's', 't', '_', 'm', 'e', 't', 'h', 'o', 'd',
-            19, 0, 0, 0, 0, 0, 0, 0, 
-            'm', 'u', 'l', 't', 'i', 'p', 'l', 'e', '_', 'p', 'r', 'i', 'm', 'i', 't', 'i', 'v', 'e', 's',
+            42, 1, 0, 0, 
             22,
             'z',
             255, 255, 255, 255, 255, 255, 255, 127, 
@@ -312,7 +900,7 @@ TEST_CASE("unpack request", "[unpack][request]") {
         packer pr(bytes);
         request_t<multiple_primitives> r = pr.unpack_request<multiple_primitives>();
         REQUIRE(r.value() == mp); 
-        REQUIRE(r.method_name() == "test_method");
+        REQUIRE(r.method_id() == 298);
     }
 
     SECTION("nested messages") {
@@ -331,10 +919,7 @@ TEST_CASE("unpack request", "[unpack][request]") {
         nm.arg3 = mp;
 
         std::vector<uint8_t> bytes {
-            4, 0, 0, 0, 0, 0, 0, 0, 
-            't', 'e', 's', 't',
-            14, 0, 0, 0, 0, 0, 0, 0, 
-            'n', 'e', 's', 't', 'e', 'd', '_', 'm', 'e', 's', 's', 'a', 'g', 'e',
+            7, 0, 0, 0, 
             255, 255, 255, 255, 255, 255, 255, 127, 
             5, 
             22,
@@ -347,29 +932,17 @@ TEST_CASE("unpack request", "[unpack][request]") {
         packer pr(bytes);
         request_t<nested_message> r = pr.unpack_request<nested_message>();
         REQUIRE(r.value() == nm); 
-        REQUIRE(r.method_name() == "test");
+        REQUIRE(r.method_id() == 7);
     }
 }
 
 TEST_CASE("unpack response", "[unpack][response]") {
-    message_registry["single_primitive"] = []() -> std::unique_ptr<single_primitive> { 
-        return std::make_unique<single_primitive>(); 
-    };
-    message_registry["multiple_primitives"] = []() -> std::unique_ptr<multiple_primitives> { 
-        return std::make_unique<multiple_primitives>(); 
-    };
-    message_registry["nested_message"] = []() -> std::unique_ptr<nested_message> { 
-        return std::make_unique<nested_message>(); 
-    };
-
     SECTION("single primitive") {
         single_primitive sp;
         sp.arg1 = 5;
 
         std::vector<uint8_t> bytes {
             0,
-            16, 0, 0, 0, 0, 0, 0, 0, 
-            's', 'i', 'n', 'g', 'l', 'e', '_', 'p', 'r', 'i', 'm', 'i', 't', 'i', 'v', 'e',
             5, 
         };
         packer pr(bytes);
@@ -387,8 +960,6 @@ TEST_CASE("unpack response", "[unpack][response]") {
 
         std::vector<uint8_t> bytes {
             2,
-            19, 0, 0, 0, 0, 0, 0, 0, 
-            'm', 'u', 'l', 't', 'i', 'p', 'l', 'e', '_', 'p', 'r', 'i', 'm', 'i', 't', 'i', 'v', 'e', 's',
             22,
             'z',
             255, 255, 255, 255, 255, 255, 255, 127, 
@@ -418,8 +989,6 @@ TEST_CASE("unpack response", "[unpack][response]") {
 
         std::vector<uint8_t> bytes {
             1,
-            14, 0, 0, 0, 0, 0, 0, 0, 
-            'n', 'e', 's', 't', 'e', 'd', '_', 'm', 'e', 's', 's', 'a', 'g', 'e',
             255, 255, 255, 255, 255, 255, 255, 127, 
             5, 
             22,
@@ -435,4 +1004,69 @@ TEST_CASE("unpack response", "[unpack][response]") {
     }
 }
 
+TEST_CASE("messages pack in place and move out", "[pack][unpack][move]") {
+    multiple_primitives mp;
+    mp.arg1 = 1;
+    mp.arg2 = 'b';
+    mp.arg3 = 3;
+    mp.arg4 = std::string(1000, 'd');
+
+    for (wire_format f : { wire_format::FIXED, wire_format::COMPACT }) {
+        CAPTURE(static_cast<int>(f));
+        request_t<multiple_primitives> req;
+        req.set_method_id(7);
+        req.set_value(multiple_primitives(mp));
+        packer wrapped(f);
+        wrapped.pack_request(req);
+
+        packer direct(f);
+        direct.pack_request(7, mp);
+        REQUIRE(*direct.buf() == std::vector<uint8_t>(wrapped.data(), wrapped.data() + wrapped.size()));
+        REQUIRE(mp.arg4.size() == 1000); // the caller's message is left alone
+
+        packer res(f);
+        res.pack_response(RPC_SUCCESS, mp);
+        response_t<multiple_primitives> r = res.unpack_response<multiple_primitives>();
+        const char* body = r.value().arg4.data();
+        multiple_primitives out = std::move(r).take_value();
+        REQUIRE(out == mp);
+        REQUIRE(out.arg4.data() == body); // moved, not copied
+
+        request_t<multiple_primitives> back = direct.unpack_request<multiple_primitives>();
+        REQUIRE(back.method_id() == 7);
+        REQUIRE(std::move(back).take_value() == mp);
+    }
+}
+
+TEST_CASE("compact format packs integers as varints", "[pack][unpack][compact]") {
+    multiple_primitives mp;
+    mp.arg1 = -3;       // 1-byte types stay raw
+    mp.arg2 = 'z';
+    mp.arg3 = -5;
+    mp.arg4 = "abc";
+
+    packer pr(wire_format::COMPACT);
+    request_t<multiple_primitives> req;
+    req.set_value(multiple_primitives(mp));
+    req.set_method_id(300);
+    pr.pack_request(req);
+
+    std::vector<uint8_t> packed {
+        0xac, 0x02,                 // method id
+        253,
+        'z',
+        9,                          // zigzag(-5)
+        3, 'a', 'b', 'c'
+    };
+    CAPTURE(*pr.buf());
+    REQUIRE(packed == *pr.buf());
+
+    packer rd(packed);
+    rd.set_format(wire_format::COMPACT);
+    request_t<multiple_primitives> r = rd.unpack_request<multiple_primitives>();
+    REQUIRE(r.method_id() == 300);
+    REQUIRE(r.value() == mp);
+    REQUIRE(rd.size() == 0);
+}
+
 } // namespace srpc
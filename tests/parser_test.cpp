@@ -66,7 +66,7 @@ TEST_CASE("Parse Message", "[parse][message]") {
                 "Error casting rpc element to message.");
 
         CHECK(msg->name == "Request");
-        for (int i = 0; i < test_case.size(); i++) {
+        for (size_t i = 0; i < test_case.size(); i++) {
             auto field = msg->fields()[i].get();
             CHECK(field->name == test_case[i].name);
             CHECK(field->type == test_case[i].type);
@@ -109,7 +109,7 @@ TEST_CASE("Parse Message", "[parse][message]") {
         auto engine_msg = try_cast_shared<message>(contract::elements[contract::element_index_map["Engine"]], 
                 "Error casting rpc element to message.");
         CHECK(engine_msg->name == "Engine");
-        for (int i = 0; i < engine_field_test_case.size(); i++) {
+        for (size_t i = 0; i < engine_field_test_case.size(); i++) {
             INFO("engine_field_test_case: "<<i);
             auto field = engine_msg->fields()[i].get();
             CHECK(field->name == engine_field_test_case[i].name);
@@ -119,13 +119,158 @@ TEST_CASE("Parse Message", "[parse][message]") {
         auto car_msg = try_cast_shared<message>(contract::elements[contract::element_index_map["Car"]], 
                 "Error casting rpc element to message.");
         CHECK(car_msg->name == "Car");
-        for (int i = 0; i < car_field_test_case.size(); i++) {
+        for (size_t i = 0; i < car_field_test_case.size(); i++) {
             INFO("car_field_test_case: "<<i);
             auto field = car_msg->fields()[i].get();
             CHECK(field->name == car_field_test_case[i].name);
             CHECK(field->type == car_field_test_case[i].type);
         }
     }
+
+    SECTION("Repeated Fields") {
+        contract::elements.clear();
+        contract::element_index_map.clear();
+        std::string input = R"(
+            message Wheel {
+                int32 size;
+            }
+            message Car {
+                repeated Wheel wheels;
+                repeated int64 readings;
+                string color;
+            }
+        )";
+
+        lexer l(input);
+        parser p(l);
+        p.parse_contract();
+        check_parser_errors(p);
+
+        auto car_msg = try_cast_shared<message>(contract::elements[contract::element_index_map["Car"]], 
+                "Error casting rpc element to message.");
+        REQUIRE(car_msg->fields().size() == 3);
+        CHECK(car_msg->fields()[0]->type == "Wheel");
+        CHECK(car_msg->fields()[0]->is_repeated);
+        CHECK(!car_msg->fields()[0]->is_primitive);
+        CHECK(car_msg->fields()[1]->type == "int64_t");
+        CHECK(car_msg->fields()[1]->is_repeated);
+        CHECK(!car_msg->fields()[2]->is_repeated);
+    }
+
+    SECTION("Map Fields") {
+        contract::elements.clear();
+        contract::element_index_map.clear();
+        std::string input = R"(
+            message Wheel {
+                int32 size;
+            }
+            message Garage {
+                map<string, Wheel> spares;
+                map<int64, int32> counts;
+                int8 floor;
+            }
+        )";
+
+        lexer l(input);
+        parser p(l);
+        p.parse_contract();
+        check_parser_errors(p);
+
+        auto garage = try_cast_shared<message>(contract::elements[contract::element_index_map["Garage"]], 
+                "Error casting rpc element to message.");
+        REQUIRE(garage->fields().size() == 3);
+        CHECK(garage->fields()[0]->key_type == "std::string");
+        CHECK(garage->fields()[0]->type == "Wheel");
+        CHECK(!garage->fields()[0]->is_primitive);
+        CHECK(garage->fields()[1]->key_type == "int64_t");
+        CHECK(garage->fields()[1]->type == "int32_t");
+        CHECK(!garage->fields()[2]->is_map());
+    }
+
+    SECTION("Unsigned, Floating Point And Bytes") {
+        contract::elements.clear();
+        contract::element_index_map.clear();
+        std::string input = R"(
+            message Quote {
+                uint8 a;
+                uint16 b;
+                uint32 c;
+                uint64 d;
+                float e;
+                double f;
+                bytes g;
+            }
+        )";
+        std::vector<std::string> types {
+            "uint8_t", "uint16_t", "uint32_t", "uint64_t", "float", "double", "std::vector<uint8_t>"
+        };
+
+        lexer l(input);
+        parser p(l);
+        p.parse_contract();
+        check_parser_errors(p);
+
+        auto quote = try_cast_shared<message>(contract::elements[contract::element_index_map["Quote"]], 
+                "Error casting rpc element to message.");
+        REQUIRE(quote->fields().size() == types.size());
+        for (size_t i = 0; i < types.size(); i++) {
+            CHECK(quote->fields()[i]->type == types[i]);
+            CHECK(quote->fields()[i]->is_primitive);
+        }
+    }
+
+    SECTION("Map Keys Must Be Primitive") {
+        contract::elements.clear();
+        contract::element_index_map.clear();
+        std::string input = R"(
+            message Wheel {
+                int32 size;
+            }
+            message Garage {
+                map<Wheel, int32> by_wheel;
+                int8 floor;
+            }
+        )";
+
+        lexer l(input);
+        parser p(l);
+        p.parse_contract();
+        REQUIRE(p.errors().size() == 1);
+        CHECK(p.errors()[0] == "Map keys must be a primitive type.");
+
+        auto garage = try_cast_shared<message>(contract::elements[contract::element_index_map["Garage"]], 
+                "Error casting rpc element to message.");
+        REQUIRE(garage->fields().size() == 1); // parsing went on after the bad field
+        CHECK(garage->fields()[0]->name == "floor");
+    }
+
+    SECTION("Arena Fields") {
+        contract::elements.clear();
+        contract::element_index_map.clear();
+        std::string input = R"(
+            message Upload {
+                arena string name;
+                arena bytes data;
+                string tag;
+                arena int32 size;
+            }
+        )";
+
+        lexer l(input);
+        parser p(l);
+        p.parse_contract();
+        REQUIRE(p.errors().size() == 1);
+        CHECK(p.errors()[0] == "Only string and bytes fields can be arena fields.");
+
+        auto upload = try_cast_shared<message>(contract::elements[contract::element_index_map["Upload"]], 
+                "Error casting rpc element to message.");
+        REQUIRE(upload->fields().size() == 3);
+        CHECK(upload->fields()[0]->in_arena);
+        CHECK(upload->fields()[0]->type == "std::string");
+        CHECK(upload->fields()[1]->in_arena);
+        CHECK(upload->fields()[1]->type == "std::vector<uint8_t>");
+        CHECK_FALSE(upload->fields()[2]->in_arena);
+    }
 }
 
 TEST_CASE("Parse Service", "[parse][service]") {
@@ -155,14 +300,109 @@ TEST_CASE("Parse Service", "[parse][service]") {
                 "Error casting rpc element to message.");
         CHECK(svc->name == "MyService");
 
-        for (int i = 0; i < my_service_test_case.size(); i++) {
+        for (size_t i = 0; i < my_service_test_case.size(); i++) {
             INFO("my_service_test_case: "<<i);
             auto method = svc->methods()[i].get();
             CHECK(method->name == my_service_test_case[i].name);
             CHECK(method->input_t == my_service_test_case[i].input_t);
             CHECK(method->output_t == my_service_test_case[i].output_t);
+            CHECK(method->id == static_cast<uint32_t>(i));
         }        
     }
+
+    SECTION("Method Ids") {
+        contract::elements.clear();
+        contract::element_index_map.clear();
+        std::string input = R"(
+            service First {
+                method a(Request) returns (Response);
+                method b(Request) returns (Response) = 7;
+                method c(Request) returns (Response);
+            }
+            service Second = 100 {
+                method d(Request) returns (Response);
+                method e(Request) returns (Response) = 3;
+            }
+        )";
+
+        lexer l(input);
+        parser p(l);
+        p.parse_contract();
+        check_parser_errors(p);
+
+        auto first = try_cast_shared<service>(contract::elements[contract::element_index_map["First"]], 
+                "Error casting rpc element to service.");
+        auto second = try_cast_shared<service>(contract::elements[contract::element_index_map["Second"]], 
+                "Error casting rpc element to service.");
+        CHECK(first->methods()[0]->id == 0);
+        CHECK(first->methods()[1]->id == 7);
+        CHECK(first->methods()[2]->id == 8); // after the one before it
+        CHECK(second->methods()[0]->id == 100);
+        CHECK(second->methods()[1]->id == 3);
+    }
+
+    SECTION("Services Without A Base") {
+        contract::elements.clear();
+        contract::element_index_map.clear();
+        std::string input = R"(
+            service First {
+                method a(Request) returns (Response);
+                method b(Request) returns (Response);
+            }
+            service Second {
+                method c(Request) returns (Response);
+            }
+            service Third = 10 {
+                method d(Request) returns (Response);
+            }
+            service Fourth {
+                method e(Request) returns (Response);
+            }
+        )";
+
+        lexer l(input);
+        parser p(l);
+        p.parse_contract();
+        check_parser_errors(p);
+
+        auto id_of = [] (const std::string& svc_name, size_t i) {
+            auto svc = try_cast_shared<service>(contract::elements[contract::element_index_map[svc_name]], 
+                    "Error casting rpc element to service.");
+            return svc->methods()[i]->id;
+        };
+        CHECK(id_of("First", 0) == 0);
+        CHECK(id_of("First", 1) == 1);
+        CHECK(id_of("Second", 0) == 2); // after the ids of the services before it
+        CHECK(id_of("Third", 0) == 10);
+        CHECK(id_of("Fourth", 0) == 11);
+    }
+
+    SECTION("Method Ids Must Be Unique") {
+        contract::elements.clear();
+        contract::element_index_map.clear();
+        std::string input = R"(
+            service First {
+                method a(Request) returns (Response);
+            }
+            service Second {
+                method b(Request) returns (Response) = 0;
+                method c(Request) returns (Response) = 70000;
+                method d(Request) returns (Response);
+            }
+        )";
+
+        lexer l(input);
+        parser p(l);
+        p.parse_contract();
+        REQUIRE(p.errors().size() == 2);
+        CHECK(p.errors()[0].find("out of range") != std::string::npos);
+        CHECK(p.errors()[1].find("Second.b is already used by First.a") != std::string::npos);
+
+        auto second = try_cast_shared<service>(contract::elements[contract::element_index_map["Second"]], 
+                "Error casting rpc element to service.");
+        REQUIRE(second->methods().size() == 2); // parsing went on after the bad method
+        CHECK(second->methods()[1]->name == "d");
+    }
 }
 
 } // namespace srpc
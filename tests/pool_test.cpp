@@ -0,0 +1,125 @@
+#include <srpc/pool.hpp>
+#include <srpc/packer.hpp>
+#include <srpc/transport.hpp>
+
+#include <thread>
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/catch_message.hpp>
+
+namespace srpc {
+
+TEST_CASE("pool reuses released slabs", "[pool]") {
+    buffer_pool pool;
+
+    slab a = pool.acquire(100);
+    REQUIRE(a);
+    REQUIRE(a.size() == 100);
+    REQUIRE(a.capacity() == 128);
+    uint8_t* first = a.data();
+
+    a.release();
+    REQUIRE(pool.free_count(100) == 1);
+
+    slab b = pool.acquire(120); // same size class
+    REQUIRE(b.data() == first);
+    REQUIRE(pool.hit_count() == 1);
+    REQUIRE(pool.miss_count() == 1);
+    REQUIRE(pool.free_count(100) == 0);
+}
+
+TEST_CASE("pool does not keep oversized slabs", "[pool]") {
+    buffer_pool pool;
+    size_t big = (size_t{1} << POOL_MAX_CLASS_SHIFT) + 1;
+    {
+        slab s = pool.acquire(big);
+        REQUIRE(s.size() == big);
+    }
+    REQUIRE(pool.free_count(big) == 0);
+}
+
+TEST_CASE("packer adopts a slab without copying", "[pool][packer]") {
+    slab s = buffer_pool::global().acquire(sizeof(int64_t));
+    int64_t v = 42;
+    std::memcpy(s.data(), &v, sizeof(v));
+    const uint8_t* raw = s.data();
+
+    packer p(std::move(s));
+    REQUIRE(p.data() == raw);
+
+    int64_t out = 0;
+    p >> out;
+    REQUIRE(out == 42);
+    REQUIRE(p.size() == 0);
+
+    p << int64_t{7}; // writing detaches into owned storage
+    REQUIRE(p.buf()->data() != raw);
+}
+
+TEST_CASE("received frames return to the pool", "[pool][transport]") {
+    int32_t fds[2];
+    REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+    const uint8_t data[300] = {1, 2, 3};
+    for (int32_t i = 0; i < 10; i++) {
+        transport::send_data(fds[0], data, sizeof(data));
+        message_t msg = transport::recv_data(fds[1]);
+        REQUIRE(msg.size() == sizeof(data));
+        REQUIRE(std::memcmp(msg.data(), data, sizeof(data)) == 0);
+    }
+    close(fds[0]);
+    close(fds[1]);
+
+    REQUIRE(buffer_pool::global().free_count(sizeof(data)) >= 1);
+}
+
+TEST_CASE("request arenas bump allocate from pooled chunks", "[pool][arena]") {
+    size_t live = request_arena::live_count();
+    {
+        request_arena::ptr a = request_arena::create();
+        REQUIRE(request_arena::live_count() == live + 1);
+
+        void* first = a->allocate(3, 1);
+        void* second = a->allocate(8, 8);
+        REQUIRE(reinterpret_cast<uintptr_t>(second) % 8 == 0);
+        REQUIRE(static_cast<uint8_t*>(second) - static_cast<uint8_t*>(first) < 16);
+        REQUIRE(a->chunk_count() == 1);
+
+        void* big = a->allocate(ARENA_CHUNK_SZ, 16); // does not fit, takes a bigger chunk
+        REQUIRE(big != nullptr);
+        REQUIRE(reinterpret_cast<uintptr_t>(big) % 16 == 0);
+        REQUIRE(a->chunk_count() == 2);
+        REQUIRE(a->allocated() >= ARENA_CHUNK_SZ + 11);
+    }
+    REQUIRE(request_arena::live_count() == live);
+    REQUIRE(buffer_pool::global().free_count(ARENA_CHUNK_SZ) >= 1);
+}
+
+TEST_CASE("objects made in an arena keep it alive", "[pool][arena]") {
+    size_t live = request_arena::live_count();
+
+    packer::ptr p;
+    {
+        request_arena::ptr a = request_arena::create();
+        p = make_in<packer>(a, wire_format::COMPACT, a);
+        REQUIRE(p->arena() == a);
+    }
+    REQUIRE(request_arena::live_count() == live + 1);
+
+    std::string body(1000, 'x');
+    (*p) << int64_t{-1} << body;
+    REQUIRE(p->arena()->allocated() >= p->size());
+    std::string out;
+    int64_t v = 0;
+    (*p) >> v >> out;
+    REQUIRE(v == -1);
+    REQUIRE(out == body);
+
+    p.reset();
+    REQUIRE(request_arena::live_count() == live);
+
+    // without an arena, make_in falls back to the heap
+    packer::ptr heap = make_in<packer>(nullptr, wire_format::FIXED, nullptr);
+    REQUIRE(heap->arena() == nullptr);
+}
+
+} // namespace srpc
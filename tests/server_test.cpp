@@ -1,10 +1,43 @@
 #include <srpc/core.hpp>
 #include <srpc/packer.hpp>
 #include <srpc/server.hpp>
+#include <srpc/client.hpp>
 
+#include <map>
+#include <new>
+#include <cstdlib>
+#include <atomic>
+#include <future>
 #include <thread>
+#include <functional>
+#include <string_view>
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/catch_message.hpp>
+#include <catch2/generators/catch_generators.hpp>
+
+/// Heap allocations made by the threads that set count_allocations, the reactor 
+/// threads of a test that checks a server does not call malloc per request.
+std::atomic<size_t> counted_allocations = 0;
+thread_local bool count_allocations = false;
+
+#ifndef __has_feature
+#define __has_feature(x) 0
+#endif
+
+#if defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_THREAD__) || __has_feature(address_sanitizer) || __has_feature(thread_sanitizer)
+#define COUNTS_ALLOCATIONS 0    // the sanitizer runtime replaces operator new itself
+#else
+#define COUNTS_ALLOCATIONS 1
+
+void* operator new(size_t size) {
+	if (count_allocations) { counted_allocations.fetch_add(1, std::memory_order_relaxed); }
+	if (void* p = std::malloc(size == 0 ? 1 : size)) { return p; }
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+#endif
 
 struct number : public srpc::message_base {
 	int64_t num;
@@ -14,61 +47,146 @@ struct number : public srpc::message_base {
 	static constexpr auto fields = std::make_tuple(
 		STRUCT_MEMBER(number, num, "number::num")
 	);
-	void unpack(srpc::buffer::ptr bp) override {
-        srpc::packer p(bp);
-        p >> num;
+	void encode(srpc::packer& p) const {
+		p << num;
+	}
+	void decode(srpc::packer& p) {
+		p >> num;
+	}
+
+	// fixed layout
+	static constexpr size_t wire_size = 8;
+	void encode_to(uint8_t* out) const {
+		std::memcpy(out + 0, &num, sizeof(num));
+	}
+	void decode_from(const uint8_t* in) {
+		std::memcpy(&num, in + 0, sizeof(num));
 	}
 
     constexpr bool operator==(const number& other) const noexcept { return other.num == num; }
 };
 
+struct text : public srpc::message_base {
+	std::string body;
+
+	// overrides
+	static constexpr const char* name = "text";
+	static constexpr auto fields = std::make_tuple(
+		STRUCT_MEMBER(text, body, "text::body")
+	);
+	void encode(srpc::packer& p) const {
+		p << body;
+	}
+	void decode(srpc::packer& p) {
+		p >> body;
+	}
+};
+
+struct text_view : public srpc::message_base {
+	std::string_view body;
+
+	// overrides
+	static constexpr const char* name = "text";
+	static constexpr auto fields = std::make_tuple(
+		STRUCT_MEMBER(text_view, body, "text::body")
+	);
+	void decode(srpc::packer& p) {
+		p >> body;
+	}
+};
+
+/// text with an arena field, as generated for `arena string body;`
+struct arena_text : public srpc::message_base {
+	std::pmr::string body;
+
+	// arena fields
+	using allocator_type = std::pmr::polymorphic_allocator<>;
+	arena_text() = default;
+	explicit arena_text(allocator_type alloc) : body(alloc) {}
+	allocator_type get_allocator() const noexcept { return body.get_allocator(); }
+
+	// overrides
+	static constexpr const char* name = "text";
+	static constexpr auto fields = std::make_tuple(
+		STRUCT_MEMBER(arena_text, body, "text::body")
+	);
+	void encode(srpc::packer& p) const {
+		p << body;
+	}
+	void decode(srpc::packer& p) {
+		p >> body;
+	}
+};
+
+struct calculate_method_ids {
+	static constexpr uint32_t square = 0;
+};
+
 /// CLIENT 
 struct calculate_stub {
-	calculate_stub() {
-		if (!_init) {
-			srpc::message_registry["number"] = []() -> std::unique_ptr<number> {
-				return std::make_unique<number>();
-			};
-		}
-		_init = true;
+	void register_insecure_channel(std::string server_ip, std::string port) {
+		_channel = srpc::channel::create(server_ip, port);
 	}
-    ~calculate_stub() { close(this->_socket); }
 
-	void register_insecure_channel(std::string server_ip, std::string port) {
-		if (_socket != -1) { close(_socket); }
-		_socket = srpc::transport::create_client_socket(server_ip, port);
+	void register_channel(srpc::channel::ptr channel) {
+		_channel = std::move(channel);
+	}
+
+	number square(const number& req) {
+		if (_channel->format() == srpc::wire_format::FIXED) {
+			return srpc::fixed_call<number>(*_channel, calculate_method_ids::square, req);
+		}
+
+        srpc::packer pr(_channel->format());
+		pr.set_chained(true);
+		pr.pack_request(calculate_method_ids::square, req);
+
+        srpc::message_t res = _channel->call(pr.release_chain());
+        srpc::packer rpr(std::move(res), pr.format());
+
+		return rpr.unpack_response<number>().take_value();
 	}
 
-	number square(number& req) {
-        srpc::packer pr;
-		srpc::request_t<number> request;
-		request.set_method_name("calculate_servicer::square");
-		request.set_value(std::move(req));
-		pr.pack_request(request);
+	void square_async(const number& req, std::function<void(number)> done) {
+		if (_channel->format() == srpc::wire_format::FIXED) {
+			srpc::fixed_call_then<number>(*_channel, calculate_method_ids::square, req, std::move(done));
+			return;
+		}
 
-		srpc::transport::send_data(_socket, (*pr.buf()).data(), pr.size());
-        srpc::message_t res = srpc::transport::recv_data(_socket);
-        srpc::packer rpr(res.data(), res.size());
+        srpc::packer pr(_channel->format());
+		pr.set_chained(true);
+		pr.pack_request(calculate_method_ids::square, req);
 
-		srpc::response_t<number> msg = rpr.unpack_response<number>();
+		_channel->call_then(pr.release_chain(), [done = std::move(done), format = pr.format()] (srpc::message_t res) {
+			srpc::packer rpr(std::move(res), format);
+			done(rpr.unpack_response<number>().take_value());
+		});
+	}
 
-		return msg.value();
+	std::future<number> square_async(const number& req) {
+		auto p = std::make_shared<std::promise<number>>();
+		std::future<number> f = p->get_future();
+		square_async(req, [p] (number v) { p->set_value(std::move(v)); });
+		return f;
+	}
+
+	srpc::callback_awaitable<number> square_co(const number& req) {
+		return srpc::callback_awaitable<number>([this, req] (std::function<void(number)> done) mutable {
+			square_async(req, std::move(done));
+		});
 	}
 
 private:
-	static bool _init;
-	int32_t     _socket = -1;
+	srpc::channel::ptr _channel;
 };
 
-inline bool calculate_stub::_init = false;
-
 /// SERVICER
 struct calculate_servicer : srpc::servicer_base {
-	virtual number square(number& req) { throw std::runtime_error("Method not implemented!"); }
+	virtual number square([[maybe_unused]] number& req) { throw std::runtime_error("Method not implemented!"); }
 
 	static constexpr const char* name = "calculate";
 	static constexpr auto methods = std::make_tuple(
-		STRUCT_MEMBER(calculate_servicer, square, "calculate_servicer::square")
+		SERVICE_METHOD(calculate_servicer, square, "calculate_servicer::square", calculate_method_ids::square)
 	);
 };
 
@@ -80,6 +198,90 @@ struct calculator : public calculate_servicer {
     }
 };
 
+/// Coroutine servicer that forwards to a downstream calculator and records the
+/// thread it was resumed on.
+struct forwarding_servicer : srpc::servicer_base {
+    srpc::task<number> square(number& req) {
+        number out = co_await downstream->square_co(req);
+        (*resumed_on)[out.num] = std::this_thread::get_id();
+        co_return out;
+    }
+
+    std::shared_ptr<calculate_stub>                                     downstream;
+    std::shared_ptr<std::map<int64_t, std::thread::id>>                 resumed_on;
+
+	static constexpr const char* name = "calculate";
+	static constexpr auto methods = std::make_tuple(
+		SERVICE_METHOD(forwarding_servicer, square, "calculate_servicer::square", calculate_method_ids::square)
+	);
+};
+
+/// Takes the request as a view and records where its string lives.
+struct length_servicer : srpc::servicer_base {
+    number length(text_view& req) {
+        body = req.body;
+        number out;
+        out.num = req.body.size();
+        return out;
+    }
+
+    std::string_view body;
+
+	static constexpr const char* name = "length";
+	static constexpr auto methods = std::make_tuple(
+		SERVICE_METHOD(length_servicer, length, "length_servicer::length", 0)
+	);
+};
+
+/// Sends the text back, large bodies are referenced rather than copied on both ends.
+struct echo_servicer : srpc::servicer_base {
+    text echo(text& req) { return std::move(req); }
+
+	static constexpr const char* name = "echo";
+	static constexpr auto methods = std::make_tuple(
+		SERVICE_METHOD(echo_servicer, echo, "echo_servicer::echo", 0)
+	);
+};
+
+/// Echoes the text from the request's arena and records where the strings were allocated.
+struct arena_echo_servicer : srpc::servicer_base {
+    arena_text echo(arena_text& req) {
+        request_in_arena = dynamic_cast<srpc::request_arena*>(req.get_allocator().resource()) != nullptr;
+        arena_text out(req.get_allocator());
+        out.body = req.body;
+        return out;
+    }
+
+    bool request_in_arena = false;
+
+	static constexpr const char* name = "echo";
+	static constexpr auto methods = std::make_tuple(
+		SERVICE_METHOD(arena_echo_servicer, echo, "arena_echo_servicer::echo", 0)
+	);
+};
+
+/// One method that throws and one that works, served side by side.
+struct failing_servicer : srpc::servicer_base {
+    text fail([[maybe_unused]] text& req) { throw std::runtime_error("Method not implemented!"); }
+    text echo(text& req) { return std::move(req); }
+
+	static constexpr const char* name = "failing";
+	static constexpr auto methods = std::make_tuple(
+		SERVICE_METHOD(failing_servicer, fail, "failing_servicer::fail", 0),
+		SERVICE_METHOD(failing_servicer, echo, "failing_servicer::echo", 1)
+	);
+};
+
+text echo_call(srpc::channel& ch, text& req) {
+    srpc::packer pr(ch.format());
+    pr.set_chained(true);
+    pr.pack_request(0, req);
+
+    srpc::message_t res = ch.call(pr.release_chain());
+    srpc::packer rpr(std::move(res), pr.format());
+    return rpr.unpack_response<text>().take_value();
+}
+
 void srpc::server::__testable_start(std::string const&& port) {
     int32_t listening_fd = transport::create_server_socket(port), accepted_fd;
     struct sockaddr_storage client_addr;
@@ -91,18 +293,19 @@ void srpc::server::__testable_start(std::string const&& port) {
         fprintf(stderr, "srpc::server::start(): accept failed.\n");
     }
 
-    srpc::message_t msg = transport::recv_data(accepted_fd);  
+    uint64_t request_id;
+    srpc::message_t msg = transport::recv_frame(accepted_fd, request_id);  
 
-    // deserialize the method name and service name        
-    packer::ptr p = std::make_shared<packer>(msg.data(), msg.size());
-    std::string funcname;
-    (*p) >> funcname;
+    // deserialize the method id
+    packer::ptr p = std::make_shared<packer>(std::move(msg));
+    uint32_t method_id = 0;
+    (*p) >> method_id;
 
     // call the service's method
-    packer::ptr r = call(funcname, p);
+    packer::ptr r = call(method_id, p);
     assert(r->offset() == 0);
 
-    transport::send_data(accepted_fd, r->data(), r->size());
+    transport::send_data(accepted_fd, r->data(), r->size(), request_id);
 
     close(accepted_fd);
     close(listening_fd);
@@ -111,8 +314,6 @@ void srpc::server::__testable_start(std::string const&& port) {
 namespace srpc {
 
 TEST_CASE("register service", "[server][register][service]") {
-    srpc::message_registry["number"] = []() -> std::unique_ptr<number> { return std::make_unique<number>(); };
-
     server s;
     number input, expected_value;
     request_t<number> req;
@@ -123,21 +324,115 @@ TEST_CASE("register service", "[server][register][service]") {
     expected_value.num = 25;
 
     req.set_value(std::move(input));
-    req.set_method_name("calculate_servicer::square");
+    req.set_method_id(calculate_method_ids::square);
     p->pack_request(req);
 
-    std::string funcname;
-    (*p) >> funcname;
+    uint32_t method_id = 0;
+    (*p) >> method_id;
     
     s.register_service(c); 
 
-    packer::ptr rp = s.call(funcname, p);
+    packer::ptr rp = s.call(method_id, p);
     response_t<number> response = rp->unpack_response<number>();
     
     REQUIRE(response.code() == RPC_SUCCESS);
     REQUIRE(response.value() == expected_value);
 }
 
+TEST_CASE("view handlers read strings in place", "[server][register][service][view]") {
+    server s;
+    length_servicer l;
+    s.register_service(l);
+
+    text t;
+    t.body = std::string(4096, 'x');
+    request_t<text> req;
+    req.set_method_id(0);
+    req.set_value(std::move(t));
+
+    packer pr;
+    pr.pack_request(req);
+    packer::ptr p = std::make_shared<packer>(pr.data(), pr.size());
+    const uint8_t* begin = p->data();
+    const uint8_t* end = begin + p->size();
+    uint32_t method_id = 0;
+    (*p) >> method_id;
+
+    packer::ptr rp = s.call(method_id, p);
+    response_t<number> response = rp->unpack_response<number>();
+    REQUIRE(response.code() == RPC_SUCCESS);
+    REQUIRE(response.value().num == 4096);
+
+    const uint8_t* body = reinterpret_cast<const uint8_t*>(l.body.data());
+    REQUIRE(body >= begin);
+    REQUIRE(body + l.body.size() <= end);
+}
+
+TEST_CASE("arena fields are decoded into the request arena", "[server][register][service][arena]") {
+    server s;
+    arena_echo_servicer e;
+    s.register_service(e);
+
+    text t;
+    t.body = std::string(300, 'x'); // past the small string buffer
+    packer pr;
+    pr.pack_request(0, t);
+
+    size_t live = request_arena::live_count();
+    {
+        request_arena::ptr arena = request_arena::create();
+        message_t frame = buffer_pool::global().acquire(pr.size());
+        std::memcpy(frame.data(), pr.data(), pr.size());
+        packer::ptr p = make_in<packer>(arena, std::move(frame), wire_format::FIXED, arena);
+        uint32_t method_id = 0;
+        (*p) >> method_id;
+
+        packer::ptr rp = s.call(method_id, p);
+        response_t<text> response = rp->unpack_response<text>();
+        REQUIRE(response.code() == RPC_SUCCESS);
+        REQUIRE(response.value().body == t.body);
+    }
+    REQUIRE(e.request_in_arena);
+    REQUIRE(request_arena::live_count() == live);
+}
+
+TEST_CASE("unknown method ids are rejected", "[server][register][service]") {
+    server s;
+    calculator c;
+    s.register_service(c); 
+
+    for (uint32_t id : {uint32_t{1}, uint32_t{SERVER_MAX_METHODS} + 7}) {
+        packer::ptr p = std::make_shared<packer>();
+        (*p) << int64_t{5};
+
+        packer::ptr rp = s.call(id, p);
+        uint8_t code = RPC_SUCCESS;
+        (*rp) >> code;
+        REQUIRE(code == RPC_ERR_FUNCTION_NOT_REGISTERED);
+    }
+}
+
+TEST_CASE("method ids can only be taken once", "[server][register][service]") {
+    server s;
+    calculator c;
+    length_servicer l; // its method is numbered 0 as well
+    s.register_service(c);
+    REQUIRE_THROWS_AS(s.register_service(l), std::logic_error);
+
+    packer::ptr p = std::make_shared<packer>();
+    (*p) << int64_t{5};
+    packer::ptr rp = s.call(calculate_method_ids::square, p);
+    response_t<number> response = rp->unpack_response<number>();
+    REQUIRE(response.code() == RPC_SUCCESS);
+    REQUIRE(response.value().num == 25);
+}
+
+/// Whether reactors run on io_uring here, start_reactor() falls back to epoll otherwise.
+bool uring_reactor_available() {
+    static const bool available = uring_loop([] (packer::ptr, responder) {}).ok();
+    return available;
+}
+
 void run_server() {
     server s;
     calculator c;
@@ -146,6 +441,709 @@ void run_server() {
     s.__testable_start("8081"); 
 }
 
+TEST_CASE("reactor serves persistent connections", "[server][reactor]") {
+    transport::backend backend = GENERATE(transport::backend::SOCKETS, transport::backend::IO_URING);
+    if (backend == transport::backend::IO_URING && !uring_reactor_available()) { SKIP("io_uring unavailable"); }
+    transport::scoped_backend selected(backend); // restored even if a REQUIRE fails
+    constexpr int32_t n_clients = 16, n_calls = 100;
+
+    server s;
+    calculator c;
+    s.register_service(c);
+    std::thread server_thread([&s] () { s.start_reactor("8082"); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    std::vector<std::thread> clients;
+    std::atomic<int32_t> correct = 0;
+    for (int32_t i = 0; i < n_clients; i++) {
+        clients.emplace_back([&correct, i] () {
+            calculate_stub stub;
+            stub.register_insecure_channel("127.0.0.1", "8082");
+            for (int32_t j = 0; j < n_calls; j++) {
+                number input;
+                input.num = i * n_calls + j;
+                int64_t expected = input.num * input.num;
+                if (stub.square(input).num == expected) { correct++; }
+            }
+        });
+    }
+    for (auto& t : clients) { t.join(); }
+
+    s.stop();
+    server_thread.join();
+
+    REQUIRE(correct == n_clients * n_calls);
+}
+
+TEST_CASE("multiple reactors share a port", "[server][reactor]") {
+    transport::backend backend = GENERATE(transport::backend::SOCKETS, transport::backend::IO_URING);
+    if (backend == transport::backend::IO_URING && !uring_reactor_available()) { SKIP("io_uring unavailable"); }
+    transport::scoped_backend selected(backend); // restored even if a REQUIRE fails
+    constexpr int32_t n_clients = 16, n_calls = 100;
+
+    server s;
+    calculator c;
+    s.register_service(c);
+    std::thread server_thread([&s] () { s.start_reactor("8083", 4); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    std::vector<std::thread> clients;
+    std::atomic<int32_t> correct = 0;
+    for (int32_t i = 0; i < n_clients; i++) {
+        clients.emplace_back([&correct, i] () {
+            calculate_stub stub;
+            stub.register_insecure_channel("127.0.0.1", "8083");
+            for (int32_t j = 0; j < n_calls; j++) {
+                number input;
+                input.num = i * n_calls + j;
+                int64_t expected = input.num * input.num;
+                if (stub.square(input).num == expected) { correct++; }
+            }
+        });
+    }
+    for (auto& t : clients) { t.join(); }
+
+    s.stop();
+    server_thread.join();
+
+    REQUIRE(correct == n_clients * n_calls);
+}
+
+TEST_CASE("reactor hands requests to executor", "[server][reactor][executor]") {
+    transport::backend backend = GENERATE(transport::backend::SOCKETS, transport::backend::IO_URING);
+    if (backend == transport::backend::IO_URING && !uring_reactor_available()) { SKIP("io_uring unavailable"); }
+    transport::scoped_backend selected(backend); // restored even if a REQUIRE fails
+    constexpr int32_t n_clients = 16, n_calls = 100;
+
+    server s;
+    calculator c;
+    s.register_service(c);
+    s.set_executor(std::make_shared<work_stealing_executor>(4));
+    std::thread server_thread([&s] () { s.start_reactor("8084"); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    std::vector<std::thread> clients;
+    std::atomic<int32_t> correct = 0;
+    for (int32_t i = 0; i < n_clients; i++) {
+        clients.emplace_back([&correct, i] () {
+            calculate_stub stub;
+            stub.register_insecure_channel("127.0.0.1", "8084");
+            for (int32_t j = 0; j < n_calls; j++) {
+                number input;
+                input.num = i * n_calls + j;
+                int64_t expected = input.num * input.num;
+                if (stub.square(input).num == expected) { correct++; }
+            }
+        });
+    }
+    for (auto& t : clients) { t.join(); }
+
+    s.stop();
+    server_thread.join();
+
+    REQUIRE(correct == n_clients * n_calls);
+    REQUIRE(s.executor()->executed_count() == n_clients * n_calls);
+}
+
+TEST_CASE("reactor answers pipelined requests by request id", "[server][reactor]") {
+    transport::backend backend = GENERATE(transport::backend::SOCKETS, transport::backend::IO_URING);
+    if (backend == transport::backend::IO_URING && !uring_reactor_available()) { SKIP("io_uring unavailable"); }
+    transport::scoped_backend selected(backend); // restored even if a REQUIRE fails
+    constexpr int32_t n_calls = 256;
+
+    server s;
+    calculator c;
+    s.register_service(c);
+    s.set_executor(std::make_shared<work_stealing_executor>(4));
+    std::thread server_thread([&s] () { s.start_reactor("8087"); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    calculate_stub stub; // registers "number"
+    int32_t fd = transport::create_client_socket("127.0.0.1", "8087");
+    REQUIRE(fd >= 0);
+
+    std::vector<packer> requests(n_calls);
+    std::vector<transport::frame_view> frames;
+    for (int32_t i = 0; i < n_calls; i++) {
+        request_t<number> request;
+        request.set_method_id(calculate_method_ids::square);
+        number input;
+        input.num = i;
+        request.set_value(std::move(input));
+        requests[i].pack_request(request);
+        frames.push_back({requests[i].data(), requests[i].size(), static_cast<uint64_t>(i)});
+    }
+    REQUIRE(transport::send_frames(fd, frames.data(), frames.size()) == 0);
+
+    // responses finish on the executor and may come back in any order
+    int32_t correct = 0;
+    for (int32_t i = 0; i < n_calls; i++) {
+        uint64_t request_id;
+        message_t res = transport::recv_frame(fd, request_id);
+        packer rpr(std::move(res));
+        int64_t id = static_cast<int64_t>(request_id);
+        if (rpr.unpack_response<number>().value().num == id * id) { correct++; }
+    }
+    close(fd);
+
+    s.stop();
+    server_thread.join();
+
+    REQUIRE(correct == n_calls);
+}
+
+TEST_CASE("concurrent calls share one connection", "[server][reactor][client]") {
+    constexpr int32_t n_callers = 16, n_calls = 100;
+
+    server s;
+    calculator c;
+    s.register_service(c);
+    s.set_executor(std::make_shared<work_stealing_executor>(4));
+    std::thread server_thread([&s] () { s.start_reactor("8088"); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    std::atomic<int32_t> correct = 0;
+    {
+        calculate_stub stub;
+        stub.register_insecure_channel("127.0.0.1", "8088");
+
+        std::vector<std::thread> callers;
+        for (int32_t i = 0; i < n_callers; i++) {
+            callers.emplace_back([&stub, &correct, i] () {
+                for (int32_t j = 0; j < n_calls; j++) {
+                    number input;
+                    input.num = i * n_calls + j;
+                    int64_t expected = input.num * input.num;
+                    if (stub.square(input).num == expected) { correct++; }
+                }
+            });
+        }
+        for (auto& t : callers) { t.join(); }
+    } // close the client end first
+
+    s.stop();
+    server_thread.join();
+
+    REQUIRE(correct == n_callers * n_calls);
+}
+
+TEST_CASE("async stubs fan out calls from one thread", "[server][reactor][client]") {
+    constexpr int32_t n_calls = 500;
+
+    server s;
+    calculator c;
+    s.register_service(c);
+    s.set_executor(std::make_shared<work_stealing_executor>(4));
+    std::thread server_thread([&s] () { s.start_reactor("8089"); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    int32_t correct_futures = 0;
+    std::atomic<int32_t> correct_callbacks = 0, done_callbacks = 0;
+    {
+        calculate_stub stub;
+        stub.register_insecure_channel("127.0.0.1", "8089");
+
+        std::vector<std::future<number>> futures;
+        for (int32_t i = 0; i < n_calls; i++) {
+            number input;
+            input.num = i;
+            futures.push_back(stub.square_async(input));
+
+            input.num = i;
+            stub.square_async(input, [&correct_callbacks, &done_callbacks, i] (number out) {
+                if (out.num == i * i) { correct_callbacks++; }
+                done_callbacks++;
+            });
+        }
+        for (int32_t i = 0; i < n_calls; i++) {
+            if (futures[i].get().num == i * i) { correct_futures++; }
+        }
+        while (done_callbacks < n_calls) { std::this_thread::yield(); }
+    }
+
+    s.stop();
+    server_thread.join();
+
+    REQUIRE(correct_futures == n_calls);
+    REQUIRE(correct_callbacks == n_calls);
+}
+
+TEST_CASE("coroutine servicer awaits a downstream call", "[server][reactor][coro]") {
+    constexpr int32_t n_callers = 8, n_calls = 50;
+
+    server downstream;
+    calculator c;
+    downstream.register_service(c);
+    std::thread downstream_thread([&downstream] () { downstream.start_reactor("8090"); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    server s;
+    forwarding_servicer f;
+    f.downstream = std::make_shared<calculate_stub>();
+    f.downstream->register_insecure_channel("127.0.0.1", "8090");
+    f.resumed_on = std::make_shared<std::map<int64_t, std::thread::id>>();
+    s.register_service(f);
+
+    std::thread::id loop_thread;
+    std::thread server_thread([&s, &loop_thread] () { 
+        loop_thread = std::this_thread::get_id();
+        s.start_reactor("8091"); 
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    std::atomic<int32_t> correct = 0;
+    {
+        calculate_stub stub;
+        stub.register_insecure_channel("127.0.0.1", "8091");
+
+        std::vector<std::thread> callers;
+        for (int32_t i = 0; i < n_callers; i++) {
+            callers.emplace_back([&stub, &correct, i] () {
+                for (int32_t j = 0; j < n_calls; j++) {
+                    number input;
+                    input.num = i * n_calls + j;
+                    int64_t expected = input.num * input.num;
+                    if (stub.square(input).num == expected) { correct++; }
+                }
+            });
+        }
+        for (auto& t : callers) { t.join(); }
+    }
+
+    s.stop();
+    server_thread.join();
+    downstream.stop();
+    downstream_thread.join();
+
+    REQUIRE(correct == n_callers * n_calls);
+    size_t on_loop = 0;
+    for (auto& [num, id] : *f.resumed_on) { if (id == loop_thread) { on_loop++; } }
+    REQUIRE(on_loop == f.resumed_on->size());
+}
+
+TEST_CASE("stubs share a bounded channel", "[server][reactor][client][channel]") {
+    constexpr int32_t n_stubs = 16, n_calls = 100;
+
+    server s;
+    calculator c;
+    s.register_service(c);
+    s.set_executor(std::make_shared<work_stealing_executor>(4));
+    std::thread server_thread([&s] () { s.start_reactor("8092"); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    channel_options options;
+    options.max_connections = 2;
+    options.max_in_flight = 4;
+    channel::ptr ch = channel::create("127.0.0.1", "8092", options);
+    REQUIRE(ch->connection_count() == 0); // lazy
+
+    std::atomic<int32_t> correct = 0;
+    std::atomic<bool> over_limit = false;
+    std::vector<std::thread> threads;
+    for (int32_t i = 0; i < n_stubs; i++) {
+        threads.emplace_back([&ch, &correct, &over_limit, i] () {
+            calculate_stub stub;
+            stub.register_channel(ch);
+            for (int32_t j = 0; j < n_calls; j++) {
+                number input;
+                input.num = i * n_calls + j;
+                int64_t expected = input.num * input.num;
+                if (stub.square(input).num == expected) { correct++; }
+                if (ch->in_flight() > 2 * 4) { over_limit = true; }
+            }
+        });
+    }
+    for (auto& t : threads) { t.join(); }
+
+    REQUIRE(correct == n_stubs * n_calls);
+    REQUIRE(!over_limit);
+    REQUIRE(ch->connection_count() >= 1);
+    REQUIRE(ch->connection_count() <= 2);
+
+    ch.reset();
+    s.stop();
+    server_thread.join();
+}
+
+TEST_CASE("channel reconnects after the server restarts", "[server][reactor][client][channel]") {
+    calculator c;
+    channel::ptr ch = channel::create("127.0.0.1", "8093");
+    calculate_stub stub;
+    stub.register_channel(ch);
+
+    for (int32_t round = 0; round < 2; round++) {
+        server s;
+        s.register_service(c);
+        std::thread server_thread([&s] () { s.start_reactor("8093"); });
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+        number input;
+        input.num = 3 + round;
+        int64_t expected = input.num * input.num;
+        REQUIRE(stub.square(input).num == expected);
+        REQUIRE(ch->connection_count() == 1);
+
+        s.stop();
+        server_thread.join();
+        std::this_thread::sleep_for(std::chrono::milliseconds(200)); // let the client see the close
+    }
+    REQUIRE(ch->connection_count() == 0);
+}
+
+TEST_CASE("stubs take temporaries and const requests", "[server][reactor][client]") {
+    server s;
+    calculator c;
+    s.register_service(c);
+    std::thread server_thread([&s] () { s.start_reactor("8103"); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    auto of = [] (int64_t v) { number n; n.num = v; return n; };
+    calculate_stub stub;
+    stub.register_insecure_channel("127.0.0.1", "8103");
+    REQUIRE(stub.square(of(3)).num == 9);
+    const number four = of(4);
+    REQUIRE(stub.square(four).num == 16);
+    REQUIRE(stub.square_async(of(5)).get().num == 25);
+
+    s.stop();
+    server_thread.join();
+}
+
+TEST_CASE("channel fails calls when the server is unreachable", "[client][channel]") {
+    packer pr;
+    request_t<number> request;
+    request.set_method_id(calculate_method_ids::square);
+    request.set_value(number{});
+    pr.pack_request(request);
+
+    channel::ptr ch = channel::create("127.0.0.1", "8094");
+    message_t res = ch->call(pr.data(), pr.size());
+    REQUIRE(!res);
+
+    packer rpr(std::move(res));
+    REQUIRE(rpr.unpack_response<number>().code() == RPC_ERR_CONNECTION_CLOSED);
+}
+
+TEST_CASE("channels negotiate the compact wire format", "[server][reactor][client][channel][compact]") {
+    server s;
+    calculator c;
+    s.register_service(c);
+    std::thread server_thread([&s] () { s.start_reactor("8095"); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    channel_options options;
+    options.format = wire_format::COMPACT;
+    channel::ptr ch = channel::create("127.0.0.1", "8095", options);
+    REQUIRE(ch->format() == wire_format::COMPACT);
+    REQUIRE(ch->connection_count() == 1);
+
+    calculate_stub stub;
+    stub.register_channel(ch);
+    for (int64_t v : {int64_t{-3}, int64_t{0}, int64_t{7}, int64_t{1} << 20, -(int64_t{1} << 30)}) {
+        number input;
+        input.num = v;
+        REQUIRE(stub.square(input).num == v * v);
+    }
+
+    // formats the server does not know fall back to FIXED
+    int32_t fd = transport::create_client_socket("127.0.0.1", "8095");
+    REQUIRE(fd >= 0);
+    uint8_t asked = 7;
+    transport::send_data(fd, &asked, sizeof(asked), HANDSHAKE_REQUEST_ID);
+    uint64_t request_id = 0;
+    message_t answer = transport::recv_frame(fd, request_id);
+    REQUIRE(request_id == HANDSHAKE_REQUEST_ID);
+    REQUIRE(answer.size() == 1);
+    REQUIRE(answer.data()[0] == static_cast<uint8_t>(wire_format::FIXED));
+    close(fd);
+
+    ch.reset();
+    s.stop();
+    server_thread.join();
+}
+
+TEST_CASE("large strings travel as chained segments", "[server][reactor][client][iobuf]") {
+    server s;
+    echo_servicer e;
+    s.register_service(e);
+    s.set_executor(std::make_shared<work_stealing_executor>(2));
+    std::thread server_thread([&s] () { s.start_reactor("8096"); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    channel::ptr ch = channel::create("127.0.0.1", "8096");
+    for (size_t size : {size_t{0}, size_t{100}, size_t{IOBUF_REF_MIN}, size_t{4} << 20}) {
+        std::string body(size, '\0');
+        for (size_t i = 0; i < size; i++) { body[i] = static_cast<char>(i * 31 + 7); }
+
+        text req;
+        req.body = body;
+        text res = echo_call(*ch, req);
+        CAPTURE(size);
+        REQUIRE(res.body == body);
+    }
+
+    ch.reset();
+    s.stop();
+    server_thread.join();
+}
+
+TEST_CASE("server calls allocate from pooled arenas", "[server][reactor][arena]") {
+    constexpr int32_t n_warmup = 200, n_calls = 600; // warm up every body size, 100 to 299 bytes
+    server s;
+    echo_servicer e;
+    s.register_service(e);
+    std::thread server_thread([&s] () { s.start_reactor("8097"); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    size_t live = request_arena::live_count();
+    channel::ptr ch = channel::create("127.0.0.1", "8097");
+    auto call = [&ch] (int32_t i) {
+        text req;
+        req.body = std::string(100 + i % 200, 'a');
+        return echo_call(*ch, req).body.size() == 100 + static_cast<size_t>(i % 200);
+    };
+    for (int32_t i = 0; i < n_warmup; i++) { REQUIRE(call(i)); }
+
+    uint64_t misses = buffer_pool::global().miss_count();
+    int32_t ok = 0;
+    for (int32_t i = 0; i < n_calls; i++) { ok += call(i); }
+    REQUIRE(ok == n_calls);
+    REQUIRE(buffer_pool::global().miss_count() == misses); // steady state: no new pool memory
+
+    ch.reset();
+    s.stop();
+    server_thread.join();
+    REQUIRE(request_arena::live_count() == live); // every call gave its arena back
+}
+
+TEST_CASE("reactors do not allocate from the heap per request", "[server][reactor][arena][malloc]") {
+    transport::backend backend = GENERATE(transport::backend::SOCKETS, transport::backend::IO_URING);
+    if (backend == transport::backend::IO_URING && !uring_reactor_available()) { SKIP("io_uring unavailable"); }
+    transport::scoped_backend selected(backend); // restored even if a REQUIRE fails
+    if (!COUNTS_ALLOCATIONS) { SKIP("allocations are not counted under sanitizers"); }
+    constexpr uint64_t n_warmup = 1000, n_calls = 1000;
+
+    server s;
+    calculator c;
+    arena_echo_servicer e;
+    std::function<bool(int32_t, uint64_t)> call;
+    SECTION("fixed-size messages") {
+        s.register_service(c);
+        call = [] (int32_t fd, uint64_t id) {
+            number input;
+            input.num = static_cast<int64_t>(id);
+            packer req;
+            req.pack_request(calculate_method_ids::square, input);
+            transport::send_data(fd, req.data(), req.size(), id);
+            uint64_t request_id = 0;
+            packer rpr(transport::recv_frame(fd, request_id));
+            return request_id == id && rpr.unpack_response<number>().value().num == input.num * input.num;
+        };
+    }
+    SECTION("arena strings") {
+        s.register_service(e);
+        call = [] (int32_t fd, uint64_t id) {
+            text input;
+            input.body = std::string(300, 'x'); // past the small string buffer
+            packer req;
+            req.pack_request(0, input);
+            transport::send_data(fd, req.data(), req.size(), id);
+            uint64_t request_id = 0;
+            packer rpr(transport::recv_frame(fd, request_id));
+            return request_id == id && rpr.unpack_response<text>().value().body == input.body;
+        };
+    }
+    std::thread server_thread([&s] () { 
+        count_allocations = true;
+        s.start_reactor("8102"); 
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    int32_t fd = transport::create_client_socket("127.0.0.1", "8102");
+    REQUIRE(fd >= 0);
+    bool correct = true;
+    for (uint64_t id = 1; id <= n_warmup; id++) { correct = correct && call(fd, id); }
+    size_t before = counted_allocations.load();
+    for (uint64_t id = n_warmup + 1; id <= n_warmup + n_calls; id++) { correct = correct && call(fd, id); }
+    size_t after = counted_allocations.load();
+    close(fd);
+
+    s.stop();
+    server_thread.join();
+    REQUIRE(correct);
+    REQUIRE(after - before == 0);
+}
+
+TEST_CASE("malformed requests get an error and keep the connection", "[server][reactor][malformed]") {
+    transport::backend backend = GENERATE(transport::backend::SOCKETS, transport::backend::IO_URING);
+    if (backend == transport::backend::IO_URING && !uring_reactor_available()) { SKIP("io_uring unavailable"); }
+    transport::scoped_backend selected(backend); // restored even if a REQUIRE fails
+    server s;
+    echo_servicer e;
+    s.register_service(e);
+    std::thread server_thread([&s] () { s.start_reactor("8098"); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    int32_t fd = transport::create_client_socket("127.0.0.1", "8098");
+    REQUIRE(fd >= 0);
+    auto status_of = [fd] (packer& req, uint64_t id) {
+        transport::send_data(fd, req.data(), req.size(), id);
+        uint64_t request_id = 0;
+        packer rpr(transport::recv_frame(fd, request_id));
+        REQUIRE(request_id == id);
+        return rpr.unpack_response<text>();
+    };
+
+    packer no_method;
+    no_method << uint16_t{0};
+    REQUIRE(status_of(no_method, 1).code() == RPC_ERR_MALFORMED_MESSAGE);
+
+    packer huge_length;
+    huge_length << uint32_t{0} << ~size_t{0} << uint64_t{0};
+    REQUIRE(status_of(huge_length, 2).code() == RPC_ERR_MALFORMED_MESSAGE);
+
+    text body;
+    body.body = "still here";
+    packer ok;
+    ok.pack_request(0, body);
+    response_t<text> res = status_of(ok, 3);
+    REQUIRE(res.code() == RPC_SUCCESS);
+    REQUIRE(res.value().body == "still here");
+    close(fd);
+
+    s.stop();
+    server_thread.join();
+}
+
+TEST_CASE("throwing handlers fail their call and keep the connection", "[server][reactor][throw]") {
+    transport::backend backend = GENERATE(transport::backend::SOCKETS, transport::backend::IO_URING);
+    if (backend == transport::backend::IO_URING && !uring_reactor_available()) { SKIP("io_uring unavailable"); }
+    transport::scoped_backend selected(backend); // restored even if a REQUIRE fails
+    server s;
+    failing_servicer f;
+    s.register_service(f);
+    SECTION("inline handlers") {}
+    SECTION("executor handlers") { s.set_executor(std::make_shared<work_stealing_executor>(2)); }
+    std::thread server_thread([&s] () { s.start_reactor("8100"); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    int32_t fd = transport::create_client_socket("127.0.0.1", "8100");
+    REQUIRE(fd >= 0);
+    auto call = [fd] (uint32_t method_id, uint64_t id) {
+        text body;
+        body.body = "still here";
+        packer req;
+        req.pack_request(method_id, body);
+        transport::send_data(fd, req.data(), req.size(), id);
+        uint64_t request_id = 0;
+        packer rpr(transport::recv_frame(fd, request_id));
+        REQUIRE(request_id == id);
+        return rpr.unpack_response<text>();
+    };
+
+    REQUIRE(call(0, 1).code() == RPC_ERR_HANDLER_FAILED);
+    response_t<text> res = call(1, 2);
+    REQUIRE(res.code() == RPC_SUCCESS);
+    REQUIRE(res.value().body == "still here");
+    close(fd);
+
+    s.stop();
+    server_thread.join();
+}
+
+TEST_CASE("reactors answer for frame handlers that throw", "[server][reactor][throw]") {
+    transport::backend backend = GENERATE(transport::backend::SOCKETS, transport::backend::IO_URING);
+    if (backend == transport::backend::IO_URING && !uring_reactor_available()) { SKIP("io_uring unavailable"); }
+    transport::scoped_backend selected(backend); // restored even if a REQUIRE fails
+    work_stealing_executor::ptr executor;
+    SECTION("inline handlers") {}
+    SECTION("executor handlers") { executor = std::make_shared<work_stealing_executor>(2); }
+    reactor::frame_handler handler = [] (packer::ptr, responder) { throw std::runtime_error("handler failed"); };
+    reactor::ptr loop;
+    if (backend == transport::backend::IO_URING) {
+        loop = std::make_unique<uring_loop>(handler, executor);
+    } else {
+        loop = std::make_unique<event_loop>(handler, executor);
+    }
+    REQUIRE(loop->adopt_listener(transport::create_server_socket("8101")) >= 0);
+    std::thread loop_thread([&loop] () { loop->run(); });
+
+    int32_t fd = transport::create_client_socket("127.0.0.1", "8101");
+    REQUIRE(fd >= 0);
+    for (uint64_t id = 1; id <= 2; id++) {
+        packer req;
+        req << uint32_t{0};
+        transport::send_data(fd, req.data(), req.size(), id);
+        uint64_t request_id = 0;
+        packer rpr(transport::recv_frame(fd, request_id));
+        REQUIRE(request_id == id);
+        REQUIRE(rpr.unpack_response<text>().code() == RPC_ERR_HANDLER_FAILED);
+    }
+    close(fd);
+
+    loop->stop();
+    loop_thread.join();
+    loop.reset(); // waits for every dispatched request to be answered
+}
+
+TEST_CASE("half-closed connections are answered before being closed", "[server][reactor][halfclose]") {
+    transport::backend backend = GENERATE(transport::backend::SOCKETS, transport::backend::IO_URING);
+    if (backend == transport::backend::IO_URING && !uring_reactor_available()) { SKIP("io_uring unavailable"); }
+    transport::scoped_backend selected(backend); // restored even if a REQUIRE fails
+    server s;
+    echo_servicer e;
+    s.register_service(e);
+    SECTION("inline handlers") {}
+    SECTION("executor handlers") { s.set_executor(std::make_shared<work_stealing_executor>(2)); }
+    std::thread server_thread([&s] () { s.start_reactor("8099"); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    int32_t fd = transport::create_client_socket("127.0.0.1", "8099");
+    REQUIRE(fd >= 0);
+    text body;
+    body.body = "last words";
+    packer req;
+    req.pack_request(0, body);
+    transport::send_data(fd, req.data(), req.size(), 7);
+    REQUIRE(shutdown(fd, SHUT_WR) == 0);
+
+    uint64_t request_id = 0;
+    packer rpr(transport::recv_frame(fd, request_id));
+    REQUIRE(request_id == 7);
+    response_t<text> res = rpr.unpack_response<text>();
+    REQUIRE(res.code() == RPC_SUCCESS);
+    REQUIRE(res.value().body == "last words");
+    uint8_t byte;
+    REQUIRE(recv(fd, &byte, 1, 0) == 0); // closed once answered
+    close(fd);
+
+    s.stop();
+    server_thread.join();
+}
+
+TEST_CASE("oversized frames close the connection", "[server][reactor][malformed]") {
+    transport::backend backend = GENERATE(transport::backend::SOCKETS, transport::backend::IO_URING);
+    if (backend == transport::backend::IO_URING && !uring_reactor_available()) { SKIP("io_uring unavailable"); }
+    transport::scoped_backend selected(backend); // restored even if a REQUIRE fails
+    server s;
+    echo_servicer e;
+    s.register_service(e);
+    std::thread server_thread([&s] () { s.start_reactor("8099"); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    int32_t fd = transport::create_client_socket("127.0.0.1", "8099");
+    REQUIRE(fd >= 0);
+    uint8_t header[FRAME_HEADER_SZ];
+    transport::encode_header(header, FRAME_MAX_SZ + 1, 1);
+    REQUIRE(send(fd, header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header)));
+    uint8_t byte;
+    REQUIRE(recv(fd, &byte, 1, 0) == 0);
+    close(fd);
+
+    s.stop();
+    server_thread.join();
+}
+
 /*TEST_CASE("start server", "[server]") {*/
 /*    number input, expected, rcv;*/
 /**/
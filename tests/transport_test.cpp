@@ -35,18 +35,18 @@ void run_server(std::string port) {
     close(accepted_fd);
 }
 
-const uint8_t* run_client(std::string server_ip, std::string port, const uint8_t* data, size_t len) {
+std::vector<uint8_t> run_client(std::string server_ip, std::string port, const uint8_t* data, size_t len) {
     int32_t client_fd; 
     if ((client_fd = transport::create_client_socket(server_ip, port)) < 0) {
         fprintf(stderr, "run_client(): create client socket failed.\n");
-        return nullptr;   
+        return {};   
     }
     transport::send_data(client_fd, data, len);
     
     message_t response = transport::recv_data(client_fd);
     close(client_fd); 
 
-    return response.data();
+    return std::vector<uint8_t>(response.data(), response.data() + response.size());
 }
 
 
@@ -57,10 +57,130 @@ TEST_CASE("send vector to server", "[socket][server][client]") {
     const uint8_t data[] = {65, 66, 67, 68, 69};
     const uint8_t expected[] = {70, 71, 72, 73, 74, 123};
 
-    const uint8_t* res = run_client("127.0.0.1", PORT, data, 5);
+    std::vector<uint8_t> res = run_client("127.0.0.1", PORT, data, 5);
     server_thread.join();
 
-    REQUIRE(std::memcmp(expected, res, 6) == 0);
+    REQUIRE(res.size() == 6);
+    REQUIRE(std::memcmp(expected, res.data(), 6) == 0);
+}
+
+TEST_CASE("send_frames survives partial writes", "[socket][transport]") {
+    constexpr size_t n_frames = 100, frame_size = 10000;
+
+    int32_t fds[2];
+    REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    int32_t sndbuf = 4096; // far less than one batch, forces short writes
+    setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+
+    std::vector<std::vector<uint8_t>> payloads;
+    std::vector<transport::frame_view> frames;
+    for (size_t i = 0; i < n_frames; i++) {
+        payloads.emplace_back(frame_size, static_cast<uint8_t>(i));
+    }
+    for (auto& p : payloads) { frames.push_back({p.data(), p.size()}); }
+
+    int32_t status = -1;
+    std::thread sender([&] () { status = transport::send_frames(fds[0], frames.data(), frames.size()); });
+
+    size_t intact = 0;
+    for (size_t i = 0; i < n_frames; i++) {
+        message_t msg = transport::recv_data(fds[1]);
+        if (msg.size() == frame_size && std::memcmp(msg.data(), payloads[i].data(), frame_size) == 0) { intact++; }
+    }
+    sender.join();
+    close(fds[0]);
+    close(fds[1]);
+
+    REQUIRE(status == 0);
+    REQUIRE(intact == n_frames);
+}
+
+TEST_CASE("send_chain writes every segment of a long chain", "[socket][transport][iobuf]") {
+    constexpr size_t n_segments = 3 * SEND_MAX_IOV, segment_size = 1000;
+
+    int32_t fds[2];
+    REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    int32_t sndbuf = 4096;
+    setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+
+    std::vector<std::vector<uint8_t>> blocks;
+    for (size_t i = 0; i < n_segments; i++) { blocks.emplace_back(segment_size, static_cast<uint8_t>(i)); }
+    iobuf chain;
+    for (auto& b : blocks) { chain.append_ref(b.data(), b.size()); }
+    REQUIRE(chain.size() == n_segments * segment_size);
+
+    int32_t status = -1;
+    std::thread sender([&] () { status = transport::send_chain(fds[0], chain, 42); });
+
+    uint64_t request_id = 0;
+    message_t msg = transport::recv_frame(fds[1], request_id);
+    sender.join();
+    close(fds[0]);
+    close(fds[1]);
+
+    REQUIRE(status == 0);
+    REQUIRE(request_id == 42);
+    REQUIRE(msg.size() == chain.size());
+    std::vector<uint8_t> expected = chain.flatten();
+    REQUIRE(std::memcmp(msg.data(), expected.data(), expected.size()) == 0);
+}
+
+TEST_CASE("frame_reader reassembles frames read in pieces", "[transport][frame_reader]") {
+    std::vector<uint8_t> stream;
+    auto append = [&stream] (uint64_t request_id, size_t len) {
+        uint8_t header[FRAME_HEADER_SZ];
+        transport::encode_header(header, static_cast<uint32_t>(len), request_id);
+        stream.insert(stream.end(), header, header + sizeof(header));
+        for (size_t i = 0; i < len; i++) { stream.push_back(static_cast<uint8_t>(request_id + i)); }
+    };
+    append(1, 5);
+    append(2, 0);
+    append(3, 20000);
+    append(4, 3);
+
+    std::vector<std::pair<uint64_t, size_t>> frames;
+    bool intact = true;
+    auto on_frame = [&frames, &intact] (uint64_t request_id, message_t&& msg) {
+        for (size_t i = 0; i < msg.size(); i++) {
+            if (msg.data()[i] != static_cast<uint8_t>(request_id + i)) { intact = false; }
+        }
+        frames.emplace_back(request_id, msg.size());
+    };
+    const std::vector<std::pair<uint64_t, size_t>> expected = { {1, 5}, {2, 0}, {3, 20000}, {4, 3} };
+
+    SECTION("fed one byte at a time") {
+        transport::frame_reader reader;
+        bool fed = true;
+        for (uint8_t b : stream) { fed = reader.feed(&b, 1, on_frame) && fed; }
+        REQUIRE(fed);
+    }
+    SECTION("large payloads received in place") {
+        transport::frame_reader reader;
+        size_t pos = 0;
+        while (pos < stream.size()) {
+            if (reader.remaining() > 0) {
+                size_t n = std::min<size_t>(reader.remaining(), 7000);
+                std::memcpy(reader.space(), stream.data() + pos, n);
+                reader.received(n, on_frame);
+                pos += n;
+            } else {
+                size_t n = std::min<size_t>(stream.size() - pos, 10);
+                REQUIRE(reader.feed(stream.data() + pos, n, on_frame));
+                pos += n;
+            }
+        }
+    }
+    REQUIRE(frames == expected);
+    REQUIRE(intact);
+}
+
+TEST_CASE("frame_reader refuses oversized frames", "[transport][frame_reader]") {
+    uint8_t header[FRAME_HEADER_SZ];
+    transport::encode_header(header, FRAME_MAX_SZ + 1, 1);
+    transport::frame_reader reader;
+    bool called = false;
+    REQUIRE_FALSE(reader.feed(header, sizeof(header), [&called] (uint64_t, message_t&&) { called = true; }));
+    REQUIRE_FALSE(called);
 }
 
 } // namespace srpc
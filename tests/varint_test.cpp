@@ -0,0 +1,187 @@
+#include <srpc/varint.hpp>
+#include <srpc/varint_array.hpp>
+#include <srpc/packer.hpp>
+
+#include <limits>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include <cstdint>
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/catch_message.hpp>
+
+namespace srpc {
+
+TEST_CASE("varints encode seven bits per byte", "[varint]") {
+    uint8_t out[VARINT_MAX_BYTES];
+
+    REQUIRE(varint::encode(0, out) == 1);
+    REQUIRE(out[0] == 0);
+
+    REQUIRE(varint::encode(300, out) == 2);
+    REQUIRE(out[0] == 0xac);
+    REQUIRE(out[1] == 0x02);
+
+    REQUIRE(varint::encode(std::numeric_limits<uint64_t>::max(), out) == VARINT_MAX_BYTES);
+    REQUIRE(varint::encoded_size(std::numeric_limits<uint64_t>::max()) == VARINT_MAX_BYTES);
+    REQUIRE(varint::encoded_size(127) == 1);
+    REQUIRE(varint::encoded_size(128) == 2);
+}
+
+TEST_CASE("zigzag keeps small negative numbers small", "[varint]") {
+    REQUIRE(varint::zigzag(int64_t{0}) == 0);
+    REQUIRE(varint::zigzag(int64_t{-1}) == 1);
+    REQUIRE(varint::zigzag(int64_t{1}) == 2);
+    REQUIRE(varint::zigzag(int32_t{-2}) == 3);
+    REQUIRE(varint::zigzag(std::numeric_limits<int64_t>::min()) == std::numeric_limits<uint64_t>::max());
+
+    for (int64_t v : {int64_t{0}, int64_t{-1}, int64_t{63}, int64_t{-64}, std::numeric_limits<int64_t>::max(),
+                      std::numeric_limits<int64_t>::min()}) {
+        REQUIRE(varint::unzigzag<int64_t>(varint::zigzag(v)) == v);
+    }
+    for (int16_t v : {int16_t{-300}, int16_t{300}, std::numeric_limits<int16_t>::min()}) {
+        REQUIRE(varint::unzigzag<int16_t>(varint::zigzag(v)) == v);
+    }
+}
+
+TEST_CASE("fast and byte-wise varint decoding agree", "[varint]") {
+    std::vector<uint64_t> values;
+    for (int32_t shift = 0; shift < 64; shift++) {
+        uint64_t p = uint64_t{1} << shift;
+        values.insert(values.end(), {p - 1, p, p + 1});
+    }
+    values.push_back(std::numeric_limits<uint64_t>::max());
+
+    for (uint64_t v : values) {
+        CAPTURE(v);
+        uint8_t padded[VARINT_MAX_BYTES + 8] = {};  // room for the 8-byte load
+        size_t n = varint::encode(v, padded);
+        REQUIRE(n == varint::encoded_size(v));
+
+        uint64_t fast = 0, exact = 0;
+        REQUIRE(varint::decode(padded, sizeof(padded), fast) == n);
+        REQUIRE(varint::decode(padded, n, exact) == n);  // too short for the fast path
+        REQUIRE(fast == v);
+        REQUIRE(exact == v);
+    }
+}
+
+TEST_CASE("truncated varints are rejected", "[varint]") {
+    uint8_t out[VARINT_MAX_BYTES];
+    size_t n = varint::encode(uint64_t{1} << 40, out);
+
+    uint64_t v = 0;
+    REQUIRE(varint::decode(out, n - 1, v) == 0);
+    REQUIRE(varint::decode(out, 0, v) == 0);
+}
+
+template <typename T>
+void check_array_kernels(std::mt19937_64& rng) {
+    for (int32_t trial = 0; trial < 200; trial++) {
+        size_t n = rng() % 200;
+        std::vector<T> in(n);
+        for (T& v : in) {
+            // runs of small numbers (the vectorized cases) mixed with anything
+            int32_t bits = trial % 4 == 0 ? 6 : trial % 4 == 1 ? 13 : static_cast<int32_t>(rng() % 64);
+            v = static_cast<T>(rng() & ((uint64_t{1} << bits) - 1));
+        }
+        CAPTURE(trial, n);
+
+        std::vector<uint8_t> scalar(n * VARINT_MAX_BYTES);
+        scalar.resize(varint::encode_array(in.data(), n, scalar.data(), varint::simd::NONE));
+
+        for (varint::simd level : {varint::simd::SSE4, varint::simd::AVX2}) {
+            if (level > varint::cpu_simd()) { continue; }
+            CAPTURE(static_cast<int32_t>(level));
+
+            std::vector<uint8_t> simd(n * VARINT_MAX_BYTES);
+            simd.resize(varint::encode_array(in.data(), n, simd.data(), level));
+            REQUIRE(simd == scalar);
+
+            std::vector<T> out(n);
+            REQUIRE(varint::decode_array(scalar.data(), scalar.size(), out.data(), n, level) == (n ? scalar.size() : 0));
+            REQUIRE(out == in);
+        }
+    }
+}
+
+TEST_CASE("vectorized array kernels match the scalar ones", "[varint][simd]") {
+    std::mt19937_64 rng(7);
+    check_array_kernels<int32_t>(rng);
+    check_array_kernels<int64_t>(rng);
+    check_array_kernels<uint32_t>(rng);
+    check_array_kernels<uint64_t>(rng);
+}
+
+/// Encodes and decodes 1M values of at most bits bits with every kernel the CPU has, 
+/// printing throughput in GB/s of the integer array.
+template <typename T>
+void bench_array_kernels(const char* type_name, int32_t bits) {
+    constexpr size_t n = size_t{1} << 20;
+    constexpr int32_t rounds = 50;
+
+    std::mt19937_64 rng(11);
+    std::vector<T> in(n);
+    for (T& v : in) { v = static_cast<T>(rng() & ((uint64_t{1} << bits) - 1)); }
+    std::vector<uint8_t> bytes(n * VARINT_MAX_BYTES);
+    std::vector<T> out(n);
+    const double gb = static_cast<double>(n * sizeof(T)) * rounds / 1e9;
+
+    for (varint::simd level : {varint::simd::NONE, varint::simd::SSE4, varint::simd::AVX2}) {
+        if (level > varint::cpu_simd()) { continue; }
+
+        size_t len = 0, consumed = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int32_t r = 0; r < rounds; r++) { len = varint::encode_array(in.data(), n, bytes.data(), level); }
+        std::chrono::duration<double> encode = std::chrono::steady_clock::now() - start;
+
+        start = std::chrono::steady_clock::now();
+        for (int32_t r = 0; r < rounds; r++) { consumed = varint::decode_array(bytes.data(), len, out.data(), n, level); }
+        std::chrono::duration<double> decode = std::chrono::steady_clock::now() - start;
+
+        REQUIRE(consumed == len);
+        REQUIRE(out == in);
+        const char* level_name = level == varint::simd::AVX2 ? "avx2" : level == varint::simd::SSE4 ? "sse4.1" : "scalar";
+        printf("%-6s %2d-bit  %-6s  encode %6.2f GB/s  decode %6.2f GB/s\n", 
+                type_name, bits, level_name, gb / encode.count(), gb / decode.count());
+    }
+}
+
+/// Hidden, run with ./unit_tests "[!benchmark]" on an optimized build.
+TEST_CASE("varint array kernel throughput", "[!benchmark][varint][simd]") {
+    bench_array_kernels<int32_t>("int32", 6);
+    bench_array_kernels<int32_t>("int32", 13);
+    bench_array_kernels<int32_t>("int32", 31);
+    bench_array_kernels<int64_t>("int64", 6);
+    bench_array_kernels<int64_t>("int64", 13);
+    bench_array_kernels<int64_t>("int64", 40);
+}
+
+TEST_CASE("truncated varint arrays are rejected", "[varint][simd]") {
+    std::vector<int32_t> in(64, -5);
+    in.back() = 1 << 20;
+    std::vector<uint8_t> bytes(in.size() * VARINT_MAX_BYTES);
+    bytes.resize(varint::encode_array(in.data(), in.size(), bytes.data()));
+
+    std::vector<int32_t> out(in.size());
+    REQUIRE(varint::decode_array(bytes.data(), bytes.size() - 1, out.data(), out.size()) == 0);
+    REQUIRE(varint::decode_array(bytes.data(), bytes.size(), out.data(), out.size()) == bytes.size());
+    REQUIRE(out == in);
+}
+
+TEST_CASE("compact repeated integers round trip through the packer", "[varint][simd][pack]") {
+    std::vector<int64_t> in(1000);
+    for (size_t i = 0; i < in.size(); i++) { in[i] = i % 3 == 0 ? -static_cast<int64_t>(i) : static_cast<int64_t>(i % 50); }
+
+    packer pr(wire_format::COMPACT);
+    pr << in;
+    REQUIRE(pr.size() == packer::encoded_size(in, wire_format::COMPACT));
+
+    std::vector<int64_t> out;
+    pr >> out;
+    REQUIRE(out == in);
+    REQUIRE(pr.size() == 0);
+}
+
+} // namespace srpc